@@ -19,6 +19,23 @@ SOURCE_GROUP(X11 FILES ${PLATFORM})
 add_definitions(
 )
 
+# Run the network threads' I/O services on io_uring rather than epoll. This needs a Boost.Asio
+# with io_uring support (Boost 1.78 or later, so a system Boost rather than the one bundled with
+# FireBreath) and liburing, and applies to every network thread. Reads and writes go through the
+# ring on the pooled buffers as they are, without registering them with the kernel.
+option(SOCKIT_IO_URING "Use io_uring as the Boost.Asio backend" OFF)
+
+if (SOCKIT_IO_URING)
+    if (NOT WITH_SYSTEM_BOOST)
+        message(FATAL_ERROR "SOCKIT_IO_URING needs Boost 1.78 or later, configure with -DWITH_SYSTEM_BOOST=1")
+    endif()
+    add_definitions(
+        -DBOOST_ASIO_HAS_IO_URING
+        -DBOOST_ASIO_HAS_IO_URING_AS_DEFAULT
+    )
+    set(SOCKIT_PLATFORM_LIBS uring)
+endif()
+
 set (SOURCES
     ${SOURCES}
     ${PLATFORM}
@@ -29,4 +46,5 @@ add_x11_plugin(${PROJECT_NAME} SOURCES)
 # add library dependencies here; leave ${PLUGIN_INTERNAL_DEPS} there unless you know what you're doing!
 target_link_libraries(${PROJECT_NAME}
     ${PLUGIN_INTERNAL_DEPS}
+    ${SOCKIT_PLATFORM_LIBS}
     )
@@ -0,0 +1,310 @@
+/*
+ * Binary.cpp
+ *
+ *  Created on: Oct 17, 2026
+ */
+
+#include "Binary.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define BINARY_SSE2
+#include <emmintrin.h>
+#endif
+
+#if defined(BINARY_SSE2) && (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define BINARY_AVX2
+#include <immintrin.h>
+#define AVX2_TARGET __attribute__((target("avx2")))
+#endif
+
+namespace
+{
+	// Each kernel converts as many whole vectors as the data holds, and returns the number of elements it converted,
+	// leaving the rest to the next narrower kernel. The kernels are named for the width in bits of the characters they
+	// read or write, and only touch those characters through vector loads and stores, so the loops over the typed
+	// characters are left to the callers.
+
+#if defined(BINARY_AVX2)
+
+	/** Whether the processor supports AVX2, which is only known at run time */
+	const bool has_avx2 = __builtin_cpu_supports("avx2");
+
+	AVX2_TARGET size_t widen32_avx2(const unsigned char * in, size_t size, void * out)
+	{
+		char * bytes = (char *) out;
+
+		size_t i = 0;
+		for (; i + 8 <= size; i += 8)
+		{
+			__m128i chars = _mm_loadl_epi64((const __m128i *) (in + i));
+			_mm256_storeu_si256((__m256i *) (bytes + 4 * i), _mm256_cvtepu8_epi32(chars));
+		}
+		return i;
+	}
+
+	AVX2_TARGET size_t widen16_avx2(const unsigned char * in, size_t size, void * out)
+	{
+		char * bytes = (char *) out;
+
+		size_t i = 0;
+		for (; i + 16 <= size; i += 16)
+		{
+			__m128i chars = _mm_loadu_si128((const __m128i *) (in + i));
+			_mm256_storeu_si256((__m256i *) (bytes + 2 * i), _mm256_cvtepu8_epi16(chars));
+		}
+		return i;
+	}
+
+	AVX2_TARGET size_t mask32_avx2(const void * in, size_t size, void * out)
+	{
+		const char * words = (const char *) in;
+		char * bytes = (char *) out;
+		const __m128i mask = _mm_set1_epi16(0xff);
+
+		size_t i = 0;
+		for (; i + 8 <= size; i += 8)
+		{
+			__m128i low = _mm_and_si128(_mm_loadu_si128((const __m128i *) (words + 2 * i)), mask);
+			_mm256_storeu_si256((__m256i *) (bytes + 4 * i), _mm256_cvtepu16_epi32(low));
+		}
+		return i;
+	}
+
+	AVX2_TARGET size_t mask16_avx2(const void * in, size_t size, void * out)
+	{
+		const char * words = (const char *) in;
+		char * bytes = (char *) out;
+		const __m256i mask = _mm256_set1_epi16(0xff);
+
+		size_t i = 0;
+		for (; i + 16 <= size; i += 16)
+		{
+			__m256i low = _mm256_and_si256(_mm256_loadu_si256((const __m256i *) (words + 2 * i)), mask);
+			_mm256_storeu_si256((__m256i *) (bytes + 2 * i), low);
+		}
+		return i;
+	}
+
+	AVX2_TARGET size_t narrow32_avx2(const void * in, size_t size, char * out)
+	{
+		const char * words = (const char *) in;
+		const __m256i mask = _mm256_set1_epi32(0xff);
+
+		// The packs interleave the two lanes of each register, which the final permute puts back in order
+		const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+
+		size_t i = 0;
+		for (; i + 32 <= size; i += 32)
+		{
+			__m256i a = _mm256_and_si256(_mm256_loadu_si256((const __m256i *) (words + 4 * i)), mask);
+			__m256i b = _mm256_and_si256(_mm256_loadu_si256((const __m256i *) (words + 4 * i + 32)), mask);
+			__m256i c = _mm256_and_si256(_mm256_loadu_si256((const __m256i *) (words + 4 * i + 64)), mask);
+			__m256i d = _mm256_and_si256(_mm256_loadu_si256((const __m256i *) (words + 4 * i + 96)), mask);
+
+			__m256i bytes = _mm256_packus_epi16(_mm256_packs_epi32(a, b), _mm256_packs_epi32(c, d));
+			_mm256_storeu_si256((__m256i *) (out + i), _mm256_permutevar8x32_epi32(bytes, order));
+		}
+		return i;
+	}
+
+	AVX2_TARGET size_t narrow16_avx2(const void * in, size_t size, char * out)
+	{
+		const char * words = (const char *) in;
+		const __m256i mask = _mm256_set1_epi16(0xff);
+
+		size_t i = 0;
+		for (; i + 32 <= size; i += 32)
+		{
+			__m256i a = _mm256_and_si256(_mm256_loadu_si256((const __m256i *) (words + 2 * i)), mask);
+			__m256i b = _mm256_and_si256(_mm256_loadu_si256((const __m256i *) (words + 2 * i + 32)), mask);
+
+			__m256i bytes = _mm256_packus_epi16(a, b);
+			_mm256_storeu_si256((__m256i *) (out + i), _mm256_permute4x64_epi64(bytes, 0xd8));
+		}
+		return i;
+	}
+
+#endif
+
+#if defined(BINARY_SSE2)
+
+	size_t widen32_sse2(const unsigned char * in, size_t size, void * out)
+	{
+		char * bytes = (char *) out;
+		const __m128i zero = _mm_setzero_si128();
+
+		size_t i = 0;
+		for (; i + 16 <= size; i += 16)
+		{
+			__m128i chars = _mm_loadu_si128((const __m128i *) (in + i));
+			__m128i low = _mm_unpacklo_epi8(chars, zero);
+			__m128i high = _mm_unpackhi_epi8(chars, zero);
+
+			_mm_storeu_si128((__m128i *) (bytes + 4 * i), _mm_unpacklo_epi16(low, zero));
+			_mm_storeu_si128((__m128i *) (bytes + 4 * i + 16), _mm_unpackhi_epi16(low, zero));
+			_mm_storeu_si128((__m128i *) (bytes + 4 * i + 32), _mm_unpacklo_epi16(high, zero));
+			_mm_storeu_si128((__m128i *) (bytes + 4 * i + 48), _mm_unpackhi_epi16(high, zero));
+		}
+		return i;
+	}
+
+	size_t widen16_sse2(const unsigned char * in, size_t size, void * out)
+	{
+		char * bytes = (char *) out;
+		const __m128i zero = _mm_setzero_si128();
+
+		size_t i = 0;
+		for (; i + 16 <= size; i += 16)
+		{
+			__m128i chars = _mm_loadu_si128((const __m128i *) (in + i));
+			_mm_storeu_si128((__m128i *) (bytes + 2 * i), _mm_unpacklo_epi8(chars, zero));
+			_mm_storeu_si128((__m128i *) (bytes + 2 * i + 16), _mm_unpackhi_epi8(chars, zero));
+		}
+		return i;
+	}
+
+	size_t mask32_sse2(const void * in, size_t size, void * out)
+	{
+		const char * words = (const char *) in;
+		char * bytes = (char *) out;
+		const __m128i mask = _mm_set1_epi16(0xff);
+		const __m128i zero = _mm_setzero_si128();
+
+		size_t i = 0;
+		for (; i + 8 <= size; i += 8)
+		{
+			__m128i low = _mm_and_si128(_mm_loadu_si128((const __m128i *) (words + 2 * i)), mask);
+			_mm_storeu_si128((__m128i *) (bytes + 4 * i), _mm_unpacklo_epi16(low, zero));
+			_mm_storeu_si128((__m128i *) (bytes + 4 * i + 16), _mm_unpackhi_epi16(low, zero));
+		}
+		return i;
+	}
+
+	size_t mask16_sse2(const void * in, size_t size, void * out)
+	{
+		const char * words = (const char *) in;
+		char * bytes = (char *) out;
+		const __m128i mask = _mm_set1_epi16(0xff);
+
+		size_t i = 0;
+		for (; i + 8 <= size; i += 8)
+		{
+			__m128i low = _mm_and_si128(_mm_loadu_si128((const __m128i *) (words + 2 * i)), mask);
+			_mm_storeu_si128((__m128i *) (bytes + 2 * i), low);
+		}
+		return i;
+	}
+
+	size_t narrow32_sse2(const void * in, size_t size, char * out)
+	{
+		const char * words = (const char *) in;
+		const __m128i mask = _mm_set1_epi32(0xff);
+
+		size_t i = 0;
+		for (; i + 16 <= size; i += 16)
+		{
+			__m128i a = _mm_and_si128(_mm_loadu_si128((const __m128i *) (words + 4 * i)), mask);
+			__m128i b = _mm_and_si128(_mm_loadu_si128((const __m128i *) (words + 4 * i + 16)), mask);
+			__m128i c = _mm_and_si128(_mm_loadu_si128((const __m128i *) (words + 4 * i + 32)), mask);
+			__m128i d = _mm_and_si128(_mm_loadu_si128((const __m128i *) (words + 4 * i + 48)), mask);
+
+			__m128i bytes = _mm_packus_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d));
+			_mm_storeu_si128((__m128i *) (out + i), bytes);
+		}
+		return i;
+	}
+
+	size_t narrow16_sse2(const void * in, size_t size, char * out)
+	{
+		const char * words = (const char *) in;
+		const __m128i mask = _mm_set1_epi16(0xff);
+
+		size_t i = 0;
+		for (; i + 16 <= size; i += 16)
+		{
+			__m128i a = _mm_and_si128(_mm_loadu_si128((const __m128i *) (words + 2 * i)), mask);
+			__m128i b = _mm_and_si128(_mm_loadu_si128((const __m128i *) (words + 2 * i + 16)), mask);
+			_mm_storeu_si128((__m128i *) (out + i), _mm_packus_epi16(a, b));
+		}
+		return i;
+	}
+
+#endif
+
+	template<class T>
+	void widen_all(const unsigned char * in, size_t size, T * out)
+	{
+		size_t i = 0;
+
+#if defined(BINARY_AVX2)
+		if (has_avx2)
+			i = (sizeof(T) == 4) ? widen32_avx2(in, size, out) : widen16_avx2(in, size, out);
+#endif
+#if defined(BINARY_SSE2)
+		i += (sizeof(T) == 4) ? widen32_sse2(in + i, size - i, out + i) : widen16_sse2(in + i, size - i, out + i);
+#endif
+
+		for (; i < size; i++)
+			out[i] = (T) in[i];
+	}
+
+	template<class T>
+	void widen_all(const boost::uint16_t * in, size_t size, T * out)
+	{
+		size_t i = 0;
+
+#if defined(BINARY_AVX2)
+		if (has_avx2)
+			i = (sizeof(T) == 4) ? mask32_avx2(in, size, out) : mask16_avx2(in, size, out);
+#endif
+#if defined(BINARY_SSE2)
+		i += (sizeof(T) == 4) ? mask32_sse2(in + i, size - i, out + i) : mask16_sse2(in + i, size - i, out + i);
+#endif
+
+		for (; i < size; i++)
+			out[i] = (T) (in[i] & 0xff);
+	}
+
+	template<class T>
+	void narrow_all(const T * in, size_t size, char * out)
+	{
+		size_t i = 0;
+
+#if defined(BINARY_AVX2)
+		if (has_avx2)
+			i = (sizeof(T) == 4) ? narrow32_avx2(in, size, out) : narrow16_avx2(in, size, out);
+#endif
+#if defined(BINARY_SSE2)
+		i += (sizeof(T) == 4) ? narrow32_sse2(in + i, size - i, out + i) : narrow16_sse2(in + i, size - i, out + i);
+#endif
+
+		for (; i < size; i++)
+			out[i] = (char) (unsigned char) in[i];
+	}
+}
+
+void Binary::widen(const char * data, size_t size, wstring & out)
+{
+	out.resize(size);
+
+	if (size > 0)
+		widen_all((const unsigned char *) data, size, &out[0]);
+}
+
+void Binary::widen(const boost::uint16_t * data, size_t size, wstring & out)
+{
+	out.resize(size);
+
+	if (size > 0)
+		widen_all(data, size, &out[0]);
+}
+
+void Binary::narrow(const wchar_t * data, size_t size, char * out)
+{
+	narrow_all(data, size, out);
+}
+
+void Binary::narrow(const boost::uint16_t * data, size_t size, char * out)
+{
+	narrow_all(data, size, out);
+}
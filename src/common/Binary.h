@@ -0,0 +1,65 @@
+/*
+ * Binary.h
+ *
+ *  Created on: Oct 17, 2026
+ */
+
+#ifndef BINARY_H_
+#define BINARY_H_
+
+#include <boost/cstdint.hpp>
+
+#include <string>
+
+using std::string;
+using std::wstring;
+
+/**
+ * Helpers to move binary data in and out of javascript strings in bulk. A string holding binary data carries one byte
+ * 	in each of its characters, which is the form <code>String.fromCharCode</code> and <code>charCodeAt</code> work
+ * 	with, and crosses into and out of the plugin as a single value rather than as one variant per byte.
+ *
+ * 	The conversions run on SSE2 where the build targets it, and on AVX2 where the compiler can target it and the
+ * 	processor supports it, with a scalar loop for the tail of the data and for other platforms.
+ */
+namespace Binary
+{
+	/**
+	 * Widens bytes into a string holding one byte in each character.
+	 *
+	 * 	@param	data	The bytes to widen
+	 * 	@param	size	The number of bytes
+	 * 	@param	out		The string to fill, which is resized to hold exactly the bytes
+	 */
+	void widen(const char * data, size_t size, wstring & out);
+
+	/**
+	 * Widens integers each holding one byte into a string holding one byte in each character, keeping the low eight
+	 * 	bits of each integer, in a single pass.
+	 *
+	 * 	@param	data	The integers to widen
+	 * 	@param	size	The number of integers
+	 * 	@param	out		The string to fill, which is resized to hold exactly the bytes
+	 */
+	void widen(const boost::uint16_t * data, size_t size, wstring & out);
+
+	/**
+	 * Narrows characters each holding one byte into bytes, keeping the low eight bits of each character.
+	 *
+	 * 	@param	data	The characters to narrow
+	 * 	@param	size	The number of characters
+	 * 	@param	out		The bytes to fill, with room for at least <code>size</code> of them
+	 */
+	void narrow(const wchar_t * data, size_t size, char * out);
+
+	/**
+	 * Narrows integers each holding one byte into bytes, keeping the low eight bits of each integer.
+	 *
+	 * 	@param	data	The integers to narrow
+	 * 	@param	size	The number of integers
+	 * 	@param	out		The bytes to fill, with room for at least <code>size</code> of them
+	 */
+	void narrow(const boost::uint16_t * data, size_t size, char * out);
+}
+
+#endif /* BINARY_H_ */
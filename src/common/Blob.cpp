@@ -0,0 +1,99 @@
+/*
+ * Blob.cpp
+ *
+ *  Created on: Oct 17, 2026
+ */
+
+#include "Blob.h"
+
+#include <boost/lexical_cast.hpp>
+
+#include <algorithm>
+
+#include "Binary.h"
+
+Blob::Blob(SharedBufferPtr buffer, size_t offset, size_t size) :
+	buffer(buffer), offset(offset), length(buffer ? size : 0)
+{
+	registerMethod("getLength", make_method(this, &Blob::get_length));
+	registerMethod("get", make_method(this, &Blob::get_byte));
+	registerMethod("slice", make_method(this, &Blob::slice));
+	registerMethod("toBinary", make_method(this, &Blob::to_binary));
+	registerMethod("toArray", make_method(this, &Blob::to_array));
+	registerMethod("toString", make_method(this, &Blob::to_string));
+}
+
+Blob::~Blob()
+{
+}
+
+const char * Blob::data() const
+{
+	if (!buffer)
+		return 0;
+
+	return buffer->data() + offset;
+}
+
+size_t Blob::size() const
+{
+	return length;
+}
+
+int Blob::get_length() const
+{
+	return (int) length;
+}
+
+int Blob::get_byte(int index) const
+{
+	if (index < 0 || (size_t) index >= length)
+		throw FB::script_error("Blob index " + boost::lexical_cast<string>(index) + " is out of range");
+
+	return (unsigned char) data()[index];
+}
+
+boost::shared_ptr<Blob> Blob::slice(int begin, boost::optional<int> end) const
+{
+	size_t first = clamp(begin);
+	size_t last = end ? clamp(*end) : length;
+
+	if (last < first)
+		last = first;
+
+	return boost::shared_ptr<Blob>(new Blob(buffer, offset + first, last - first));
+}
+
+wstring Blob::to_binary() const
+{
+	wstring binary;
+	Binary::widen(data(), length, binary);
+	return binary;
+}
+
+FB::VariantList Blob::to_array() const
+{
+	FB::VariantList bytes(length);
+
+	const unsigned char * in = (const unsigned char *) data();
+	for (size_t i = 0; i < length; i++)
+		bytes[i] = in[i];
+
+	return bytes;
+}
+
+string Blob::to_string() const
+{
+	return string(data() ? data() : "", length);
+}
+
+size_t Blob::clamp(int index) const
+{
+	if (index < 0)
+	{
+		size_t back = (size_t) -(boost::int64_t) index;
+		return back >= length ? 0 : length - back;
+	}
+
+	return std::min((size_t) index, length);
+}
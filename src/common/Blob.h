@@ -0,0 +1,122 @@
+/*
+ * Blob.h
+ *
+ *  Created on: Oct 17, 2026
+ */
+
+#ifndef BLOB_H_
+#define BLOB_H_
+
+#include <boost/optional.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <string>
+
+#include "JSAPIAuto.h"
+#include "SharedBuffer.h"
+
+using std::string;
+using std::wstring;
+
+/**
+ * A handle on binary data held by the plugin, exposed to javascript so that the data need not be converted to be
+ * 	passed around. A blob shares the buffer its data was received into, so reading one from an event, slicing it, and
+ * 	sending it back out with <code>sendBlob</code> never copies the data into javascript. When javascript does need the
+ * 	data, <code>toBinary</code> hands it over in bulk, as a string holding one byte in each character.
+ */
+class Blob: public FB::JSAPIAuto
+{
+	public:
+
+		/**
+		 * Builds a blob over part of a shared buffer, registering its javascript API.
+		 *
+		 * 	@param	buffer	The buffer holding the data, or null for an empty blob
+		 * 	@param	offset	The offset of the data in the buffer
+		 * 	@param	size	The number of bytes of data
+		 */
+		Blob(SharedBufferPtr buffer, size_t offset, size_t size);
+
+		/**
+		 * Deconstructs a blob, dropping its reference to the buffer
+		 */
+		virtual ~Blob();
+
+		/**
+		 * Gets the data held in this blob.
+		 */
+		const char * data() const;
+
+		/**
+		 * Gets the number of bytes of data held in this blob.
+		 */
+		size_t size() const;
+
+		/**
+		 * Gets the number of bytes of data held in this blob, exposed to javascript as 'getLength'.
+		 */
+		int get_length() const;
+
+		/**
+		 * Gets a single byte of this blob, exposed to javascript as 'get'.
+		 *
+		 * 	@param	index	The index of the byte
+		 * 	@return	The byte, from 0 to 255
+		 * 	@throws	FB::script_error if the index is outside this blob
+		 */
+		int get_byte(int index) const;
+
+		/**
+		 * Gets a blob holding part of this one, sharing its data, exposed to javascript as 'slice'. Like
+		 * 	<code>Array.prototype.slice</code>, negative indices count back from the end of this blob, and indices out
+		 * 	of range are clamped to it.
+		 *
+		 * 	@param	begin	The index of the first byte of the slice
+		 * 	@param	end		The index just past the last byte of the slice, or the end of this blob if not given
+		 * 	@return	The slice
+		 */
+		boost::shared_ptr<Blob> slice(int begin, boost::optional<int> end) const;
+
+		/**
+		 * Copies the data in this blob into a string holding one byte in each character, exposed to javascript as
+		 * 	'toBinary'.
+		 */
+		wstring to_binary() const;
+
+		/**
+		 * Copies the data in this blob into an array holding one byte in each element, exposed to javascript as
+		 * 	'toArray'. This converts each byte on its own, so is only meant for small blobs.
+		 */
+		FB::VariantList to_array() const;
+
+		/**
+		 * Copies the data in this blob into a string, exposed to javascript as 'toString'.
+		 */
+		string to_string() const;
+
+	private:
+
+		/**
+		 * Disallows copying a blob
+		 */
+		Blob(const Blob &other);
+
+		/**
+		 * Resolves an index given to <code>slice</code> into an offset into this blob.
+		 *
+		 * 	@param	index	The index, which counts back from the end of this blob if negative
+		 * 	@return	The offset, clamped to this blob
+		 */
+		size_t clamp(int index) const;
+
+		/** The buffer holding the data, shared with the events and blobs it was read from */
+		SharedBufferPtr buffer;
+
+		/** The offset of the data in the buffer */
+		size_t offset;
+
+		/** The number of bytes of data */
+		size_t length;
+};
+
+#endif /* BLOB_H_ */
@@ -0,0 +1,143 @@
+/*
+ * BufferPool.cpp
+ *
+ *  Created on: Oct 17, 2026
+ */
+
+#include "BufferPool.h"
+
+BufferPool::BufferPool() :
+	size_classes(size_class(MAX_POOLED_SIZE) + 1)
+{
+	for (size_t i = 0; i < size_classes.size(); i++)
+	{
+		size_classes[i].buffers = 0;
+	}
+}
+
+BufferPool::~BufferPool()
+{
+	for (size_t i = 0; i < size_classes.size(); i++)
+	{
+		map<char *, size_t>::iterator slab;
+		for (slab = size_classes[i].slabs.begin(); slab != size_classes[i].slabs.end(); slab++)
+		{
+			delete[] slab->first;
+		}
+	}
+}
+
+int BufferPool::size_class(size_t size)
+{
+	int index = 0;
+	while (((size_t) 1 << index) < size || ((size_t) 1 << index) < MIN_POOLED_SIZE)
+	{
+		index++;
+	}
+
+	return index;
+}
+
+size_t BufferPool::slab_buffers(int index)
+{
+	return std::max(SLAB_SIZE / ((size_t) 1 << index), (size_t) 1);
+}
+
+void BufferPool::grow(int index)
+{
+	size_t buffer_size = (size_t) 1 << index;
+	size_t count = slab_buffers(index);
+
+	char * slab = new char[buffer_size * count];
+	size_classes[index].slabs[slab] = count;
+	size_classes[index].buffers += count;
+
+	for (size_t i = 0; i < count; i++)
+	{
+		size_classes[index].free_buffers.push_back(slab + i * buffer_size);
+	}
+}
+
+char * BufferPool::lease(size_t size)
+{
+	// Leave buffers too large to be worth holding on to outside the pool
+	if (size > MAX_POOLED_SIZE)
+		return new char[size];
+
+	int index = size_class(size);
+
+	boost::mutex::scoped_lock lock(mutex);
+	if (size_classes[index].free_buffers.empty())
+		grow(index);
+
+	char * buffer = size_classes[index].free_buffers.back();
+	size_classes[index].free_buffers.pop_back();
+	find_slab(index, buffer)->second--;
+	return buffer;
+}
+
+void BufferPool::release(char * buffer, size_t size)
+{
+	if (size > MAX_POOLED_SIZE)
+	{
+		delete[] buffer;
+		return;
+	}
+
+	int index = size_class(size);
+
+	boost::mutex::scoped_lock lock(mutex);
+	size_classes[index].free_buffers.push_back(buffer);
+
+	// Free the slab once it is unused, unless its buffers are the only ones this size class has to spare
+	map<char *, size_t>::iterator slab = find_slab(index, buffer);
+	size_t count = slab_buffers(index);
+	if (++slab->second == count && size_classes[index].free_buffers.size() >= 2 * count)
+		trim(index, slab);
+}
+
+map<char *, size_t>::iterator BufferPool::find_slab(int index, char * buffer)
+{
+	// The slab holding a buffer is the last one starting at or before it
+	map<char *, size_t>::iterator slab = size_classes[index].slabs.upper_bound(buffer);
+	return --slab;
+}
+
+void BufferPool::trim(int index, map<char *, size_t>::iterator slab)
+{
+	SizeClass & slab_class = size_classes[index];
+	char * begin = slab->first;
+	char * end = begin + ((size_t) 1 << index) * slab->second;
+
+	size_t kept = 0;
+	for (size_t i = 0; i < slab_class.free_buffers.size(); i++)
+	{
+		if (slab_class.free_buffers[i] < begin || slab_class.free_buffers[i] >= end)
+			slab_class.free_buffers[kept++] = slab_class.free_buffers[i];
+	}
+	slab_class.free_buffers.resize(kept);
+
+	slab_class.buffers -= slab->second;
+	slab_class.slabs.erase(slab);
+	delete[] begin;
+}
+
+vector<BufferPool::Stats> BufferPool::get_stats()
+{
+	boost::mutex::scoped_lock lock(mutex);
+
+	vector<Stats> stats;
+	for (size_t i = 0; i < size_classes.size(); i++)
+	{
+		if (size_classes[i].buffers == 0)
+			continue;
+
+		Stats size_class_stats;
+		size_class_stats.buffer_size = (size_t) 1 << i;
+		size_class_stats.buffers = size_classes[i].buffers;
+		size_class_stats.leased = size_classes[i].buffers - size_classes[i].free_buffers.size();
+		stats.push_back(size_class_stats);
+	}
+
+	return stats;
+}
@@ -0,0 +1,174 @@
+/*
+ * BufferPool.h
+ *
+ *  Created on: Oct 17, 2026
+ */
+
+#ifndef BUFFERPOOL_H_
+#define BUFFERPOOL_H_
+
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/thread.hpp>
+
+#include <algorithm>
+#include <map>
+#include <vector>
+
+using std::map;
+using std::vector;
+
+/**
+ * A thread-safe slab allocator for network buffers, shared by every client and server on a <code>NetworkThread</code>.
+ * 	Buffers are kept in power-of-two size classes, and each size class is carved out of slabs allocated as it grows.
+ * 	Buffers are leased for as long as they are needed and then released back to their size class, so once a size class
+ * 	has grown to the traffic's peak, leasing and releasing buffers does no heap allocation. A slab is freed again once
+ * 	all of its buffers are released while at least another slab's worth of the size class is free, so a burst does not
+ * 	pin its memory for the life of the pool. A pool must be owned by a <code>boost::shared_ptr</code>, which the shared
+ * 	buffers leased from it hold on to.
+ */
+class BufferPool : public boost::enable_shared_from_this<BufferPool>
+{
+	public:
+
+		/**
+		 * The occupancy of a single size class.
+		 */
+		struct Stats
+		{
+			/** The size in bytes of the buffers in this size class */
+			size_t buffer_size;
+
+			/** The number of buffers carved out of this size class's slabs */
+			size_t buffers;
+
+			/** The number of those buffers currently leased */
+			size_t leased;
+		};
+
+		/**
+		 * Builds an empty pool of buffers.
+		 */
+		BufferPool();
+
+		/**
+		 * Frees every slab held by this pool. Shared buffers keep their pool alive, so this only happens once the last
+		 * 	of them is released. Buffers leased directly must be released before the pool is destroyed.
+		 */
+		~BufferPool();
+
+		/**
+		 * Leases a buffer from this pool, growing the size class by a slab if none of its buffers are free. Buffers
+		 * 	larger than <code>MAX_POOLED_SIZE</code> are allocated and freed individually.
+		 *
+		 * 	@param	size	The minimum size in bytes of the buffer
+		 * 	@return	A buffer of at least <code>size</code> bytes
+		 */
+		char * lease(size_t size);
+
+		/**
+		 * Returns a leased buffer to this pool, freeing its slab if the size class has a slab's worth of buffers to spare.
+		 *
+		 * 	@param	buffer	The buffer to release, which must have been leased from this pool
+		 * 	@param	size	The size with which the buffer was leased
+		 */
+		void release(char * buffer, size_t size);
+
+		/**
+		 * Gets the occupancy of every size class that has been used.
+		 *
+		 * 	@return	The occupancy of each size class in use, smallest first
+		 */
+		vector<Stats> get_stats();
+
+		/**
+		 * The number of bytes allocated at a time for each slab, which smaller buffers are carved out of.
+		 */
+		static const size_t SLAB_SIZE = 65536;
+
+		/**
+		 * The size of the largest buffers kept in the pool.
+		 */
+		static const size_t MAX_POOLED_SIZE = 1048576;
+
+		/**
+		 * The size of the smallest buffers in the pool, to which smaller leases are rounded up.
+		 */
+		static const size_t MIN_POOLED_SIZE = 64;
+
+	private:
+
+		/**
+		 * The slabs and free buffers of a single size class
+		 */
+		struct SizeClass
+		{
+			/** The slabs allocated for this size class, by address, with the number of each slab's buffers that are free */
+			map<char *, size_t> slabs;
+
+			/** The buffers in this size class available to be leased */
+			vector<char *> free_buffers;
+
+			/** The number of buffers carved out of this size class's slabs */
+			size_t buffers;
+		};
+
+		/**
+		 * Disallows copying a buffer pool
+		 */
+		BufferPool(const BufferPool &other);
+
+		/**
+		 * Gets the size class for a buffer size, which is the base two logarithm of the size rounded up to a power of
+		 * 	two, and no smaller than <code>MIN_POOLED_SIZE</code>.
+		 *
+		 * 	@param	size	The size in bytes of a buffer
+		 * 	@return	The index of the size class holding buffers of this size
+		 */
+		static int size_class(size_t size);
+
+		/**
+		 * Allocates a new slab for a size class, and adds its buffers to the free buffers. Must be called while holding
+		 * 	the mutex.
+		 *
+		 * 	@param	index	The index of the size class to grow
+		 */
+		void grow(int index);
+
+		/**
+		 * Gets the number of buffers carved out of each slab of a size class.
+		 *
+		 * 	@param	index	The index of the size class
+		 * 	@return	The number of buffers in each of its slabs
+		 */
+		static size_t slab_buffers(int index);
+
+		/**
+		 * Finds the slab a buffer was carved out of. Must be called while holding the mutex.
+		 *
+		 * 	@param	index	The index of the buffer's size class
+		 * 	@param	buffer	A buffer of that size class
+		 * 	@return	The slab holding the buffer
+		 */
+		map<char *, size_t>::iterator find_slab(int index, char * buffer);
+
+		/**
+		 * Frees a slab whose buffers are all free, removing them from the free buffers. Must be called while holding the
+		 * 	mutex.
+		 *
+		 * 	@param	index	The index of the slab's size class
+		 * 	@param	slab	The slab to free
+		 */
+		void trim(int index, map<char *, size_t>::iterator slab);
+
+		/**
+		 * The size classes, indexed by the base two logarithm of their buffer size
+		 */
+		vector<SizeClass> size_classes;
+
+		/**
+		 * A mutex around the size classes
+		 */
+		boost::mutex mutex;
+};
+
+#endif /* BUFFERPOOL_H_ */
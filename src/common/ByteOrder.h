@@ -0,0 +1,46 @@
+/*
+ * ByteOrder.h
+ *
+ *  Created on: Oct 17, 2026
+ */
+
+#ifndef BYTEORDER_H_
+#define BYTEORDER_H_
+
+#include <boost/cstdint.hpp>
+
+/**
+ * Helpers to read and write the big-endian integers in the headers this plugin puts on the wire, independent of the
+ * 	host's byte order and of the alignment of the buffer.
+ */
+namespace ByteOrder
+{
+	inline void put16(char * out, boost::uint16_t value)
+	{
+		out[0] = (char) (value >> 8);
+		out[1] = (char) value;
+	}
+
+	inline void put32(char * out, boost::uint32_t value)
+	{
+		out[0] = (char) (value >> 24);
+		out[1] = (char) (value >> 16);
+		out[2] = (char) (value >> 8);
+		out[3] = (char) value;
+	}
+
+	inline boost::uint16_t get16(const char * in)
+	{
+		const unsigned char * bytes = (const unsigned char *) in;
+		return (boost::uint16_t) ((bytes[0] << 8) | bytes[1]);
+	}
+
+	inline boost::uint32_t get32(const char * in)
+	{
+		const unsigned char * bytes = (const unsigned char *) in;
+		return ((boost::uint32_t) bytes[0] << 24) | ((boost::uint32_t) bytes[1] << 16) | ((boost::uint32_t) bytes[2] << 8)
+				| bytes[3];
+	}
+}
+
+#endif /* BYTEORDER_H_ */
@@ -7,10 +7,80 @@
 
 #include "Client.h"
 
+#include "Binary.h"
+#include "Blob.h"
+#include "Encoding.h"
+#include "Logger.h"
+
 Client::Client()
 {
 	registerMethod("send", make_method(this, &Client::send));
 	registerMethod("sendBytes", make_method(this, &Client::send_bytes));
+	registerMethod("sendBinary", make_method(this, &Client::send_binary));
+	registerMethod("sendBlob", make_method(this, &Client::send_blob));
+	registerMethod("sendBase64", make_method(this, &Client::send_base64));
+	registerMethod("sendHex", make_method(this, &Client::send_hex));
 	registerMethod("getHost", make_method(this, &Client::get_host));
 	registerMethod("getPort", make_method(this, &Client::get_port));
 }
+
+bool Client::send_bytes(const vector<byte> & bytes)
+{
+	string data(bytes.size(), '\0');
+	if (!bytes.empty())
+		Binary::narrow(&bytes[0], bytes.size(), &data[0]);
+
+	return send(data);
+}
+
+bool Client::send_binary(const binary & data)
+{
+	string bytes(data.size(), '\0');
+	if (!data.empty())
+		Binary::narrow(data.data(), data.size(), &bytes[0]);
+
+	return send(bytes);
+}
+
+bool Client::send_blob(const FB::JSAPIPtr & object)
+{
+	boost::shared_ptr<Blob> blob = boost::dynamic_pointer_cast<Blob>(object);
+
+	if (!blob)
+	{
+		string message("Client failed to send, the object given is not a blob");
+		Logger::error(message, get_port(), get_host());
+		fire_error(message);
+		return false;
+	}
+
+	return send(blob->to_string());
+}
+
+bool Client::send_base64(const string & text)
+{
+	string bytes;
+	if (!Encoding::base64_decode(text.data(), text.size(), bytes))
+	{
+		string message("Client failed to send, the data given is not base64");
+		Logger::error(message, get_port(), get_host());
+		fire_error(message);
+		return false;
+	}
+
+	return send(bytes);
+}
+
+bool Client::send_hex(const string & text)
+{
+	string bytes;
+	if (!Encoding::hex_decode(text.data(), text.size(), bytes))
+	{
+		string message("Client failed to send, the data given is not hex");
+		Logger::error(message, get_port(), get_host());
+		fire_error(message);
+		return false;
+	}
+
+	return send(bytes);
+}
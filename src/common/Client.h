@@ -32,15 +32,56 @@ class Client: public NetworkObject
 		 * Asynchronously sends data to the remote host to which this client is connected.
 		 *
 		 * 	@param	data	The data to send across the wire
+		 * 	@return	False if this client is buffering more data than it should, and true otherwise
 		 */
-		virtual void send(const string & data) = 0;
+		virtual bool send(const string & data) = 0;
 
 		/**
 		 * Asynchronously sends bytes to the remote host to which this client is connected.
 		 *
 		 * 	@param	bytes	The bytes of data to send across the wire
+		 * 	@return	False if this client is buffering more data than it should, and true otherwise
 		 */
-		virtual void send_bytes(const vector<byte> & bytes) = 0;
+		bool send_bytes(const vector<byte> & bytes);
+
+		/**
+		 * Asynchronously sends binary data, given as a string holding one byte in each character, to the remote host
+		 * 	to which this client is connected. Exposed to javascript as 'sendBinary'.
+		 *
+		 * 	@param	data	The binary data to send across the wire
+		 * 	@return	False if this client is buffering more data than it should, and true otherwise
+		 */
+		bool send_binary(const binary & data);
+
+		/**
+		 * Asynchronously sends the data held in a blob, such as one read from an event, to the remote host to which
+		 * 	this client is connected. Exposed to javascript as 'sendBlob'.
+		 *
+		 * 	@param	blob	The blob holding the data to send across the wire
+		 * 	@return	False if the object given is not a blob, or if this client is buffering more data than it should,
+		 * 			and true otherwise
+		 */
+		bool send_blob(const FB::JSAPIPtr & blob);
+
+		/**
+		 * Asynchronously sends binary data given as base64 text, which is decoded before it is sent, to the remote host
+		 * 	to which this client is connected. Exposed to javascript as 'sendBase64'.
+		 *
+		 * 	@param	text	The base64 encoding of the data to send across the wire
+		 * 	@return	False if the text is not base64, or if this client is buffering more data than it should, and true
+		 * 			otherwise
+		 */
+		bool send_base64(const string & text);
+
+		/**
+		 * Asynchronously sends binary data given as hex text, which is decoded before it is sent, to the remote host to
+		 * 	which this client is connected. Exposed to javascript as 'sendHex'.
+		 *
+		 * 	@param	text	The hex encoding of the data to send across the wire
+		 * 	@return	False if the text is not hex, or if this client is buffering more data than it should, and true
+		 * 			otherwise
+		 */
+		bool send_hex(const string & text);
 
 		/**
 		 * Get host to which this client connects
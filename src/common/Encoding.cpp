@@ -0,0 +1,189 @@
+/*
+ * Encoding.cpp
+ *
+ *  Created on: Oct 17, 2026
+ */
+
+#include "Encoding.h"
+
+#include <boost/cstdint.hpp>
+
+#include <string.h>
+
+namespace
+{
+	const char BASE64_ALPHABET[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+	const char HEX_DIGITS[] = "0123456789abcdef";
+
+	/** Set in a decoded base64 word when any of its characters is not base64, above the 24 bits of data */
+	const boost::uint32_t BASE64_INVALID = 0x01000000;
+
+	/**
+	 * Lookup tables built once, so that each step of a conversion is a load rather than arithmetic. Base64 is encoded
+	 * 	twelve bits, or two characters, at a time, and decoded a character at a time into a word already shifted to
+	 * 	its place in the group of four.
+	 */
+	struct Tables
+	{
+		Tables()
+		{
+			for (int value = 0; value < 4096; value++)
+			{
+				base64_pairs[value][0] = BASE64_ALPHABET[value >> 6];
+				base64_pairs[value][1] = BASE64_ALPHABET[value & 63];
+			}
+
+			for (int c = 0; c < 256; c++)
+			{
+				for (int place = 0; place < 4; place++)
+					base64_places[place][c] = BASE64_INVALID;
+				hex_values[c] = -1;
+			}
+
+			for (int value = 0; value < 64; value++)
+			{
+				unsigned char c = (unsigned char) BASE64_ALPHABET[value];
+				for (int place = 0; place < 4; place++)
+					base64_places[place][c] = (boost::uint32_t) value << (18 - 6 * place);
+			}
+
+			for (int byte = 0; byte < 256; byte++)
+			{
+				hex_pairs[byte][0] = HEX_DIGITS[byte >> 4];
+				hex_pairs[byte][1] = HEX_DIGITS[byte & 15];
+			}
+
+			for (int value = 0; value < 16; value++)
+			{
+				hex_values[(unsigned char) HEX_DIGITS[value]] = value;
+				hex_values[(unsigned char) ("0123456789ABCDEF"[value])] = value;
+			}
+		}
+
+		char base64_pairs[4096][2];
+
+		boost::uint32_t base64_places[4][256];
+
+		char hex_pairs[256][2];
+
+		int hex_values[256];
+	};
+
+	const Tables tables;
+}
+
+void Encoding::base64_encode(const char * data, size_t size, string & out)
+{
+	out.resize((size + 2) / 3 * 4);
+	if (size == 0)
+		return;
+
+	const unsigned char * in = (const unsigned char *) data;
+	char * text = &out[0];
+
+	size_t i = 0;
+	for (; i + 3 <= size; i += 3, text += 4)
+	{
+		boost::uint32_t word = ((boost::uint32_t) in[i] << 16) | ((boost::uint32_t) in[i + 1] << 8) | in[i + 2];
+		memcpy(text, tables.base64_pairs[word >> 12], 2);
+		memcpy(text + 2, tables.base64_pairs[word & 0xfff], 2);
+	}
+
+	if (i < size)
+	{
+		boost::uint32_t word = (boost::uint32_t) in[i] << 16;
+		if (i + 1 < size)
+			word |= (boost::uint32_t) in[i + 1] << 8;
+
+		memcpy(text, tables.base64_pairs[word >> 12], 2);
+		text[2] = (i + 1 < size) ? BASE64_ALPHABET[(word >> 6) & 63] : '=';
+		text[3] = '=';
+	}
+}
+
+bool Encoding::base64_decode(const char * data, size_t size, string & out)
+{
+	// Padding only ever completes the last group of four
+	size_t length = size;
+	if (length % 4 == 0)
+	{
+		for (int pad = 0; pad < 2 && length > 0 && data[length - 1] == '='; pad++)
+			length--;
+	}
+
+	if (length % 4 == 1)
+		return false;
+
+	out.resize(length / 4 * 3 + (length % 4 ? length % 4 - 1 : 0));
+	if (length == 0)
+		return true;
+
+	const unsigned char * in = (const unsigned char *) data;
+	char * bytes = &out[0];
+
+	size_t i = 0;
+	for (; i + 4 <= length; i += 4, bytes += 3)
+	{
+		boost::uint32_t word = tables.base64_places[0][in[i]] | tables.base64_places[1][in[i + 1]]
+				| tables.base64_places[2][in[i + 2]] | tables.base64_places[3][in[i + 3]];
+
+		if (word & BASE64_INVALID)
+			return false;
+
+		bytes[0] = (char) (word >> 16);
+		bytes[1] = (char) (word >> 8);
+		bytes[2] = (char) word;
+	}
+
+	if (i < length)
+	{
+		boost::uint32_t word = tables.base64_places[0][in[i]] | tables.base64_places[1][in[i + 1]];
+		if (i + 2 < length)
+			word |= tables.base64_places[2][in[i + 2]];
+
+		if (word & BASE64_INVALID)
+			return false;
+
+		bytes[0] = (char) (word >> 16);
+		if (i + 2 < length)
+			bytes[1] = (char) (word >> 8);
+	}
+
+	return true;
+}
+
+void Encoding::hex_encode(const char * data, size_t size, string & out)
+{
+	out.resize(size * 2);
+	if (size == 0)
+		return;
+
+	const unsigned char * in = (const unsigned char *) data;
+	char * text = &out[0];
+
+	for (size_t i = 0; i < size; i++)
+		memcpy(text + 2 * i, tables.hex_pairs[in[i]], 2);
+}
+
+bool Encoding::hex_decode(const char * data, size_t size, string & out)
+{
+	if (size % 2)
+		return false;
+
+	out.resize(size / 2);
+
+	const unsigned char * in = (const unsigned char *) data;
+	for (size_t i = 0; i < size / 2; i++)
+	{
+		int high = tables.hex_values[in[2 * i]];
+		int low = tables.hex_values[in[2 * i + 1]];
+
+		if ((high | low) < 0)
+			return false;
+
+		out[i] = (char) ((high << 4) | low);
+	}
+
+	return true;
+}
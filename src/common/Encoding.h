@@ -0,0 +1,60 @@
+/*
+ * Encoding.h
+ *
+ *  Created on: Oct 17, 2026
+ */
+
+#ifndef ENCODING_H_
+#define ENCODING_H_
+
+#include <string>
+
+using std::string;
+
+/**
+ * Base64 and hex codecs, so that pages exchanging binary data as text can have the plugin encode and decode it rather
+ * 	than doing so in script. Base64 uses the standard alphabet with padding, and hex is encoded in lowercase. Neither
+ * 	decoder accepts whitespace.
+ */
+namespace Encoding
+{
+	/**
+	 * Encodes bytes as base64.
+	 *
+	 * 	@param	data	The bytes to encode
+	 * 	@param	size	The number of bytes
+	 * 	@param	out		The string to fill, which is resized to hold exactly the encoding
+	 */
+	void base64_encode(const char * data, size_t size, string & out);
+
+	/**
+	 * Decodes base64 into bytes. The padding at the end of the text may be left out.
+	 *
+	 * 	@param	data	The text to decode
+	 * 	@param	size	The number of characters of text
+	 * 	@param	out		The string to fill, which is resized to hold exactly the bytes decoded
+	 * 	@return	True if the text was decoded, and false if it is not base64
+	 */
+	bool base64_decode(const char * data, size_t size, string & out);
+
+	/**
+	 * Encodes bytes as hex, two lowercase digits to a byte.
+	 *
+	 * 	@param	data	The bytes to encode
+	 * 	@param	size	The number of bytes
+	 * 	@param	out		The string to fill, which is resized to hold exactly the encoding
+	 */
+	void hex_encode(const char * data, size_t size, string & out);
+
+	/**
+	 * Decodes hex, in either case, into bytes.
+	 *
+	 * 	@param	data	The text to decode
+	 * 	@param	size	The number of characters of text
+	 * 	@param	out		The string to fill, which is resized to hold exactly the bytes decoded
+	 * 	@return	True if the text was decoded, and false if it is not hex
+	 */
+	bool hex_decode(const char * data, size_t size, string & out);
+}
+
+#endif /* ENCODING_H_ */
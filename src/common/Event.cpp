@@ -7,15 +7,43 @@
 
 #include "Event.h"
 
-Event::Event()
+#include <boost/lexical_cast.hpp>
+
+#include <algorithm>
+
+#include <string.h>
+
+#include "Binary.h"
+#include "ByteOrder.h"
+#include "Encoding.h"
+#include "Logger.h"
+
+Event::Event() :
+	receive_time(0), dispatch_time(0), listened(false)
 {
 	// Expose these methods to the Javascript
 	registerMethod("send", make_method(this, &Event::send));
 	registerMethod("sendBytes", make_method(this, &Event::send_bytes));
 	registerMethod("read", make_method(this, &Event::read));
 	registerMethod("readBytes", make_method(this, &Event::read_bytes));
+	registerMethod("sendBinary", make_method(this, &Event::send_binary));
+	registerMethod("sendBlob", make_method(this, &Event::send_blob));
+	registerMethod("readBinary", make_method(this, &Event::read_binary));
+	registerMethod("readBlob", make_method(this, &Event::read_blob));
+	registerMethod("sendBase64", make_method(this, &Event::send_base64));
+	registerMethod("sendHex", make_method(this, &Event::send_hex));
+	registerMethod("readBase64", make_method(this, &Event::read_base64));
+	registerMethod("readHex", make_method(this, &Event::read_hex));
+	registerMethod("getLength", make_method(this, &Event::get_length));
+	registerMethod("readSlice", make_method(this, &Event::read_slice));
+	registerMethod("indexOf", make_method(this, &Event::index_of));
+	registerMethod("readUint8", make_method(this, &Event::read_uint8));
+	registerMethod("readUint16", make_method(this, &Event::read_uint16));
+	registerMethod("readUint32", make_method(this, &Event::read_uint32));
 	registerMethod("getHost", make_method(this, &Event::get_host));
 	registerMethod("getPort", make_method(this, &Event::get_port));
+	registerMethod("getReceiveTime", make_method(this, &Event::get_receive_time));
+	registerMethod("getDispatchTime", make_method(this, &Event::get_dispatch_time));
 }
 
 
@@ -23,3 +51,272 @@ Event::~Event()
 {
 	// Nothing to do here
 }
+
+bool Event::send_bytes(const vector<byte> & bytes)
+{
+	string data(bytes.size(), '\0');
+	if (!bytes.empty())
+		Binary::narrow(&bytes[0], bytes.size(), &data[0]);
+
+	return send(data);
+}
+
+bool Event::send_binary(const binary & data)
+{
+	string bytes(data.size(), '\0');
+	if (!data.empty())
+		Binary::narrow(data.data(), data.size(), &bytes[0]);
+
+	return send(bytes);
+}
+
+bool Event::send_blob(const FB::JSAPIPtr & object)
+{
+	boost::shared_ptr<Blob> blob = boost::dynamic_pointer_cast<Blob>(object);
+
+	if (!blob)
+	{
+		string message("Event failed to send, the object given is not a blob");
+		Logger::error(message, get_port(), get_host());
+		fire_error(message);
+		return false;
+	}
+
+	return send(blob->to_string());
+}
+
+bool Event::send_base64(const string & text)
+{
+	string bytes;
+	if (!Encoding::base64_decode(text.data(), text.size(), bytes))
+	{
+		string message("Event failed to send, the data given is not base64");
+		Logger::error(message, get_port(), get_host());
+		fire_error(message);
+		return false;
+	}
+
+	return send(bytes);
+}
+
+bool Event::send_hex(const string & text)
+{
+	string bytes;
+	if (!Encoding::hex_decode(text.data(), text.size(), bytes))
+	{
+		string message("Event failed to send, the data given is not hex");
+		Logger::error(message, get_port(), get_host());
+		fire_error(message);
+		return false;
+	}
+
+	return send(bytes);
+}
+
+string Event::read() const
+{
+	if (!data)
+		return string();
+
+	return data->to_string();
+}
+
+FB::VariantList Event::read_bytes() const
+{
+	if (!data)
+		return FB::VariantList();
+
+	FB::VariantList bytes(data->size());
+
+	const unsigned char * in = (const unsigned char *) data->data();
+	for (size_t i = 0; i < data->size(); i++)
+		bytes[i] = in[i];
+
+	return bytes;
+}
+
+binary Event::read_binary() const
+{
+	binary bytes;
+
+	if (data)
+		Binary::widen(data->data(), data->size(), bytes);
+
+	return bytes;
+}
+
+string Event::read_base64() const
+{
+	string text;
+
+	if (data)
+		Encoding::base64_encode(data->data(), data->size(), text);
+
+	return text;
+}
+
+string Event::read_hex() const
+{
+	string text;
+
+	if (data)
+		Encoding::hex_encode(data->data(), data->size(), text);
+
+	return text;
+}
+
+boost::shared_ptr<Blob> Event::read_blob() const
+{
+	return boost::shared_ptr<Blob>(new Blob(data, 0, data ? data->size() : 0));
+}
+
+int Event::get_length() const
+{
+	return data ? (int) data->size() : 0;
+}
+
+boost::shared_ptr<Blob> Event::read_slice(int offset, boost::optional<int> length) const
+{
+	size_t size = data ? data->size() : 0;
+	if (offset < 0 || (size_t) offset >= size || (length && *length <= 0))
+		return boost::shared_ptr<Blob>(new Blob(data, 0, 0));
+
+	size_t count = size - offset;
+	if (length)
+		count = std::min(count, (size_t) *length);
+
+	return boost::shared_ptr<Blob>(new Blob(data, offset, count));
+}
+
+int Event::index_of(const binary & pattern, boost::optional<int> from) const
+{
+	size_t size = data ? data->size() : 0;
+	size_t start = (from && *from > 0) ? (size_t) *from : 0;
+
+	if (start > size || pattern.size() > size - start)
+		return -1;
+	if (pattern.empty())
+		return (int) start;
+
+	string bytes(pattern.size(), '\0');
+	Binary::narrow(pattern.data(), pattern.size(), &bytes[0]);
+
+	// Jump between occurrences of the first byte, and only compare the rest there
+	const char * begin = data->data();
+	const char * last = begin + size - bytes.size();
+
+	for (const char * at = begin + start; at <= last; at++)
+	{
+		at = (const char *) memchr(at, bytes[0], last - at + 1);
+		if (!at)
+			break;
+
+		if (memcmp(at + 1, bytes.data() + 1, bytes.size() - 1) == 0)
+			return (int) (at - begin);
+	}
+
+	return -1;
+}
+
+int Event::read_uint8(int offset) const
+{
+	return (unsigned char) *checked_data(offset, 1);
+}
+
+int Event::read_uint16(int offset, boost::optional<bool> little_endian) const
+{
+	const char * in = checked_data(offset, 2);
+
+	if (little_endian && *little_endian)
+		return ((unsigned char) in[1] << 8) | (unsigned char) in[0];
+
+	return ByteOrder::get16(in);
+}
+
+double Event::read_uint32(int offset, boost::optional<bool> little_endian) const
+{
+	const char * in = checked_data(offset, 4);
+
+	if (little_endian && *little_endian)
+	{
+		const unsigned char * bytes = (const unsigned char *) in;
+		return ((boost::uint32_t) bytes[3] << 24) | ((boost::uint32_t) bytes[2] << 16) | ((boost::uint32_t) bytes[1] << 8)
+				| bytes[0];
+	}
+
+	return ByteOrder::get32(in);
+}
+
+const char * Event::checked_data(int offset, size_t size) const
+{
+	if (!data || offset < 0 || (size_t) offset > data->size() || size > data->size() - offset)
+	{
+		throw FB::script_error("Offset " + boost::lexical_cast<string>(offset) + " is out of range for "
+				+ boost::lexical_cast<string>(size) + " bytes of event data");
+	}
+
+	return data->data() + offset;
+}
+
+double Event::get_receive_time() const
+{
+	return receive_time / 1000000.0;
+}
+
+double Event::get_dispatch_time() const
+{
+	return dispatch_time / 1000000.0;
+}
+
+void Event::set_dispatch_time(boost::int64_t time)
+{
+	dispatch_time = time;
+}
+
+void Event::recycle()
+{
+	data.reset();
+	receive_time = 0;
+	dispatch_time = 0;
+}
+
+bool Event::reusable() const
+{
+	return !listened;
+}
+
+void Event::registerEventMethod(const std::string & name, FB::JSObjectPtr & event)
+{
+	listened = true;
+	FB::JSAPIAuto::registerEventMethod(name, event);
+}
+
+void Event::registerEventInterface(const FB::JSObjectPtr & event)
+{
+	listened = true;
+	FB::JSAPIAuto::registerEventInterface(event);
+}
+
+void Event::SetProperty(const std::string & name, const FB::variant & value)
+{
+	listened = true;
+	FB::JSAPIAuto::SetProperty(name, value);
+}
+
+void Event::SetProperty(int index, const FB::variant & value)
+{
+	listened = true;
+	FB::JSAPIAuto::SetProperty(index, value);
+}
+
+void Event::RemoveProperty(const std::string & name)
+{
+	listened = true;
+	FB::JSAPIAuto::RemoveProperty(name);
+}
+
+void Event::RemoveProperty(int index)
+{
+	listened = true;
+	FB::JSAPIAuto::RemoveProperty(index);
+}
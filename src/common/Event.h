@@ -13,8 +13,12 @@
 #include <string>
 #include <vector>
 #include <boost/asio.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/optional.hpp>
 
 #include "JSAPIAuto.h"
+#include "Blob.h"
+#include "SharedBuffer.h"
 
 using std::string;
 using std::vector;
@@ -44,29 +48,156 @@ class Event: public FB::JSAPIAuto
 		 * Reply on this <code>Event</code>'s connection with some data.
 		 *
 		 * 	@param	data	The data to send
+		 * 	@return	False if this connection is buffering more data than it should, and true otherwise
 		 */
-		virtual void send(const string & data) = 0;
+		virtual bool send(const string & data) = 0;
 
 		/**
 		 * Reply on this <code>Event</code>'s connection with some data, given as bytes.
 		 *
 		 *	@param	bytes	The bytes of data with which to reply
+		 * 	@return	False if this connection is buffering more data than it should, and true otherwise
 		 */
-		virtual void send_bytes(const vector<byte> & bytes) = 0;
+		bool send_bytes(const vector<byte> & bytes);
+
+		/**
+		 * Reply on this <code>Event</code>'s connection with binary data, given as a string holding one byte in each
+		 * 	character, exposed to javascript as 'sendBinary'.
+		 *
+		 *	@param	data	The binary data with which to reply
+		 * 	@return	False if this connection is buffering more data than it should, and true otherwise
+		 */
+		bool send_binary(const binary & data);
+
+		/**
+		 * Reply on this <code>Event</code>'s connection with the data held in a blob, such as one read from another
+		 * 	event, exposed to javascript as 'sendBlob'.
+		 *
+		 *	@param	blob	The blob holding the data with which to reply
+		 * 	@return	False if the object given is not a blob, or if this connection is buffering more data than it should,
+		 * 			and true otherwise
+		 */
+		bool send_blob(const FB::JSAPIPtr & blob);
+
+		/**
+		 * Reply on this <code>Event</code>'s connection with binary data given as base64 text, which is decoded before
+		 * 	it is sent, exposed to javascript as 'sendBase64'.
+		 *
+		 *	@param	text	The base64 encoding of the data with which to reply
+		 * 	@return	False if the text is not base64, or if this connection is buffering more data than it should, and
+		 * 			true otherwise
+		 */
+		bool send_base64(const string & text);
+
+		/**
+		 * Reply on this <code>Event</code>'s connection with binary data given as hex text, which is decoded before it
+		 * 	is sent, exposed to javascript as 'sendHex'.
+		 *
+		 *	@param	text	The hex encoding of the data with which to reply
+		 * 	@return	False if the text is not hex, or if this connection is buffering more data than it should, and true
+		 * 			otherwise
+		 */
+		bool send_hex(const string & text);
 
 		/**
 		 * Reads the string data that belongs to this event.
 		 *
 		 * 	@return	The string data received when this event was fired
 		 */
-		virtual string read() const = 0;
+		string read() const;
 
 		/**
-		 * Reads the byte data that belongs to this event
+		 * Reads the byte data that belongs to this event, converting each byte on its own. Prefer
+		 * 	<code>read_binary</code> or <code>read_blob</code> for anything but small messages.
 		 *
 		 * 	@return	The byte data received when this event was fired
 		 */
-		virtual FB::VariantList read_bytes() const = 0;
+		FB::VariantList read_bytes() const;
+
+		/**
+		 * Reads the data that belongs to this event as a string holding one byte in each character, exposed to
+		 * 	javascript as 'readBinary'.
+		 *
+		 * 	@return	The binary data received when this event was fired
+		 */
+		binary read_binary() const;
+
+		/**
+		 * Reads the data that belongs to this event encoded as base64, exposed to javascript as 'readBase64'.
+		 *
+		 * 	@return	The base64 encoding of the data received when this event was fired
+		 */
+		string read_base64() const;
+
+		/**
+		 * Reads the data that belongs to this event encoded as hex, exposed to javascript as 'readHex'.
+		 *
+		 * 	@return	The hex encoding of the data received when this event was fired
+		 */
+		string read_hex() const;
+
+		/**
+		 * Gets a blob sharing the data that belongs to this event, without copying it, exposed to javascript as
+		 * 	'readBlob'. The blob stays valid after the event has been recycled.
+		 *
+		 * 	@return	The blob
+		 */
+		boost::shared_ptr<Blob> read_blob() const;
+
+		/**
+		 * Gets the number of bytes of data that belong to this event, exposed to javascript as 'getLength'.
+		 */
+		int get_length() const;
+
+		/**
+		 * Gets a blob sharing part of the data that belongs to this event, without copying it, exposed to javascript as
+		 * 	'readSlice'. Like <code>String.prototype.substr</code>, the part is cut short at the end of the data.
+		 *
+		 * 	@param	offset	The offset of the first byte to read
+		 * 	@param	length	The number of bytes to read, or up to the end of the data if not given
+		 * 	@return	The blob, which is empty if the offset is past the end
+		 */
+		boost::shared_ptr<Blob> read_slice(int offset, boost::optional<int> length) const;
+
+		/**
+		 * Finds a sequence of bytes in the data that belongs to this event, exposed to javascript as 'indexOf'.
+		 *
+		 * 	@param	pattern	The bytes to find, as a string holding one byte in each character
+		 * 	@param	from	The offset to start searching from, or the start of the data if not given
+		 * 	@return	The offset of the first match at or after <code>from</code>, or -1 if there is none
+		 */
+		int index_of(const binary & pattern, boost::optional<int> from) const;
+
+		/**
+		 * Reads an unsigned byte from the data that belongs to this event, exposed to javascript as 'readUint8'.
+		 *
+		 * 	@param	offset	The offset of the byte
+		 * 	@return	The byte
+		 * 	@throws	FB::script_error if the byte is outside the data
+		 */
+		int read_uint8(int offset) const;
+
+		/**
+		 * Reads an unsigned 16-bit integer from the data that belongs to this event, exposed to javascript as
+		 * 	'readUint16'. Like <code>DataView</code>, integers are big-endian unless asked otherwise.
+		 *
+		 * 	@param	offset			The offset of the integer
+		 * 	@param	little_endian	True if the integer is little-endian
+		 * 	@return	The integer
+		 * 	@throws	FB::script_error if the integer is outside the data
+		 */
+		int read_uint16(int offset, boost::optional<bool> little_endian) const;
+
+		/**
+		 * Reads an unsigned 32-bit integer from the data that belongs to this event, exposed to javascript as
+		 * 	'readUint32'. Like <code>DataView</code>, integers are big-endian unless asked otherwise.
+		 *
+		 * 	@param	offset			The offset of the integer
+		 * 	@param	little_endian	True if the integer is little-endian
+		 * 	@return	The integer, as a number since it may not fit a signed integer
+		 * 	@throws	FB::script_error if the integer is outside the data
+		 */
+		double read_uint32(int offset, boost::optional<bool> little_endian) const;
 
 		/**
 		 * Get the address, or hostname of the remote endpoint for this event.
@@ -80,10 +211,130 @@ class Event: public FB::JSAPIAuto
 		 */
 		virtual unsigned short get_port() = 0;
 
+		/**
+		 * Gets the time the data for this event was received, as timestamped by the kernel when the 'timestamps' option
+		 * 	is set. For TCP, this is the time the last of the data arrived.
+		 *
+		 * 	@return	The number of milliseconds since the Unix epoch, with a fractional part, or zero if unknown
+		 */
+		double get_receive_time() const;
+
+		/**
+		 * Gets the time this event was fired to javascript, either on its own or as part of a batch.
+		 *
+		 * 	@return	The number of milliseconds since the Unix epoch, with a fractional part, or zero if not yet fired
+		 */
+		double get_dispatch_time() const;
+
+		/**
+		 * Records the time this event was fired to javascript.
+		 *
+		 * 	@param	time	The number of nanoseconds since the Unix epoch
+		 */
+		void set_dispatch_time(boost::int64_t time);
+
+		/**
+		 * Drops everything this event holds on to for the data it was fired for, once javascript has let go of it, so
+		 * 	that it can be reused for other data.
+		 */
+		virtual void recycle();
+
+		/**
+		 * Checks whether this event can be reused for other data once javascript has let go of it. An event that script
+		 * 	attached listeners to is not, since its listeners would be fired for, and their closures kept alive by, the
+		 * 	messages it is reused for, and neither is one script set properties of its own on.
+		 *
+		 * 	@return	True if no listeners were ever attached to this event, and no properties set on it
+		 */
+		bool reusable() const;
+
+		/**
+		 * Attaches a javascript listener to this event, after which the event is no longer reused.
+		 *
+		 * 	@param	name	The name of the event listened for
+		 * 	@param	event	The listener
+		 */
+		virtual void registerEventMethod(const std::string & name, FB::JSObjectPtr & event);
+
+		/**
+		 * Attaches a javascript object listening for all of this event's events, after which the event is no longer
+		 * 	reused.
+		 *
+		 * 	@param	event	The listening object
+		 */
+		virtual void registerEventInterface(const FB::JSObjectPtr & event);
+
+		// Keep the overloads taking wide strings, which forward to the ones below
+		using FB::JSAPIAuto::SetProperty;
+		using FB::JSAPIAuto::RemoveProperty;
+
+		/**
+		 * Sets a property of this event from javascript, after which the event is no longer reused.
+		 *
+		 * 	@param	name	The name of the property
+		 * 	@param	value	The value to set it to
+		 */
+		virtual void SetProperty(const std::string & name, const FB::variant & value);
+
+		/**
+		 * Sets an indexed property of this event from javascript, after which the event is no longer reused.
+		 *
+		 * 	@param	index	The index of the property
+		 * 	@param	value	The value to set it to
+		 */
+		virtual void SetProperty(int index, const FB::variant & value);
+
+		/**
+		 * Removes a property of this event from javascript, after which the event is no longer reused.
+		 *
+		 * 	@param	name	The name of the property
+		 */
+		virtual void RemoveProperty(const std::string & name);
+
+		/**
+		 * Removes an indexed property of this event from javascript, after which the event is no longer reused.
+		 *
+		 * 	@param	index	The index of the property
+		 */
+		virtual void RemoveProperty(int index);
+
 		/**
 		 * The javascript event fired when an error occurs, which sends the error message when fired.
 		 */
 		FB_JSAPI_EVENT(error, 1, (const string &));
+
+	protected:
+
+		/**
+		 * Checks that a number of bytes at an offset lie within the data that belongs to this event, throwing a script
+		 * 	error if they do not.
+		 *
+		 * 	@param	offset	The offset of the first byte
+		 * 	@param	size	The number of bytes
+		 * 	@return	The data, at the offset
+		 */
+		const char * checked_data(int offset, size_t size) const;
+
+		/**
+		 * The buffer holding the data received when this event was fired, shared with the receive that filled it, or
+		 * 	null if there is none
+		 */
+		SharedBufferPtr data;
+
+		/**
+		 * The time the data for this event was received, in nanoseconds since the Unix epoch, or zero if unknown
+		 */
+		boost::int64_t receive_time;
+
+		/**
+		 * The time this event was fired to javascript, in nanoseconds since the Unix epoch, or zero if not yet fired
+		 */
+		boost::int64_t dispatch_time;
+
+		/**
+		 * Whether javascript has attached a listener to this event, or set or removed a property of its own on it
+		 */
+		bool listened;
 };
 #endif
 
@@ -0,0 +1,138 @@
+/*
+ * EventPool.h
+ *
+ *  Created on: Oct 17, 2026
+ */
+
+#ifndef EVENTPOOL_H_
+#define EVENTPOOL_H_
+
+#include <boost/make_shared.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+#include <boost/weak_ptr.hpp>
+
+#include <vector>
+
+/**
+ * A pool of event objects, recycled once javascript lets go of them, so that receiving a message neither allocates a
+ * 	new event nor registers its javascript API again. Events are handed out as shared pointers whose deleter returns
+ * 	them to the pool, after calling their <code>recycle</code> method to drop what they hold on to. Events released
+ * 	once the pool is full, or after it is destroyed, are deleted instead, as are events that are not
+ * 	<code>reusable</code> because script attached listeners to them.
+ *
+ * 	The event type must be default constructible, and have <code>recycle</code> and <code>reusable</code> methods.
+ */
+template<class T>
+class EventPool
+{
+	public:
+
+		/**
+		 * Builds an empty pool.
+		 *
+		 * 	@param	capacity	The largest number of idle events kept for reuse
+		 */
+		explicit EventPool(size_t capacity = DEFAULT_CAPACITY) :
+			state(boost::make_shared<State>(capacity))
+		{
+		}
+
+		/**
+		 * Takes an idle event from the pool, or builds a new one if there is none.
+		 *
+		 * 	@return	A reference to the event, which returns it to the pool when the last reference is dropped
+		 */
+		boost::shared_ptr<T> acquire()
+		{
+			T * event = 0;
+
+			state->mutex.lock();
+			if (!state->idle.empty())
+			{
+				event = state->idle.back();
+				state->idle.pop_back();
+			}
+			state->mutex.unlock();
+
+			if (!event)
+				event = new T();
+
+			return boost::shared_ptr<T>(event, Recycler(state));
+		}
+
+		/** The default number of idle events kept for reuse */
+		static const size_t DEFAULT_CAPACITY = 256;
+
+	private:
+
+		/**
+		 * The idle events, shared with the deleters of the events handed out, so that events released after the pool is
+		 * 	destroyed can tell
+		 */
+		struct State
+		{
+			State(size_t capacity) :
+				capacity(capacity)
+			{
+			}
+
+			~State()
+			{
+				for (size_t i = 0; i < idle.size(); i++)
+					delete idle[i];
+			}
+
+			/** The largest number of idle events kept */
+			size_t capacity;
+
+			/** The events waiting to be reused */
+			std::vector<T *> idle;
+
+			/** A mutex around the idle events, which are released from the javascript thread */
+			boost::mutex mutex;
+		};
+
+		/**
+		 * The deleter of the events handed out, which returns them to the pool
+		 */
+		struct Recycler
+		{
+			Recycler(const boost::shared_ptr<State> & state) :
+				state(state)
+			{
+			}
+
+			void operator()(T * event)
+			{
+				boost::shared_ptr<State> pool = state.lock();
+
+				if (pool && event->reusable())
+				{
+					event->recycle();
+
+					boost::mutex::scoped_lock lock(pool->mutex);
+					if (pool->idle.size() < pool->capacity)
+					{
+						pool->idle.push_back(event);
+						return;
+					}
+				}
+
+				delete event;
+			}
+
+			/** The pool to return events to, if it still exists */
+			boost::weak_ptr<State> state;
+		};
+
+		/**
+		 * Disallows copying an event pool
+		 */
+		EventPool(const EventPool &other);
+
+		/** The idle events */
+		boost::shared_ptr<State> state;
+};
+
+#endif /* EVENTPOOL_H_ */
@@ -6,8 +6,120 @@
  */
 
 #include "NetworkObject.h"
+#include "ReceiveTime.h"
 
-NetworkObject::NetworkObject()
+NetworkObject::NetworkObject() :
+	max_batch_messages(DEFAULT_BATCH_SIZE), max_batch_delay(DEFAULT_BATCH_DELAY)
 {
 	registerMethod("close", make_method(this, &NetworkObject::shutdown));
 }
+
+NetworkObject::~NetworkObject()
+{
+	if (batch)
+	{
+		// Waits for any batch being fired, after which flushes and timer expiries already queued find no owner
+		boost::recursive_mutex::scoped_lock lock(batch->mutex);
+		batch->owner = 0;
+
+		boost::system::error_code error_code;
+		batch->timer.cancel(error_code);
+	}
+}
+
+void NetworkObject::enable_batching(boost::asio::io_service & io_service, boost::optional<int> max_messages,
+		boost::optional<int> max_delay)
+{
+	if (max_messages)
+		max_batch_messages = std::max(1, *max_messages);
+
+	if (max_delay)
+		max_batch_delay = std::max(0, *max_delay);
+
+	batch.reset(new BatchState(this, io_service));
+}
+
+void NetworkObject::dispatch_data(boost::shared_ptr<Event> event)
+{
+	if (!batch)
+	{
+		event->set_dispatch_time(ReceiveTime::now());
+		fire_data(FB::JSAPIPtr(event));
+		return;
+	}
+
+	// Batches are fired while holding the lock, so that a full batch and a timed out one cannot overtake each other
+	boost::recursive_mutex::scoped_lock lock(batch->mutex);
+	batch->pending.push_back(event);
+
+	if (batch->pending.size() >= (size_t) max_batch_messages)
+	{
+		// The batch is full, fire it now
+		vector<boost::shared_ptr<Event> > events;
+		events.swap(batch->pending);
+		batch->timer.cancel();
+		fire_batch(events);
+	}
+	else if (batch->pending.size() == 1 && max_batch_delay == 0)
+	{
+		// Without a delay, fire whatever arrived during this turn of the event loop
+		batch->io_service.post(boost::bind(&NetworkObject::batch_flush_handler, batch));
+	}
+	else if (batch->pending.size() == 1)
+	{
+		// This is the first message of a new batch, bound how long it may wait
+		batch->timer.expires_from_now(boost::posix_time::microseconds(max_batch_delay));
+		batch->timer.async_wait(boost::bind(&NetworkObject::batch_timer_handler, batch, _1));
+	}
+}
+
+void NetworkObject::flush_batch()
+{
+	if (!batch)
+		return;
+
+	boost::recursive_mutex::scoped_lock lock(batch->mutex);
+
+	vector<boost::shared_ptr<Event> > events;
+	events.swap(batch->pending);
+
+	if (!events.empty())
+		fire_batch(events);
+}
+
+void NetworkObject::fire_batch(const vector<boost::shared_ptr<Event> > & pending)
+{
+	boost::int64_t now = ReceiveTime::now();
+	FB::VariantList events;
+
+	for (size_t i = 0; i < pending.size(); i++)
+	{
+		pending[i]->set_dispatch_time(now);
+		events.push_back(FB::JSAPIPtr(pending[i]));
+	}
+
+	fire_dataBatch(events);
+}
+
+void NetworkObject::batch_flush_handler(boost::shared_ptr<BatchState> state)
+{
+	// The object may have been destroyed while this was queued
+	boost::recursive_mutex::scoped_lock lock(state->mutex);
+	if (state->owner)
+		state->owner->flush_batch();
+}
+
+void NetworkObject::batch_timer_handler(boost::shared_ptr<BatchState> state, const boost::system::error_code & error_code)
+{
+	// The batch was already fired because it filled up
+	if (error_code == boost::asio::error::operation_aborted)
+		return;
+
+	// The object was destroyed after this expiry was already queued, or the batch filled up and the timer now belongs
+	// to a newer batch
+	boost::recursive_mutex::scoped_lock lock(state->mutex);
+	if (!state->owner || state->timer.expires_at() > boost::posix_time::microsec_clock::universal_time())
+		return;
+
+	state->owner->flush_batch();
+}
@@ -34,12 +34,19 @@
 #ifndef NETWORKOBJECT_H_
 #define NETWORKOBJECT_H_
 
+#include <algorithm>
 #include <string>
 #include <map>
 #include <vector>
 #include <queue>
 
+#include <boost/asio.hpp>
+#include <boost/bind.hpp>
+#include <boost/optional.hpp>
+#include <boost/thread.hpp>
+
 #include "JSAPIAuto.h"
+#include "Event.h"
 
 using std::string;
 using std::vector;
@@ -62,7 +69,7 @@ class NetworkObject: public FB::JSAPIAuto
 		/**
 		 * Deconstructs this network object
 		 */
-		virtual ~NetworkObject() {}
+		virtual ~NetworkObject();
 
 		/**
 		 * Gracefully shutdown this server object, waiting until all sends have completed before freeing all resources for
@@ -87,6 +94,113 @@ class NetworkObject: public FB::JSAPIAuto
 		 * 	@see Event
 		 */
 		FB_JSAPI_EVENT(data, 1, (FB::JSAPIPtr));
+
+		/**
+		 * The javascript event fired instead of 'data' when batching is enabled. This event sends with it an array of
+		 * 	the <code>Event</code> objects received since the last batch was fired, in the order they were received.
+		 *
+		 * 	@see Event
+		 */
+		FB_JSAPI_EVENT(dataBatch, 1, (const FB::VariantList &));
+
+	protected:
+
+		/**
+		 * Enables batching of data events, so that received data is delivered to javascript in a single 'dataBatch'
+		 * 	event once enough messages have accumulated, or once the oldest pending message has waited long enough.
+		 *
+		 * 	@param	io_service		The I/O service on which to run the batch timer
+		 * 	@param	max_messages	The number of messages after which a batch is fired, if set
+		 * 	@param	max_delay		The number of microseconds after which a partial batch is fired, if set. With a delay of
+		 * 							zero, a partial batch is fired at the end of the current turn of the event loop.
+		 */
+		void enable_batching(boost::asio::io_service & io_service, boost::optional<int> max_messages,
+				boost::optional<int> max_delay);
+
+		/**
+		 * Delivers a data event to javascript, either immediately as a 'data' event, or as part of the next batch if
+		 * 	batching is enabled. The event is stamped with the time it is fired.
+		 *
+		 * 	@param	event	The event to deliver
+		 */
+		void dispatch_data(boost::shared_ptr<Event> event);
+
+		/**
+		 * Immediately fires any pending batch of data events. Called when the object shuts down, so that no messages are
+		 * 	left waiting on the batch timer.
+		 */
+		void flush_batch();
+
+	private:
+
+		/**
+		 * Stamps a batch of data events with the current time, and fires them in a single 'dataBatch' event.
+		 *
+		 * 	@param	pending	The events to fire
+		 */
+		void fire_batch(const vector<boost::shared_ptr<Event> > & pending);
+
+		/**
+		 * The batching state, which handlers queued on the I/O service share, so that they may safely run after this
+		 * 	object is destroyed. Its owner is cleared under its mutex when this object is destroyed, after which those
+		 * 	handlers do nothing.
+		 */
+		struct BatchState
+		{
+			BatchState(NetworkObject * owner, boost::asio::io_service & io_service) :
+				owner(owner), io_service(io_service), timer(io_service)
+			{
+			}
+
+			/** The object whose data events are batched, or null once it has been destroyed */
+			NetworkObject * owner;
+
+			/** The I/O service on which partial batches are flushed */
+			boost::asio::io_service & io_service;
+
+			/** The data events waiting to be fired in the next batch */
+			vector<boost::shared_ptr<Event> > pending;
+
+			/**
+			 * A mutex around the pending batch and the owner, which is held while a batch is fired. It is recursive,
+			 * 	since javascript handling a batch may close the object, which flushes it again.
+			 */
+			boost::recursive_mutex mutex;
+
+			/** The timer bounding how long a partial batch may wait */
+			boost::asio::deadline_timer timer;
+		};
+
+		/**
+		 * Handler invoked at the end of the turn of the event loop in which the first message of a batch arrived, when
+		 * 	batching without a delay.
+		 *
+		 * 	@param	state	The batching state of the object whose batch to fire
+		 */
+		static void batch_flush_handler(boost::shared_ptr<BatchState> state);
+
+		/**
+		 * Handler invoked when the oldest pending message in a batch has waited long enough.
+		 *
+		 * 	@param	state		The batching state of the object whose batch to fire
+		 * 	@param	error_code	The error code for the timer, nonzero if the timer was cancelled
+		 */
+		static void batch_timer_handler(boost::shared_ptr<BatchState> state, const boost::system::error_code & error_code);
+
+		/** The default number of messages after which a batch is fired */
+		static const int DEFAULT_BATCH_SIZE = 64;
+
+		/** The default number of microseconds after which a partial batch is fired */
+		static const int DEFAULT_BATCH_DELAY = 1000;
+
+		/** The number of messages after which a batch is fired */
+		int max_batch_messages;
+
+		/** The number of microseconds after which a partial batch is fired */
+		int max_batch_delay;
+
+		/** The batching state, or null if data events are not batched */
+		boost::shared_ptr<BatchState> batch;
 };
 
 #endif /* NETWORKOBJECT_H_ */
@@ -7,29 +7,95 @@
 
 #include "NetworkThread.h"
 
+// Boost.Asio picks its event loop backend at compile time, so every network thread in a build shares it
+#if defined(BOOST_ASIO_HAS_IO_URING_AS_DEFAULT)
+const string NetworkThread::NATIVE_ENGINE("io_uring");
+#elif defined(__UNIX__)
+const string NetworkThread::NATIVE_ENGINE("epoll");
+#elif defined(__OSX__)
+const string NetworkThread::NATIVE_ENGINE("kqueue");
+#else
+const string NetworkThread::NATIVE_ENGINE("iocp");
+#endif
+
 NetworkThread::NetworkThread() :
-	logger_category("NETWORK THREAD")
+	logger_category("NETWORK THREAD"), buffer_pool(new BufferPool()), next_loop_index(0)
+{
+	init(DEFAULT_THREADS);
+}
+
+NetworkThread::NetworkThread(map<string, string> options) :
+	logger_category("NETWORK THREAD"), buffer_pool(new BufferPool()), next_loop_index(0)
+{
+	int threads = DEFAULT_THREADS;
+
+	map<string, string>::iterator it = options.find("threads");
+	if (it != options.end())
+	{
+		if (it->second == "auto")
+		{
+			threads = boost::thread::hardware_concurrency();
+		}
+		else
+		{
+			try
+			{
+				threads = boost::lexical_cast<int>(it->second);
+			}
+			catch (boost::bad_lexical_cast &)
+			{
+				Logger::warn("Invalid thread count '" + it->second + "', using the default", Logger::NO_PORT, logger_category);
+			}
+		}
+	}
+
+	it = options.find("engine");
+	if (it != options.end() && it->second != NATIVE_ENGINE)
+	{
+		Logger::warn("The '" + it->second + "' engine is not available in this build, using '" + NATIVE_ENGINE + "'",
+				Logger::NO_PORT, logger_category);
+	}
+
+	init(threads);
+}
+
+void NetworkThread::init(int threads)
 {
-	// No initialization required for the logger
-	Logger::info("Network thread initialized", Logger::NO_PORT, logger_category);
+	// Clamp the number of background threads to something sensible
+	thread_count = std::max(1, std::min(threads, (int) MAX_THREADS));
+	engine = NATIVE_ENGINE;
+
+	Logger::info("Network thread initialized with " + boost::lexical_cast<string>(thread_count) + " background threads on "
+			+ engine, Logger::NO_PORT, logger_category);
 
 	// Register root methods for creating servers & clients
 	registerMethod("createUdpClient", make_method(this, &NetworkThread::create_udp_client));
 	registerMethod("createUdpServer", make_method(this, &NetworkThread::create_udp_server));
 	registerMethod("createTcpClient", make_method(this, &NetworkThread::create_tcp_client));
 	registerMethod("createTcpServer", make_method(this, &NetworkThread::create_tcp_server));
+	registerMethod("getThreadCount", make_method(this, &NetworkThread::get_thread_count));
+	registerMethod("getEngine", make_method(this, &NetworkThread::get_engine));
+	registerMethod("getPoolStats", make_method(this, &NetworkThread::get_pool_stats));
 
-	// Start the I/O service running in the background
-	background_thread = boost::thread(boost::bind(&NetworkThread::run, this));
+	// Start an I/O service running on each of the background threads
+	for (int i = 0; i < thread_count; i++)
+	{
+		boost::shared_ptr<boost::asio::io_service> loop(new boost::asio::io_service(1));
+		loops.push_back(loop);
+		background_threads.create_thread(boost::bind(&NetworkThread::run, this, loop));
+	}
 }
 
 NetworkThread::~NetworkThread()
 {
-	// Stop the IO service, and wait for the background thread to exit, log (but don't do anything) if there's an error
+	// Stop the IO service, and wait for the background threads to exit, log (but don't do anything) if there's an error
 	try
 	{
-		io_service.stop();
-		background_thread.join();
+		for (size_t i = 0; i < loops.size(); i++)
+		{
+			loops[i]->stop();
+		}
+		background_threads.join_all();
 	}
 	catch (std::exception & error)
 	{
@@ -50,12 +116,12 @@ boost::shared_ptr<TcpServer> NetworkThread::create_tcp_server(int port, boost::o
 
 	if (options)
 	{
-		boost::shared_ptr<TcpServer> new_server(new TcpServer(port, io_service, *options));
+		boost::shared_ptr<TcpServer> new_server(new TcpServer(port, next_loop(), *buffer_pool, *options, get_loops()));
 		tcp_servers.insert(new_server);
 		return new_server;
 	}
 
-	boost::shared_ptr<TcpServer> new_server(new TcpServer(port, io_service));
+	boost::shared_ptr<TcpServer> new_server(new TcpServer(port, next_loop(), *buffer_pool, get_loops()));
 	tcp_servers.insert(new_server);
 	return new_server;
 }
@@ -69,12 +135,12 @@ boost::shared_ptr<TcpClient> NetworkThread::create_tcp_client(const string & hos
 
 	if (options)
 	{
-		boost::shared_ptr<TcpClient> new_client(new TcpClient(host, port, io_service, *options));
+		boost::shared_ptr<TcpClient> new_client(new TcpClient(host, port, next_loop(), *buffer_pool, *options));
 		tcp_clients.insert(new_client);
 		return new_client;
 	}
 
-	boost::shared_ptr<TcpClient> new_client(new TcpClient(host, port, io_service));
+	boost::shared_ptr<TcpClient> new_client(new TcpClient(host, port, next_loop(), *buffer_pool));
 	tcp_clients.insert(new_client);
 	return new_client;
 }
@@ -86,12 +152,12 @@ boost::shared_ptr<UdpServer> NetworkThread::create_udp_server(int port, boost::o
 
 	if (options)
 	{
-		boost::shared_ptr<UdpServer> new_server(new UdpServer(port, io_service, *options));
+		boost::shared_ptr<UdpServer> new_server(new UdpServer(port, next_loop(), *buffer_pool, *options));
 		udp_servers.insert(new_server);
 		return new_server;
 	}
 
-	boost::shared_ptr<UdpServer> new_server(new UdpServer(port, io_service));
+	boost::shared_ptr<UdpServer> new_server(new UdpServer(port, next_loop(), *buffer_pool));
 	udp_servers.insert(new_server);
 	return new_server;
 }
@@ -105,23 +171,68 @@ boost::shared_ptr<UdpClient> NetworkThread::create_udp_client(const string & hos
 
 	if (options)
 	{
-		boost::shared_ptr<UdpClient> new_client(new UdpClient(host, port, io_service, *options));
+		boost::shared_ptr<UdpClient> new_client(new UdpClient(host, port, next_loop(), *buffer_pool, *options));
 		udp_clients.insert(new_client);
 		return new_client;
 	}
 
-	boost::shared_ptr<UdpClient> new_client(new UdpClient(host, port, io_service));
+	boost::shared_ptr<UdpClient> new_client(new UdpClient(host, port, next_loop(), *buffer_pool));
 	udp_clients.insert(new_client);
 	return new_client;
 }
 
-void NetworkThread::run()
+int NetworkThread::get_thread_count()
+{
+	return thread_count;
+}
+
+string NetworkThread::get_engine()
+{
+	return engine;
+}
+
+FB::VariantList NetworkThread::get_pool_stats()
+{
+	vector<BufferPool::Stats> stats = buffer_pool->get_stats();
+
+	FB::VariantList size_classes;
+	for (size_t i = 0; i < stats.size(); i++)
+	{
+		FB::VariantMap size_class;
+		size_class["size"] = (int) stats[i].buffer_size;
+		size_class["buffers"] = (int) stats[i].buffers;
+		size_class["leased"] = (int) stats[i].leased;
+		size_classes.push_back(size_class);
+	}
+
+	return size_classes;
+}
+
+boost::asio::io_service & NetworkThread::next_loop()
+{
+	boost::asio::io_service & loop = *loops[next_loop_index];
+	next_loop_index = (next_loop_index + 1) % loops.size();
+	return loop;
+}
+
+vector<boost::asio::io_service *> NetworkThread::get_loops()
+{
+	vector<boost::asio::io_service *> services;
+	for (size_t i = 0; i < loops.size(); i++)
+	{
+		services.push_back(loops[i].get());
+	}
+
+	return services;
+}
+
+void NetworkThread::run(boost::shared_ptr<boost::asio::io_service> loop)
 {
-	boost::asio::io_service::work work(io_service);
+	boost::asio::io_service::work work(*loop);
 
 	try
 	{
-		io_service.run();
+		loop->run();
 	}
 	catch (std::exception & error)
 	{
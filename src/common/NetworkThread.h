@@ -11,12 +11,14 @@
 #include <boost/weak_ptr.hpp>
 #include <boost/lexical_cast.hpp>
 
+#include <algorithm>
 #include <map>
 #include <set>
 #include <string>
 
 #include "JSAPIAuto.h"
 
+#include "BufferPool.h"
 #include "TcpClient.h"
 #include "TcpEvent.h"
 #include "TcpServer.h"
@@ -28,8 +30,11 @@ using std::map;
 using std::string;
 
 /**
- * Class representing a high-level thread of computation for the plugin. This class a single background thread
+ * Class representing a high-level thread of computation for the plugin. This class has a pool of background threads
  * associated with it to perform asynchronous I/O for all clients and servers created from this (high-level) thread.
+ * Each background thread runs its own I/O service, or event loop. Clients and servers are spread over the loops as they
+ * are created, and each serializes its own handlers on a strand. TCP servers also spread the connections they accept
+ * over the loops, and a sharded server pins each shard's acceptor and connections to one loop.
  *
  * <p>This class also exposes four methods to Javascript to allow creating servers and clients whose I/O will be performed
  * on this <code>NetworkThread</code>.
@@ -44,15 +49,45 @@ class NetworkThread: public FB::JSAPIAuto
 		NetworkThread();
 
 		/**
-		 * Destroys this network thread by stopping the background I/O service and joining on the background thread.
+		 * Creates a new network thread, registers its functions to the Javascript, and starts up the background threads.
+		 * 	Supported options currently include:
+		 *
+		 * threads          the number of background threads running the I/O service, or 'auto' for one per core
+		 * engine           the event loop backend to use ('epoll' or 'io_uring' on Linux), if this build supports it
+		 *
+		 * 	@param	options	A map of options to specify the behavior of this thread.
+		 */
+		NetworkThread(map<string, string> options);
+
+		/**
+		 * Destroys this network thread by stopping the background I/O service and joining on the background threads.
 		 */
 		virtual ~NetworkThread();
 
+		/**
+		 * Returns the number of background threads running the I/O service for this <code>NetworkThread</code>.
+		 */
+		int get_thread_count();
+
+		/**
+		 * Returns the name of the event loop backend used by the I/O service of this <code>NetworkThread</code>.
+		 */
+		string get_engine();
+
+		/**
+		 * Returns the occupancy of the buffer pool shared by every client and server on this <code>NetworkThread</code>,
+		 * 	as a list with an entry for each size class in use. Each entry maps 'size' to the size in bytes of the
+		 * 	buffers in that class, 'buffers' to the number of buffers allocated for it, and 'leased' to the number of
+		 * 	those currently in use.
+		 */
+		FB::VariantList get_pool_stats();
+
 		/**
 		 * Creates a new TCP server on this <code>NetworkThread</code>.
 		 *
 		 * 	@param	port		The port on which this new TCP server should listen
-         * 	@param  options     A map of options to specify the behavior of this object.
+         * 	@param  options     A map of options to specify the behavior of this object. A 'shards' value of 'auto'
+         * 						opens one acceptor per background thread.
 		 * 	@return	A shared pointer to a newly created TCP server
 		 */
 		boost::shared_ptr<TcpServer> create_tcp_server(int port, boost::optional<map<string, string> > options);
@@ -96,21 +131,81 @@ class NetworkThread: public FB::JSAPIAuto
 		string logger_category;
 
 		/**
-		 * A helper method in which the background thread will run. This method simply starts the I/O service, and
-		 * returns once the I/O service is stopped.
+		 * The default number of background threads used to run the I/O service.
+		 */
+		static const int DEFAULT_THREADS = 1;
+
+		/**
+		 * The maximum number of background threads that may be requested for a single <code>NetworkThread</code>.
+		 */
+		static const int MAX_THREADS = 64;
+
+		/**
+		 * The name of the event loop backend the I/O service was built with.
+		 */
+		static const string NATIVE_ENGINE;
+
+		/**
+		 * Helper function to register the Javascript API and start the background threads.
+		 *
+		 * 	@param	threads	The number of background threads to start
+		 */
+		void init(int threads);
+
+		/**
+		 * A helper method in which each background thread will run. This method simply runs the thread's I/O service,
+		 * and returns once the I/O service is stopped.
+		 *
+		 * 	@param	loop	The I/O service to run
+		 */
+		void run(boost::shared_ptr<boost::asio::io_service> loop);
+
+		/**
+		 * Picks the event loop for a new client or server, going round the loops in turn.
+		 *
+		 * 	@return	The I/O service of the loop
+		 */
+		boost::asio::io_service & next_loop();
+
+		/**
+		 * Gets every event loop, for a TCP server to spread its connections over.
+		 *
+		 * 	@return	The I/O services of the loops, in the order of the background threads
+		 */
+		vector<boost::asio::io_service *> get_loops();
+
+		/**
+		 * The pool of buffers shared by all clients and servers created on this <code>NetworkThread</code>. Every buffer
+		 * 	leased from it holds a reference to it, so it outlives this thread for as long as events, blobs or queued
+		 * 	writes still hold its buffers.
+		 */
+		boost::shared_ptr<BufferPool> buffer_pool;
+
+		/**
+		 * The <code>boost</code> I/O services used to perform asynchronous I/O for the clients and servers created on
+		 * this <code>NetworkThread</code>, one per background thread
+		 */
+		vector<boost::shared_ptr<boost::asio::io_service> > loops;
+
+		/**
+		 * The index of the loop the next client or server is created on
+		 */
+		size_t next_loop_index;
+
+		/**
+		 * The background threads which run the I/O service, and exit when the I/O service is stopped.
 		 */
-		void run();
+		boost::thread_group background_threads;
 
 		/**
-		 * The <code>boost</code> I/O service to be shared between all clients and servers created on this <code>NetworkThread</code>,
-		 * which will be used to perform asynchronous I/O.
+		 * The number of background threads running the I/O service
 		 */
-		boost::asio::io_service io_service;
+		int thread_count;
 
 		/**
-		 * The background thread which launches the I/O service, and exits when the I/O service is stopped.
+		 * The name of the event loop backend used by the I/O service
 		 */
-		boost::thread background_thread;
+		string engine;
 		
 		/** Set of all udp clients 'on' this thread */
 		set<boost::shared_ptr<UdpClient> > udp_clients;
@@ -0,0 +1,95 @@
+/*
+ * ReceiveTime.cpp
+ *
+ *  Created on: Oct 17, 2026
+ */
+
+#include "ReceiveTime.h"
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#if defined(__UNIX__)
+
+#include <string.h>
+#include <time.h>
+
+#if defined(__linux__)
+#include <linux/net_tstamp.h>
+#endif
+
+#endif
+
+ReceiveTime::Mode ReceiveTime::parse(const string & value)
+{
+	if (value == "true" || value == "software")
+		return SOFTWARE;
+	if (value == "hardware")
+		return HARDWARE;
+	return NONE;
+}
+
+boost::int64_t ReceiveTime::now()
+{
+#if defined(__UNIX__)
+	struct timespec time;
+	clock_gettime(CLOCK_REALTIME, &time);
+	return (boost::int64_t) time.tv_sec * 1000000000 + time.tv_nsec;
+#else
+	static const boost::posix_time::ptime epoch(boost::gregorian::date(1970, 1, 1));
+	return (boost::posix_time::microsec_clock::universal_time() - epoch).total_microseconds() * 1000;
+#endif
+}
+
+#if defined(__UNIX__)
+
+bool ReceiveTime::enable(int socket, Mode mode)
+{
+#if defined(SO_TIMESTAMPING) && defined(__linux__)
+	if (mode == HARDWARE)
+	{
+		// Ask for both sources, so that data arriving on an interface that doesn't timestamp is still stamped
+		int flags = SOF_TIMESTAMPING_RX_HARDWARE | SOF_TIMESTAMPING_RAW_HARDWARE | SOF_TIMESTAMPING_RX_SOFTWARE
+				| SOF_TIMESTAMPING_SOFTWARE;
+		return setsockopt(socket, SOL_SOCKET, SO_TIMESTAMPING, (void*) &flags, sizeof(int)) == 0;
+	}
+#endif
+
+	int on = 1;
+	return setsockopt(socket, SOL_SOCKET, SO_TIMESTAMPNS, (void*) &on, sizeof(int)) == 0;
+}
+
+boost::int64_t ReceiveTime::from_control(struct msghdr * message)
+{
+	boost::int64_t time = 0;
+
+	for (struct cmsghdr * control = CMSG_FIRSTHDR(message); control != NULL; control = CMSG_NXTHDR(message, control))
+	{
+		if (control->cmsg_level != SOL_SOCKET)
+			continue;
+
+		if (control->cmsg_type == SCM_TIMESTAMPNS && time == 0)
+		{
+			struct timespec stamp;
+			memcpy(&stamp, CMSG_DATA(control), sizeof(struct timespec));
+			time = (boost::int64_t) stamp.tv_sec * 1000000000 + stamp.tv_nsec;
+		}
+
+#if defined(SO_TIMESTAMPING)
+		if (control->cmsg_type == SCM_TIMESTAMPING)
+		{
+			// The software timestamp comes first, then a deprecated one, then the raw hardware timestamp
+			struct timespec stamps[3];
+			memcpy(stamps, CMSG_DATA(control), sizeof(stamps));
+
+			if (stamps[2].tv_sec != 0 || stamps[2].tv_nsec != 0)
+				return (boost::int64_t) stamps[2].tv_sec * 1000000000 + stamps[2].tv_nsec;
+			if (stamps[0].tv_sec != 0 || stamps[0].tv_nsec != 0)
+				time = (boost::int64_t) stamps[0].tv_sec * 1000000000 + stamps[0].tv_nsec;
+		}
+#endif
+	}
+
+	return time;
+}
+
+#endif
@@ -0,0 +1,84 @@
+/*
+ * ReceiveTime.h
+ *
+ *  Created on: Oct 17, 2026
+ */
+
+#ifndef RECEIVETIME_H_
+#define RECEIVETIME_H_
+
+#include <boost/cstdint.hpp>
+
+#include <string>
+
+#if defined(__UNIX__)
+
+#include <sys/types.h>
+#include <sys/socket.h>
+
+#endif
+
+using std::string;
+
+/**
+ * Helpers to have the kernel timestamp the data it receives on a socket, and to read those timestamps back. Times are
+ * 	given in nanoseconds since the Unix epoch, with zero standing for an unknown time.
+ */
+namespace ReceiveTime
+{
+	/**
+	 * The source of the timestamps taken for a socket's received data
+	 */
+	enum Mode
+	{
+		/** Received data is not timestamped */
+		NONE,
+
+		/** Received data is timestamped by the kernel as it arrives, with <code>SO_TIMESTAMPNS</code> */
+		SOFTWARE,
+
+		/** Received data is timestamped by the network interface where it has been set up to do so, and by the kernel
+		 otherwise, with <code>SO_TIMESTAMPING</code> */
+		HARDWARE
+	};
+
+	/**
+	 * Parses the value of the 'timestamps' option, which is 'true' or 'software' for software timestamps, 'hardware'
+	 * 	for hardware timestamps where available, and anything else for none.
+	 *
+	 * 	@param	value	The lowercased value of the option
+	 * 	@return	The source of timestamps asked for
+	 */
+	Mode parse(const string & value);
+
+	/**
+	 * Gets the current time.
+	 *
+	 * 	@return	The number of nanoseconds since the Unix epoch
+	 */
+	boost::int64_t now();
+
+#if defined(__UNIX__)
+
+	/**
+	 * Has the kernel timestamp the data received on a socket, delivering the timestamps as ancillary data.
+	 *
+	 * 	@param	socket	The native handle of the socket
+	 * 	@param	mode	The source of timestamps, which must not be <code>NONE</code>
+	 * 	@return	True if timestamps were enabled, and false otherwise, with <code>errno</code> set
+	 */
+	bool enable(int socket, Mode mode);
+
+	/**
+	 * Finds the timestamp in the ancillary data received with a message, preferring a hardware timestamp to a software
+	 * 	one.
+	 *
+	 * 	@param	message	The header of the message received
+	 * 	@return	The time the message was received, or zero if no timestamp was received with it
+	 */
+	boost::int64_t from_control(struct msghdr * message);
+
+#endif
+}
+
+#endif /* RECEIVETIME_H_ */
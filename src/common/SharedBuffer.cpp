@@ -0,0 +1,117 @@
+/*
+ * SharedBuffer.cpp
+ *
+ *  Created on: Oct 17, 2026
+ */
+
+#include "SharedBuffer.h"
+
+#include <string.h>
+#include <new>
+
+SharedBuffer::SharedBuffer(BufferPool & pool, size_t capacity) :
+	references(0), pool(pool.shared_from_this()), bytes(pool.lease(capacity)), lease_size(capacity), length(0), receive_time(0)
+{
+}
+
+SharedBuffer::~SharedBuffer()
+{
+	pool->release(bytes, lease_size);
+}
+
+SharedBufferPtr SharedBuffer::create(BufferPool & pool, size_t capacity)
+{
+	char * header = pool.lease(sizeof(SharedBuffer));
+	return SharedBufferPtr(new (header) SharedBuffer(pool, capacity));
+}
+
+SharedBufferPtr SharedBuffer::copy(BufferPool & pool, const char * data, size_t size)
+{
+	SharedBufferPtr buffer = create(pool, size);
+	memcpy(buffer->data(), data, size);
+	buffer->set_size(size);
+	return buffer;
+}
+
+SharedBufferPtr SharedBuffer::copy(BufferPool & pool, const string & data)
+{
+	return copy(pool, data.data(), data.size());
+}
+
+SharedBufferPtr SharedBuffer::compact(BufferPool & pool, SharedBufferPtr buffer)
+{
+	if (buffer->size() > buffer->capacity() / 4)
+		return buffer;
+
+	SharedBufferPtr compacted = copy(pool, buffer->data(), buffer->size());
+	compacted->set_receive_time(buffer->get_receive_time());
+	compacted->set_destination(buffer->get_destination());
+	return compacted;
+}
+
+char * SharedBuffer::data()
+{
+	return bytes;
+}
+
+const char * SharedBuffer::data() const
+{
+	return bytes;
+}
+
+size_t SharedBuffer::size() const
+{
+	return length;
+}
+
+void SharedBuffer::set_size(size_t size)
+{
+	length = std::min(size, capacity());
+}
+
+size_t SharedBuffer::capacity() const
+{
+	return lease_size;
+}
+
+boost::int64_t SharedBuffer::get_receive_time() const
+{
+	return receive_time;
+}
+
+void SharedBuffer::set_receive_time(boost::int64_t time)
+{
+	receive_time = time;
+}
+
+const boost::asio::ip::address & SharedBuffer::get_destination() const
+{
+	return destination;
+}
+
+void SharedBuffer::set_destination(const boost::asio::ip::address & address)
+{
+	destination = address;
+}
+
+string SharedBuffer::to_string() const
+{
+	return string(bytes, length);
+}
+
+void intrusive_ptr_add_ref(SharedBuffer * buffer)
+{
+	++buffer->references;
+}
+
+void intrusive_ptr_release(SharedBuffer * buffer)
+{
+	if (--buffer->references == 0)
+	{
+		// The header lives in the pool too, so hold on to the pool until it has been released
+		boost::shared_ptr<BufferPool> pool = buffer->pool;
+
+		buffer->~SharedBuffer();
+		pool->release((char *) buffer, sizeof(SharedBuffer));
+	}
+}
@@ -0,0 +1,203 @@
+/*
+ * SharedBuffer.h
+ *
+ *  Created on: Oct 17, 2026
+ */
+
+#ifndef SHAREDBUFFER_H_
+#define SHAREDBUFFER_H_
+
+#include <boost/asio/ip/address.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/detail/atomic_count.hpp>
+#include <boost/intrusive_ptr.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <string>
+
+#include "BufferPool.h"
+
+using std::string;
+
+class SharedBuffer;
+
+/**
+ * A reference to a shared buffer, which returns the buffer to its pool when the last reference is dropped
+ */
+typedef boost::intrusive_ptr<SharedBuffer> SharedBufferPtr;
+
+/**
+ * A reference-counted payload held in a buffer leased from a <code>BufferPool</code>. The reference count and size
+ * 	live in a small header leased from the same pool, so sharing a payload between the socket, the handlers and the
+ * 	events built from it never allocates or copies. A payload is filled once, when it is created or received into, and
+ * 	is only read from after it has been shared. Each buffer holds a reference to its pool, so buffers handed to
+ * 	javascript may outlive the <code>NetworkThread</code> that received them.
+ */
+class SharedBuffer
+{
+	public:
+
+		/**
+		 * Leases a new, empty shared buffer from a pool.
+		 *
+		 * 	@param	pool		The pool from which to lease the buffer
+		 * 	@param	capacity	The number of bytes of data the buffer has room for
+		 * 	@return	A reference to the new buffer
+		 */
+		static SharedBufferPtr create(BufferPool & pool, size_t capacity);
+
+		/**
+		 * Leases a new shared buffer from a pool, holding a copy of some data.
+		 *
+		 * 	@param	pool	The pool from which to lease the buffer
+		 * 	@param	data	The data to copy into the buffer
+		 * 	@param	size	The number of bytes of data
+		 * 	@return	A reference to the new buffer
+		 */
+		static SharedBufferPtr copy(BufferPool & pool, const char * data, size_t size);
+
+		/**
+		 * Leases a new shared buffer from a pool, holding a copy of some data.
+		 *
+		 * 	@param	pool	The pool from which to lease the buffer
+		 * 	@param	data	The data to copy into the buffer
+		 * 	@return	A reference to the new buffer
+		 */
+		static SharedBufferPtr copy(BufferPool & pool, const string & data);
+
+		/**
+		 * Moves the data in a buffer into a smaller one if it uses no more than a quarter of the buffer's capacity, so
+		 * 	that a large receive buffer isn't held on to for a small payload.
+		 *
+		 * 	@param	pool	The pool from which to lease a smaller buffer
+		 * 	@param	buffer	The buffer to compact
+		 * 	@return	A reference to the compacted buffer, or to the original if it is already a good fit
+		 */
+		static SharedBufferPtr compact(BufferPool & pool, SharedBufferPtr buffer);
+
+		/**
+		 * Gets the data held in this buffer.
+		 */
+		char * data();
+
+		/**
+		 * Gets the data held in this buffer.
+		 */
+		const char * data() const;
+
+		/**
+		 * Gets the number of bytes of data held in this buffer.
+		 */
+		size_t size() const;
+
+		/**
+		 * Sets the number of bytes of data held in this buffer, after filling it. Must not be called once the buffer
+		 * 	has been shared.
+		 *
+		 * 	@param	size	The number of bytes of data, no more than the capacity
+		 */
+		void set_size(size_t size);
+
+		/**
+		 * Gets the number of bytes of data this buffer has room for.
+		 */
+		size_t capacity() const;
+
+		/**
+		 * Gets the time the data held in this buffer was received, as timestamped by the kernel.
+		 *
+		 * 	@return	The number of nanoseconds since the Unix epoch, or zero if the time is unknown
+		 */
+		boost::int64_t get_receive_time() const;
+
+		/**
+		 * Sets the time the data held in this buffer was received, after filling it. Must not be called once the
+		 * 	buffer has been shared.
+		 *
+		 * 	@param	time	The number of nanoseconds since the Unix epoch, or zero if the time is unknown
+		 */
+		void set_receive_time(boost::int64_t time);
+
+		/**
+		 * Gets the address the data held in this buffer was sent to, as reported by the kernel.
+		 *
+		 * 	@return	The destination address, or the unspecified address if it is not known
+		 */
+		const boost::asio::ip::address & get_destination() const;
+
+		/**
+		 * Sets the address the data held in this buffer was sent to, after filling it. Must not be called once the
+		 * 	buffer has been shared.
+		 *
+		 * 	@param	address	The destination address, or the unspecified address if it is not known
+		 */
+		void set_destination(const boost::asio::ip::address & address);
+
+		/**
+		 * Copies the data held in this buffer into a string.
+		 *
+		 * 	@return	A copy of the data
+		 */
+		string to_string() const;
+
+		friend void intrusive_ptr_add_ref(SharedBuffer * buffer);
+
+		friend void intrusive_ptr_release(SharedBuffer * buffer);
+
+	private:
+
+		/**
+		 * Builds the header of a shared buffer in memory leased for it, and leases the buffer's data.
+		 *
+		 * 	@param	pool		The pool the header was leased from, from which to lease the data
+		 * 	@param	capacity	The number of bytes of data to lease
+		 */
+		SharedBuffer(BufferPool & pool, size_t capacity);
+
+		/**
+		 * Releases the buffer's data back to its pool.
+		 */
+		~SharedBuffer();
+
+		/**
+		 * Disallows copying a shared buffer
+		 */
+		SharedBuffer(const SharedBuffer &other);
+
+		/**
+		 * The number of references to this buffer
+		 */
+		boost::detail::atomic_count references;
+
+		/**
+		 * The pool this buffer was leased from, kept alive until the buffer and its header are released
+		 */
+		boost::shared_ptr<BufferPool> pool;
+
+		/**
+		 * The data held in this buffer
+		 */
+		char * bytes;
+
+		/**
+		 * The number of bytes of data leased
+		 */
+		size_t lease_size;
+
+		/**
+		 * The number of bytes of data held in this buffer
+		 */
+		size_t length;
+
+		/**
+		 * The time the data held in this buffer was received, or zero if unknown
+		 */
+		boost::int64_t receive_time;
+
+		/**
+		 * The address the data held in this buffer was sent to, or the unspecified address if unknown
+		 */
+		boost::asio::ip::address destination;
+};
+
+#endif /* SHAREDBUFFER_H_ */
@@ -8,6 +8,8 @@
 #include "DOM/Document.h"
 
 #include "SockItAPI.h"
+#include "Binary.h"
+#include "Encoding.h"
 
 SockItAPI::SockItAPI(const SockItPtr& plugin, const FB::BrowserHostPtr& host) :
 	m_plugin(plugin), m_host(host)
@@ -24,6 +26,12 @@ SockItAPI::SockItAPI(const SockItPtr& plugin, const FB::BrowserHostPtr& host) :
 	// Register methods for converting to and from binary data
 	registerMethod("toBinary", make_method(this, &SockItAPI::convert_to_binary));
 	registerMethod("fromBinary", make_method(this, &SockItAPI::convert_from_binary));
+
+	// Register methods for encoding and decoding binary data as text
+	registerMethod("base64Encode", make_method(this, &SockItAPI::base64_encode));
+	registerMethod("base64Decode", make_method(this, &SockItAPI::base64_decode));
+	registerMethod("hexEncode", make_method(this, &SockItAPI::hex_encode));
+	registerMethod("hexDecode", make_method(this, &SockItAPI::hex_decode));
 }
 
 SockItAPI::~SockItAPI()
@@ -40,8 +48,13 @@ SockItPtr SockItAPI::getPlugin()
 	return plugin;
 }
 
-boost::shared_ptr<NetworkThread> SockItAPI::create_thread()
+boost::shared_ptr<NetworkThread> SockItAPI::create_thread(boost::optional<map<string, string> > options)
 {
+	if (options)
+	{
+		return boost::shared_ptr<NetworkThread>(new NetworkThread(*options));
+	}
+
 	return boost::shared_ptr<NetworkThread>(new NetworkThread());
 }
 
@@ -67,28 +80,68 @@ boost::shared_ptr<UdpClient> SockItAPI::create_udp_client(const string &host, in
 	return default_thread.create_udp_client(host, port, options);
 }
 
-binary SockItAPI::convert_to_binary(const vector<byte> bytes)
+binary SockItAPI::convert_to_binary(const vector<byte> & bytes)
 {
-	// Convert it to a character array and create a string from it
+	// Keep the low byte of each number as a character, straight into the string returned
 	binary data;
+	if (!bytes.empty())
+		Binary::widen(&bytes[0], bytes.size(), data);
+	return data;
+}
+
+FB::VariantList SockItAPI::convert_from_binary(const binary & data)
+{
+	string bytes(data.size(), '\0');
+	if (!data.empty())
+		Binary::narrow(data.data(), data.size(), &bytes[0]);
+
+	FB::VariantList fb_bytes(bytes.size());
+	for (size_t i = 0; i < bytes.size(); i++)
+		fb_bytes[i] = (unsigned char) bytes[i];
 
-    for (int i = 0; i < bytes.size(); i++)
-    {
-        data.push_back((unsigned char) bytes[i]);
-    }
+	return fb_bytes;
+}
 
+string SockItAPI::base64_encode(const binary & data)
+{
+	string bytes(data.size(), '\0');
+	if (!data.empty())
+		Binary::narrow(data.data(), data.size(), &bytes[0]);
+
+	string text;
+	Encoding::base64_encode(bytes.data(), bytes.size(), text);
+	return text;
+}
+
+binary SockItAPI::base64_decode(const string & text)
+{
+	string bytes;
+	if (!Encoding::base64_decode(text.data(), text.size(), bytes))
+		throw FB::script_error("The data given is not base64");
+
+	binary data;
+	Binary::widen(bytes.data(), bytes.size(), data);
 	return data;
 }
 
-FB::VariantList SockItAPI::convert_from_binary(binary data)
+string SockItAPI::hex_encode(const binary & data)
 {
-	vector<byte> bytes;
-	for(int i = 0; i < data.size(); i++)
-	{
-		bytes.push_back((unsigned char) data.data()[i]);
-	}
+	string bytes(data.size(), '\0');
+	if (!data.empty())
+		Binary::narrow(data.data(), data.size(), &bytes[0]);
 
-	FB::VariantList fb_bytes;
-	std::copy(bytes.begin(), bytes.end(), std::back_inserter(fb_bytes));
-	return fb_bytes;
+	string text;
+	Encoding::hex_encode(bytes.data(), bytes.size(), text);
+	return text;
+}
+
+binary SockItAPI::hex_decode(const string & text)
+{
+	string bytes;
+	if (!Encoding::hex_decode(text.data(), text.size(), bytes))
+		throw FB::script_error("The data given is not hex");
+
+	binary data;
+	Binary::widen(bytes.data(), bytes.size(), data);
+	return data;
 }
@@ -61,9 +61,10 @@ class SockItAPI: public FB::JSAPIAuto
 		/**
 		 * Creates a new <code>NetworkThread</code> object on which we can create new clients and servers.
 		 *
+         * 	@param  options The set of options passed in from Javascript, such as the number of background threads.
 		 * 	@return A shared pointer to a newly created <code>NetworkThread</code> object
 		 */
-		boost::shared_ptr<NetworkThread> create_thread();
+		boost::shared_ptr<NetworkThread> create_thread(boost::optional<map<string, string> > options);
 
 		/**
 		 * Creates a new TCP server on the default <code>NetworkThread</code>.
@@ -110,14 +111,52 @@ class SockItAPI: public FB::JSAPIAuto
 		 *
 		 * 	@param	bytes	The bytes of data to be converted into a string
 		 */
-		binary convert_to_binary(const vector<byte> bytes);
+		binary convert_to_binary(const vector<byte> & bytes);
 
 		/**
 		 * Utility function for converting a string, assumed to be binary data returned from <code>convert_to_binary</code>.
 		 *
 		 * 	@param	data	The (binary) data to be converted to an array of characters
 		 */
-		FB::VariantList convert_from_binary(binary data);
+		FB::VariantList convert_from_binary(const binary & data);
+
+		/**
+		 * Encodes binary data, given as a string holding one byte in each character, as base64. Exposed to javascript
+		 * 	as 'base64Encode'.
+		 *
+		 * 	@param	data	The binary data to encode
+		 * 	@return	The base64 encoding of the data
+		 */
+		string base64_encode(const binary & data);
+
+		/**
+		 * Decodes base64 into binary data, as a string holding one byte in each character. Exposed to javascript as
+		 * 	'base64Decode'.
+		 *
+		 * 	@param	text	The base64 text to decode
+		 * 	@return	The binary data
+		 * 	@throws	FB::script_error if the text is not base64
+		 */
+		binary base64_decode(const string & text);
+
+		/**
+		 * Encodes binary data, given as a string holding one byte in each character, as hex. Exposed to javascript as
+		 * 	'hexEncode'.
+		 *
+		 * 	@param	data	The binary data to encode
+		 * 	@return	The hex encoding of the data
+		 */
+		string hex_encode(const binary & data);
+
+		/**
+		 * Decodes hex into binary data, as a string holding one byte in each character. Exposed to javascript as
+		 * 	'hexDecode'.
+		 *
+		 * 	@param	text	The hex text to decode
+		 * 	@return	The binary data
+		 * 	@throws	FB::script_error if the text is not hex
+		 */
+		binary hex_decode(const string & text);
 
 	private:
 
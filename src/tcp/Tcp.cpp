@@ -7,8 +7,10 @@
 
 #include "Tcp.h"
 
-Tcp::Tcp(string host, int port, boost::asio::io_service & ioService) :
-	host(host), port(port), waiting_to_shutdown(false), active_jobs(0), io_service(ioService), using_ipv6(false), failed(false)
+#include <string.h>
+
+Tcp::Tcp(string host, int port, boost::asio::io_service & ioService, BufferPool & bufferPool) :
+	buffer_pool(bufferPool), min_receive_size(BUFFER_SIZE), max_receive_size(MAX_BUFFER_SIZE), io_service(ioService), strand(ioService), waiting_to_shutdown(false), using_ipv6(false), timestamp_mode(ReceiveTime::NONE), active_jobs(0), host(host), port(port), failed(false)
 {
 	// Collect the set of errors classified as 'disconnect' type errors
 	disconnect_errors.insert(boost::asio::error::connection_reset);
@@ -17,9 +19,118 @@ Tcp::Tcp(string host, int port, boost::asio::io_service & ioService) :
 	disconnect_errors.insert(boost::asio::error::operation_aborted);
 }
 
-void Tcp::send_handler(const boost::system::error_code & error_code, std::size_t bytes_transferred, string data, string host, int port,
-		boost::shared_ptr<tcp::socket> connection)
+bool Tcp::write(boost::shared_ptr<TcpConnection> connection, const string & data)
+{
+	size_t high = high_watermark ? *high_watermark : DEFAULT_HIGH_WATERMARK;
+
+	// Record that we've started a new send job
+	active_jobs_mutex.lock();
+	active_jobs++;
+	active_jobs_mutex.unlock();
+
+	// Copy the data into a pooled buffer
+	SharedBufferPtr buffer = SharedBuffer::copy(buffer_pool, data);
+
+	// Queue the data, and claim the right to start writing if nothing is in flight
+	connection->write_mutex.lock();
+	connection->write_queue.push_back(buffer);
+	connection->buffered_bytes += data.size();
+
+	bool start = connection->writable && !connection->writing;
+	if (start)
+		connection->writing = true;
+
+	bool below_high_watermark = connection->buffered_bytes < high;
+	if (!below_high_watermark)
+		connection->draining = true;
+	connection->write_mutex.unlock();
+
+	// Start the write at the end of this turn of the event loop, so that sends made in a tight loop are gathered
+	if (start)
+		get_strand(connection).post(boost::bind(&Tcp::start_write, this, connection));
+
+	return below_high_watermark;
+}
+
+void Tcp::set_writable(boost::shared_ptr<TcpConnection> connection)
+{
+	connection->write_mutex.lock();
+	connection->writable = true;
+
+	bool start = !connection->writing && !connection->write_queue.empty();
+	if (start)
+		connection->writing = true;
+	connection->write_mutex.unlock();
+
+	if (start)
+		start_write(connection);
+}
+
+void Tcp::start_write(boost::shared_ptr<TcpConnection> connection)
 {
+	vector<boost::asio::const_buffer> buffers;
+	size_t gathered_bytes = 0;
+
+	// Gather as much of the queue as the limits allow. Entries are only removed once the write covering them
+	// completes, and references to them remain valid while more data is pushed onto the back
+	connection->write_mutex.lock();
+	deque<SharedBufferPtr>::const_iterator it = connection->write_queue.begin();
+	while (it != connection->write_queue.end() && buffers.size() < MAX_GATHER_BUFFERS
+			&& (buffers.empty() || gathered_bytes + (*it)->size() <= MAX_GATHER_BYTES))
+	{
+		buffers.push_back(boost::asio::buffer((*it)->data(), (*it)->size()));
+		gathered_bytes += (*it)->size();
+		it++;
+	}
+	connection->gathered = buffers.size();
+	connection->write_mutex.unlock();
+
+	boost::asio::async_write(*connection->socket, buffers,
+			get_strand(connection).wrap(boost::bind(&Tcp::send_handler, this, _1, _2, connection, host, port)));
+}
+
+void Tcp::send_handler(const boost::system::error_code & error_code, std::size_t bytes_transferred,
+		boost::shared_ptr<TcpConnection> connection, string host, int port)
+{
+	size_t low = low_watermark ? *low_watermark : DEFAULT_LOW_WATERMARK;
+	int completed_jobs = 0;
+	bool start = false;
+	bool drained = false;
+
+	connection->write_mutex.lock();
+	if (error_code)
+	{
+		// Nothing more can be written on this connection, so drop everything that was queued
+		completed_jobs = connection->release_write_queue();
+		connection->writing = false;
+		connection->gathered = 0;
+	}
+	else
+	{
+		for (completed_jobs = 0; completed_jobs < connection->gathered; completed_jobs++)
+		{
+			connection->buffered_bytes -= connection->write_queue.front()->size();
+			connection->write_queue.pop_front();
+		}
+
+		// Keep exactly one write in flight while there's more to send
+		start = !connection->write_queue.empty();
+		connection->writing = start;
+
+		if (connection->draining && connection->buffered_bytes <= low)
+		{
+			connection->draining = false;
+			drained = true;
+		}
+	}
+	connection->write_mutex.unlock();
+
+	// Check to see if this is for the last send to complete, and if we're waiting to shutdown
+	active_jobs_mutex.lock();
+	active_jobs -= completed_jobs;
+	int current_jobs = active_jobs;
+	active_jobs_mutex.unlock();
+
 	// Check the error code
 	if (error_code)
 	{
@@ -48,22 +159,27 @@ void Tcp::send_handler(const boost::system::error_code & error_code, std::size_t
 		return;
 	}
 
-	string message("TCP send succeeded, sent " + boost::lexical_cast<string>(bytes_transferred) + " bytes, data is: " + data);
+	string message("TCP send succeeded, sent " + boost::lexical_cast<string>(bytes_transferred) + " bytes");
 	Logger::info(message, port, host);
 
-	// Check to see if this is for the last send to complete, and if we're waiting to shutdown
-	active_jobs_mutex.lock();
-	active_jobs--;
-	active_jobs_mutex.unlock();
-	int current_jobs = active_jobs;
-	if (waiting_to_shutdown && current_jobs == 0)
+	if (start)
+	{
+		start_write(connection);
+	}
+	else if (waiting_to_shutdown && current_jobs == 0)
 	{
 		close();
+		return;
+	}
+
+	if (drained)
+	{
+		fire_drain_event(connection);
 	}
 }
 
 void Tcp::receive_handler(const boost::system::error_code & error_code, std::size_t bytes_transferred,
-		boost::shared_ptr<tcp::socket> connection, string host, int port)
+		boost::shared_ptr<TcpConnection> connection, string host, int port)
 {
 	// Check for errors
 	if (error_code)
@@ -93,11 +209,12 @@ void Tcp::receive_handler(const boost::system::error_code & error_code, std::siz
 		fire_error_event(message);
 
 		// Shutdown the socket we're receiving from
-		if (connection.get() && connection->is_open())
+		boost::shared_ptr<tcp::socket> socket = connection->get_socket();
+		if (socket.get() && socket->is_open())
 		{
 			try
 			{
-				connection->shutdown(connection->shutdown_receive);
+				socket->shutdown(socket->shutdown_receive);
 			}
 			catch (...)
 			{
@@ -108,19 +225,17 @@ void Tcp::receive_handler(const boost::system::error_code & error_code, std::siz
 		return;
 	}
 
-	// Pull out the data we received, and fire a data received event
-	string data = string(receive_buffer.c_array(), bytes_transferred);
-
 	// Log success
 	string message(
 			"Successfully received all " + boost::lexical_cast<string>(bytes_transferred) + " bytes of " + boost::lexical_cast<string>(
-					bytes_transferred) + " total bytes. Data: '" + data + "'");
+					bytes_transferred) + " total bytes");
 
 	Logger::info(message, port, host);
 
+	// Fire a data received event, which shares the buffer the data was received into
 	try
 	{
-		fire_data_event(data, connection);
+		fire_data_event(connection->receive_buffer, connection);
 	}
 	catch (const boost::bad_weak_ptr &p)
 	{
@@ -129,8 +244,153 @@ void Tcp::receive_handler(const boost::system::error_code & error_code, std::siz
 
 	// Try to receive more data
 	if (connection.get())
-		connection->async_receive(boost::asio::buffer(receive_buffer),
-				boost::bind(&Tcp::receive_handler, this, _1, _2, connection, host, port));
+		start_receive(connection);
+}
+
+void Tcp::start_receive(boost::shared_ptr<TcpConnection> connection)
+{
+	boost::shared_ptr<tcp::socket> socket = connection->get_socket();
+
+	// Data is only read once it's ready, so the socket must never block on a spurious wakeup
+	if (!socket->non_blocking())
+	{
+		boost::system::error_code error_code;
+		socket->non_blocking(true, error_code);
+		if (error_code)
+		{
+			Logger::warn("Failed to make TCP socket non-blocking: '" + error_code.message() + "'", port, host);
+		}
+
+		// This is the connection's first receive, so have its data timestamped from now on if asked to
+		if (timestamp_mode != ReceiveTime::NONE)
+		{
+#if defined(__UNIX__)
+			if (!ReceiveTime::enable(socket->native_handle(), timestamp_mode))
+				Logger::warn("Failed to enable receive timestamps on TCP socket: '" + string(strerror(errno)) + "'", port, host);
+#else
+			Logger::warn("Receive timestamps are not supported on this platform", port, host);
+#endif
+		}
+	}
+
+	// Wait for data without holding a buffer
+	socket->async_receive(boost::asio::null_buffers(),
+			get_strand(connection).wrap(boost::bind(&Tcp::readable_handler, this, _1, connection)));
+}
+
+boost::shared_ptr<TcpEvent> Tcp::create_event(boost::shared_ptr<TcpConnection> connection, SharedBufferPtr data)
+{
+	boost::shared_ptr<TcpEvent> event = event_pool.acquire();
+	event->assign(this, connection, data);
+	return event;
+}
+
+void Tcp::readable_handler(const boost::system::error_code & error_code, boost::shared_ptr<TcpConnection> connection)
+{
+	if (error_code)
+	{
+		receive_handler(error_code, 0, connection, host, port);
+		return;
+	}
+
+	// Lease a buffer of the connection's current receive size only once there's something to read into it
+	boost::system::error_code receive_error;
+	size_t receive_size = std::min(std::max(connection->receive_size, min_receive_size), max_receive_size);
+	SharedBufferPtr buffer = SharedBuffer::create(buffer_pool, receive_size);
+	size_t bytes_transferred = receive_timestamped(connection->get_socket(), buffer, receive_error);
+
+	if (receive_error == boost::asio::error::would_block)
+	{
+		start_receive(connection);
+		return;
+	}
+
+	if (!receive_error)
+	{
+		// Events hold on to the buffer, so move small payloads out of large buffers first
+		buffer->set_size(bytes_transferred);
+		connection->receive_buffer = SharedBuffer::compact(buffer_pool, buffer);
+	}
+
+	receive_handler(receive_error, bytes_transferred, connection, host, port);
+	connection->receive_buffer.reset();
+
+	if (!receive_error)
+		adapt_receive_size(connection, receive_size, bytes_transferred == buffer->capacity(), bytes_transferred);
+}
+
+size_t Tcp::receive_timestamped(boost::shared_ptr<tcp::socket> socket, SharedBufferPtr buffer,
+		boost::system::error_code & error_code)
+{
+#if defined(__UNIX__)
+	if (timestamp_mode != ReceiveTime::NONE)
+	{
+		// The timestamp arrives as ancillary data, which only recvmsg reads
+		struct iovec vector;
+		vector.iov_base = buffer->data();
+		vector.iov_len = buffer->capacity();
+
+		char control[256];
+		struct msghdr message;
+		memset(&message, 0, sizeof(struct msghdr));
+		message.msg_iov = &vector;
+		message.msg_iovlen = 1;
+		message.msg_control = control;
+		message.msg_controllen = sizeof(control);
+
+		ssize_t received = recvmsg(socket->native_handle(), &message, MSG_DONTWAIT);
+
+		error_code = boost::system::error_code();
+		if (received < 0)
+		{
+			error_code = boost::system::error_code(errno, boost::asio::error::get_system_category());
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				error_code = boost::asio::error::would_block;
+			return 0;
+		}
+
+		if (received == 0)
+		{
+			error_code = boost::asio::error::eof;
+			return 0;
+		}
+
+		buffer->set_receive_time(ReceiveTime::from_control(&message));
+		return received;
+	}
+#endif
+
+	return socket->receive(boost::asio::buffer(buffer->data(), buffer->capacity()), 0, error_code);
+}
+
+void Tcp::adapt_receive_size(boost::shared_ptr<TcpConnection> connection, size_t receive_size, bool filled,
+		size_t bytes_transferred)
+{
+	if (filled)
+	{
+		// The read filled the buffer, so there's likely more waiting
+		connection->receive_size = std::min(receive_size * 2, max_receive_size);
+		connection->quiet_receives = 0;
+	}
+	else if (bytes_transferred <= receive_size / 4)
+	{
+		// Shrink back once traffic has stayed well below the buffer size for a while
+		if (++connection->quiet_receives >= QUIET_RECEIVES)
+		{
+			connection->receive_size = std::max(receive_size / 2, min_receive_size);
+			connection->quiet_receives = 0;
+		}
+	}
+	else
+	{
+		connection->receive_size = receive_size;
+		connection->quiet_receives = 0;
+	}
+}
+
+boost::asio::io_service::strand & Tcp::get_strand(boost::shared_ptr<TcpConnection> connection)
+{
+	return connection->get_strand();
 }
 
 inline string Tcp::bool_option_to_string(optional<bool> &arg, string iftrue, string iffalse)
@@ -171,7 +431,7 @@ void inline Tcp::parse_string_int_arg(map<string, string> &options, string arg,
 	}
 }
 
-void Tcp::parse_args(map<string, string> options)
+void Tcp::parse_args(map<string, string> options, int thread_count)
 {
 	map<string, string>::iterator it;
 	map<string, string> transformed_options;
@@ -199,6 +459,32 @@ void Tcp::parse_args(map<string, string> options)
 	parse_string_bool_arg(transformed_options, "keepalive", keep_alive);
 	parse_string_bool_arg(transformed_options, "nodelay", no_delay);
 	parse_string_int_arg(transformed_options, "keepalivetimeout", keep_alive_timeout);
+	// A sharded server opens one acceptor per background thread unless told otherwise
+	it = transformed_options.find("shards");
+	if (it != transformed_options.end() && it->second == "auto")
+		it->second = boost::lexical_cast<string>(thread_count);
+
+	parse_string_int_arg(transformed_options, "shards", shards);
+	parse_string_int_arg(transformed_options, "batchsize", batch_size);
+	parse_string_int_arg(transformed_options, "batchdelay", batch_delay);
+	parse_string_int_arg(transformed_options, "highwatermark", high_watermark);
+	parse_string_int_arg(transformed_options, "lowwatermark", low_watermark);
+	parse_string_int_arg(transformed_options, "minbuffer", min_buffer);
+	parse_string_int_arg(transformed_options, "maxbuffer", max_buffer);
+
+	map<string, string>::iterator timestamps_it = transformed_options.find("timestamps");
+	if (timestamps_it != transformed_options.end())
+	{
+		timestamps.reset(timestamps_it->second);
+		timestamp_mode = ReceiveTime::parse(*timestamps);
+	}
+
+	// Resolve the bounds on the receive buffer size, keeping the maximum at least as large as the minimum
+	if (min_buffer && *min_buffer > 0)
+		min_receive_size = *min_buffer;
+	if (max_buffer && *max_buffer > 0)
+		max_receive_size = *max_buffer;
+	max_receive_size = std::max(min_receive_size, max_receive_size);
 
 	log_options();
 }
@@ -213,6 +499,22 @@ void Tcp::log_options()
 	options.append(bool_option_to_string(keep_alive, "keep alive", "don't keep alive"));
 	options.append(", keep alive timeout is ");
 	options.append(option_to_string<int> (keep_alive_timeout));
+	options.append(", shards: ");
+	options.append(option_to_string<int> (shards));
+	options.append(", batch size: ");
+	options.append(option_to_string<int> (batch_size));
+	options.append(", batch delay: ");
+	options.append(option_to_string<int> (batch_delay));
+	options.append(", high watermark: ");
+	options.append(option_to_string<int> (high_watermark));
+	options.append(", low watermark: ");
+	options.append(option_to_string<int> (low_watermark));
+	options.append(", min buffer: ");
+	options.append(option_to_string<int> (min_buffer));
+	options.append(", max buffer: ");
+	options.append(option_to_string<int> (max_buffer));
+	options.append(", timestamps: ");
+	options.append(option_to_string<string> (timestamps));
 
 	Logger::info(options, port, host);
 }
@@ -222,7 +524,7 @@ bool Tcp::set_tcp_keepalive(boost::shared_ptr<tcp::socket> socket)
 #ifdef __UNIX__
 
 	// For *n*x systems
-	int native_fd = socket->native();
+	int native_fd = socket->native_handle();
 	int timeout = *keep_alive_timeout;
 	int intvl = 1;
 	int probes = 10;
@@ -242,7 +544,7 @@ bool Tcp::set_tcp_keepalive(boost::shared_ptr<tcp::socket> socket)
 
 #elif defined(__OSX__)
 
-	int native_fd = socket->native();
+	int native_fd = socket->native_handle();
 	int timeout = *keep_alive_timeout;
 	int intvl = 1;
 	int on = 1;
@@ -267,7 +569,7 @@ bool Tcp::set_tcp_keepalive(boost::shared_ptr<tcp::socket> socket)
 	keepalive_options.keepaliveinterval = 2000;
 
 	BOOL keepalive_val = true;
-	SOCKET native = socket->native();
+	SOCKET native = socket->native_handle();
 	DWORD bytes_returned;
 
 	int ret_keepalive = setsockopt(native, SOL_SOCKET, SO_KEEPALIVE, (const char *) &keepalive_val, sizeof(keepalive_val));
@@ -15,7 +15,9 @@
 #include <boost/optional.hpp>
 #include <iostream>
 #include <set>
+#include <algorithm>
 #include <map>
+#include <vector>
 
 #if defined(__UNIX__)
 
@@ -42,7 +44,12 @@
 
 
 class Tcp;
+class TcpEvent;
 
+#include "BufferPool.h"
+#include "EventPool.h"
+#include "ReceiveTime.h"
+#include "TcpConnection.h"
 #include "TcpEvent.h"
 #include "Logger.h"
 
@@ -50,6 +57,7 @@ using boost::optional;
 using boost::asio::ip::tcp;
 using boost::asio::buffer_size;
 using std::map;
+using std::vector;
 
 /**
  * Interface to abstract out the client-server model for use in the <code>Event</code>. Contains common
@@ -70,8 +78,9 @@ class Tcp
 		 * 					host to which to connect, and for servers, represents the port to which to bind and listen
 		 * 					for incoming connections.
 		 *	@param	io_service	The I/O service used for asynchronous I/O requests
+		 *	@param	buffer_pool	The pool from which buffers for sending and receiving data are leased
 		 */
-		Tcp(string host, int port, boost::asio::io_service & io_service);
+		Tcp(string host, int port, boost::asio::io_service & io_service, BufferPool & buffer_pool);
 
 		/**
 		 * Immediately calls the <code>close</code> function, freeing all resources for this TCP object and shutting down
@@ -132,10 +141,21 @@ class Tcp
          * keep alive       allow the socket to send keep-alives.
          * do not route		option to force TCP to use local interfaces only, prevents routing
          * no delay			option to disable Nagle algorithm for possibly improved performance
+         * shards           (servers only) the number of SO_REUSEPORT acceptors to spread incoming connections over,
+         *                  or 'auto' for one per background thread
+         * batch size       deliver received data in 'dataBatch' events of up to this many messages
+         * batch delay      deliver a partial batch once its oldest message has waited this many microseconds
+         * high watermark   the number of buffered bytes on a connection above which 'send' returns false
+         * low watermark    the number of buffered bytes on a connection below which 'drain' is fired again
+         * min buffer       the smallest size in bytes the receive buffer of a connection shrinks to
+         * max buffer       the largest size in bytes the receive buffer of a connection grows to
+         * timestamps       have the kernel timestamp received data, 'true' or 'software' for software timestamps,
+         *                  or 'hardware' for hardware timestamps where the interface takes them
          *
-         * @param options   A map of options to values.
+         * @param options       A map of options to values.
+         * @param thread_count  The number of background threads, which 'auto' shards resolve to
          */
-        void parse_args(map<string, string> options);
+        void parse_args(map<string, string> options, int thread_count = 1);
 
         /**
          * Write to the log the options used to create this connection.
@@ -148,22 +168,81 @@ class Tcp
 		 */
 		virtual void close() = 0;
 
+		/**
+		 * Queues data to be written on a connection, starting a write if none is in flight and the connection is writable.
+		 *
+		 * 	@param	connection	The connection on which to write the data
+		 * 	@param	data		The data to write
+		 * 	@return	False if the data buffered on this connection is now above the high watermark, and true otherwise.
+		 * 			The data is queued either way.
+		 */
+		bool write(boost::shared_ptr<TcpConnection> connection, const string & data);
+
+		/**
+		 * Marks a connection as writable, and starts writing any data queued on it before it was writable.
+		 *
+		 * 	@param	connection	The connection which may now be written to
+		 */
+		void set_writable(boost::shared_ptr<TcpConnection> connection);
+
+		/**
+		 * Asynchronously writes the data at the front of a connection's write queue as a single gathered write, invoking
+		 * 	<code>send_handler</code> on completion. Must only be called by whoever set the connection's <code>writing</code>
+		 * 	flag.
+		 *
+		 * 	@param	connection	The connection on which to write
+		 */
+		void start_write(boost::shared_ptr<TcpConnection> connection);
+
 		/**
 		 * Handler invoked when the data has been sent (or sending terminated in error).
 		 *
 		 * 	@param	error_code	The error code encountered when trying to send data, if any occurred. On success,
 		 * 						this value is zero, and nonzero on error.
 		 * 	@param	bytes_transferred	The number of bytes successfully sent over the connection.
-		 * 	@param	data		The data to be sent.
+		 * 	@param	connection	The connection this data was sent on
 		 * 	@param	host		The hostname for this TCP object
 		 * 	@param	port		The port for this TCP object
-		 * 	@param	connection	The connection this data was sent on
 		 */
 		virtual void send_handler(const boost::system::error_code & error_code, std::size_t bytes_transferred,
-				string data, string host, int port, boost::shared_ptr<tcp::socket> connection);
+				boost::shared_ptr<TcpConnection> connection, string host, int port);
+
+		/**
+		 * Handler invoked when a connection has data ready to be received. This leases a buffer from the buffer pool only
+		 * 	once there is data to read into it, so that idle connections hold no buffer.
+		 *
+		 * 	@param	error_code	The error code encountered while waiting for data, if any occurred. On success,
+		 * 						this value is zero, and nonzero on error.
+		 * 	@param	connection	The connection on which data is ready
+		 */
+		void readable_handler(const boost::system::error_code & error_code, boost::shared_ptr<TcpConnection> connection);
+
+		/**
+		 * Receives whatever data is ready on a non-blocking socket into a buffer, along with the time the kernel
+		 * 	timestamped the last of it, if timestamps are enabled.
+		 *
+		 * 	@param	socket		The socket from which to receive
+		 * 	@param	buffer		The buffer to receive into, whose receive time is set
+		 * 	@param	error_code	Set to the error encountered, if any
+		 * 	@return	The number of bytes received
+		 */
+		size_t receive_timestamped(boost::shared_ptr<tcp::socket> socket, SharedBufferPtr buffer,
+				boost::system::error_code & error_code);
+
+		/**
+		 * Adapts a connection's receive size to its traffic, doubling it when a read fills the buffer, and halving it
+		 * 	once reads have stayed small for a while, within this object's minimum and maximum buffer sizes.
+		 *
+		 * 	@param	connection	The connection on which data was received
+		 * 	@param	receive_size	The size of the buffer the data was received into
+		 * 	@param	filled		Whether the data filled the buffer
+		 * 	@param	bytes_transferred	The number of bytes received
+		 */
+		void adapt_receive_size(boost::shared_ptr<TcpConnection> connection, size_t receive_size, bool filled,
+				size_t bytes_transferred);
 
 		/**
-		 * Handler invoked when some data has been received.
+		 * Handler invoked when some data has been received into the connection's receive buffer.
 		 *
 		 * 	@param	error_code	The error code encountered when trying to receive data, if any occurred. On success,
 		 * 						this value is zero, and nonzero on error.
@@ -173,7 +252,32 @@ class Tcp
 		 * 	@param	port		The port for this TCP object
 		 */
 		virtual void receive_handler(const boost::system::error_code & error_code, std::size_t bytes_transferred,
-				boost::shared_ptr<tcp::socket> connection, string host, int port);
+				boost::shared_ptr<TcpConnection> connection, string host, int port);
+
+		/**
+		 * Asynchronously waits for the next chunk of data on a connection, invoking <code>readable_handler</code> on
+		 * 	the connection's strand once it can be received.
+		 *
+		 * 	@param	connection	The connection on which to receive data
+		 */
+		void start_receive(boost::shared_ptr<TcpConnection> connection);
+
+		/**
+		 * Takes an event from this object's pool, and assigns it to data received on a connection.
+		 *
+		 * 	@param	connection	The connection on which the data was received, and on which to reply
+		 * 	@param	data		The buffer holding the data received, or null if there is none
+		 * 	@return	The event to fire
+		 */
+		boost::shared_ptr<TcpEvent> create_event(boost::shared_ptr<TcpConnection> connection, SharedBufferPtr data);
+
+		/**
+		 * Gets the strand on which handlers for a connection run.
+		 *
+		 * 	@param	connection	The connection whose handlers to serialize
+		 * 	@return	The strand on which this connection's handlers run
+		 */
+		boost::asio::io_service::strand & get_strand(boost::shared_ptr<TcpConnection> connection);
 
 		/**
 		 * Helper to fire an error event to javascript.
@@ -189,19 +293,37 @@ class Tcp
 		 */
 		virtual void fire_disconnect_event(const string & message) = 0;
 
+		/**
+		 * Helper to fire a drain event to javascript, once the data buffered on a connection falls back below the low
+		 * 	watermark after having gone above the high watermark.
+		 *
+		 * 	@param	connection	The connection whose write queue has drained
+		 */
+		virtual void fire_drain_event(boost::shared_ptr<TcpConnection> connection) = 0;
+
 		/**
 		 * Helper to fire data event to javascript.
 		 *
-		 * 	@param	data	The data received
+		 * 	@param	data	The buffer holding the data received, which the event shares
 		 * 	@param	connection	The connection on which attempted to receive data.
 		 */
-		virtual void fire_data_event(const string data, boost::shared_ptr<tcp::socket> connection) = 0;
+		virtual void fire_data_event(SharedBufferPtr data, boost::shared_ptr<TcpConnection> connection) = 0;
 
 		/**
-		 * A constant representing the size of the buffer in which to receive data.
+		 * A constant representing the default minimum size of the buffer in which to receive data.
 		 */
 		static const int BUFFER_SIZE = 4096;
 
+		/**
+		 * A constant representing the default maximum size of the buffer in which to receive data.
+		 */
+		static const int MAX_BUFFER_SIZE = 65536;
+
+		/**
+		 * The number of consecutive small reads after which a connection's receive buffer is shrunk.
+		 */
+		static const int QUIET_RECEIVES = 8;
+
 		/**
 		 * A constant representing the maximum number of bytes that a TCP message can be in boost.
 		 * If our message is larger than this, keep trying to send it until all successful bytes were sent.
@@ -209,15 +331,58 @@ class Tcp
 		static const int MAX_DATA_SIZE = 16436;
 
 		/**
-		 * A buffer for receiving data from the remote host.
+		 * The maximum number of queued sends gathered into a single write.
+		 */
+		static const int MAX_GATHER_BUFFERS = 64;
+
+		/**
+		 * The number of bytes after which no more queued sends are gathered into a write. A single send larger than
+		 * 	this is still written in one go.
 		 */
-		boost::array<char, BUFFER_SIZE> receive_buffer;
+		static const int MAX_GATHER_BYTES = 65536;
+
+		/**
+		 * The default number of buffered bytes on a connection above which 'send' returns false.
+		 */
+		static const int DEFAULT_HIGH_WATERMARK = 1048576;
+
+		/**
+		 * The default number of buffered bytes on a connection below which 'drain' is fired again.
+		 */
+		static const int DEFAULT_LOW_WATERMARK = 262144;
+
+		/**
+		 * The pool, shared by every object on the same network thread, from which buffers for data being sent are
+		 * 	leased, and from which connections lease a buffer each time they receive data.
+		 */
+		BufferPool & buffer_pool;
+
+		/**
+		 * The pool of events fired for data received by this object, which are reused once javascript lets go of them
+		 */
+		EventPool<TcpEvent> event_pool;
+
+		/**
+		 * The smallest size a connection's receive buffer shrinks to
+		 */
+		size_t min_receive_size;
+
+		/**
+		 * The largest size a connection's receive buffer grows to
+		 */
+		size_t max_receive_size;
 
 		/**
 		 * The I/O service for perform nonblocking actions
 		 */
 		boost::asio::io_service & io_service;
 
+		/**
+		 * The strand on which all handlers for this TCP object run, which keeps them serialized when the I/O service
+		 * 	is run by more than one background thread.
+		 */
+		boost::asio::io_service::strand strand;
+
 		/**
 		 * A flag to say whether or not this server is waiting to shutdown
 		 */
@@ -248,6 +413,51 @@ class Tcp
 		 */
 		optional<int> keep_alive_timeout;
 
+		/**
+		 * The number of SO_REUSEPORT acceptors a server should open, if set
+		 */
+		optional<int> shards;
+
+		/**
+		 * The number of messages after which a batch of data events is fired, if batching
+		 */
+		optional<int> batch_size;
+
+		/**
+		 * The number of microseconds after which a partial batch of data events is fired, if batching
+		 */
+		optional<int> batch_delay;
+
+		/**
+		 * The number of buffered bytes on a connection above which 'send' returns false
+		 */
+		optional<int> high_watermark;
+
+		/**
+		 * The number of buffered bytes on a connection below which 'drain' is fired again
+		 */
+		optional<int> low_watermark;
+
+		/**
+		 * The smallest size in bytes a connection's receive buffer shrinks to, if set
+		 */
+		optional<int> min_buffer;
+
+		/**
+		 * The largest size in bytes a connection's receive buffer grows to, if set
+		 */
+		optional<int> max_buffer;
+
+		/**
+		 * The source of timestamps for received data asked for, if any
+		 */
+		optional<string> timestamps;
+
+		/**
+		 * The source of timestamps for received data
+		 */
+		ReceiveTime::Mode timestamp_mode;
+
 		/**
 		 * The current count of active jobs on the socket
 		 */
@@ -7,8 +7,8 @@
 
 #include "TcpClient.h"
 
-TcpClient::TcpClient(const string & host, int port, boost::asio::io_service & io_service) :
-	Tcp(host, port, io_service), resolver(new tcp::resolver(io_service)), connection(new tcp::socket(io_service))
+TcpClient::TcpClient(const string & host, int port, boost::asio::io_service & io_service, BufferPool & buffer_pool) :
+	Tcp(host, port, io_service, buffer_pool), resolver(new tcp::resolver(io_service)), connection(new TcpConnection(io_service, boost::shared_ptr<tcp::socket>(new tcp::socket(io_service))))
 {
 	// Check that the connection and resolver are valid, and fail gracefully if they are not
 	if (!resolver.get() || !connection.get())
@@ -23,8 +23,9 @@ TcpClient::TcpClient(const string & host, int port, boost::asio::io_service & io
 	init();
 }
 
-TcpClient::TcpClient(const string & host, int port, boost::asio::io_service & io_service, map<string, string> options) :
-	Tcp(host, port, io_service), resolver(new tcp::resolver(io_service)), connection(new tcp::socket(io_service))
+TcpClient::TcpClient(const string & host, int port, boost::asio::io_service & io_service, BufferPool & buffer_pool,
+		map<string, string> options) :
+	Tcp(host, port, io_service, buffer_pool), resolver(new tcp::resolver(io_service)), connection(new TcpConnection(io_service, boost::shared_ptr<tcp::socket>(new tcp::socket(io_service))))
 {
 	// Check that the connection and resolver are valid, and fail gracefully if they are not
 	if (!resolver.get() || !connection.get())
@@ -38,12 +39,15 @@ TcpClient::TcpClient(const string & host, int port, boost::asio::io_service & io
 
 	parse_args(options);
 
+	if (batch_size || batch_delay)
+		enable_batching(io_service, batch_size, batch_delay);
+
 	init();
 }
 
 void TcpClient::init()
 {
-	connected = false;
+	registerMethod("getBufferedAmount", make_method(this, &TcpClient::get_buffered_amount));
 
 	Logger::info(
 			"Initializing TCP client to host '" + boost::lexical_cast<string>(host) + "' on port " + boost::lexical_cast<string>(port),
@@ -60,7 +64,7 @@ void TcpClient::init()
 		tcp::resolver::query query(tcp::v6(), host, boost::lexical_cast<string>(port),
 				boost::asio::ip::resolver_query_base::numeric_service);
 		if (resolver.get())
-			resolver->async_resolve(query, boost::bind(&TcpClient::resolve_handler, this, _1, _2));
+			resolver->async_resolve(query, strand.wrap(boost::bind(&TcpClient::resolve_handler, this, _1, _2)));
 		else
 		{
 			failed = true;
@@ -75,7 +79,7 @@ void TcpClient::init()
 		tcp::resolver::query query(tcp::v4(), host, boost::lexical_cast<string>(port),
 				boost::asio::ip::resolver_query_base::numeric_service);
 		if (resolver.get())
-			resolver->async_resolve(query, boost::bind(&TcpClient::resolve_handler, this, _1, _2));
+			resolver->async_resolve(query, strand.wrap(boost::bind(&TcpClient::resolve_handler, this, _1, _2)));
 		else
 		{
 			failed = true;
@@ -88,26 +92,28 @@ void TcpClient::init()
 
 void TcpClient::init_socket()
 {
+	boost::shared_ptr<tcp::socket> socket = connection->get_socket();
+
 	// Set the socket options for this client's TCP socket
 	if (do_not_route)
 	{
 		boost::asio::socket_base::do_not_route option(*do_not_route);
-		connection->set_option(option);
+		socket->set_option(option);
 	}
 	if (keep_alive)
 	{
 		boost::asio::socket_base::keep_alive option(*keep_alive);
-		connection->set_option(option);
+		socket->set_option(option);
 	}
 	if (no_delay)
 	{
 		boost::asio::ip::tcp::no_delay option(*no_delay);
-		connection->set_option(option);
+		socket->set_option(option);
 	}
 	if (keep_alive_timeout)
 	{
 		// Set the TCP keep-alive timeout - ignores return value
-		set_tcp_keepalive(connection);
+		set_tcp_keepalive(socket);
 	}
 }
 
@@ -122,18 +128,19 @@ void TcpClient::close()
 	resolver->cancel();
 
 	// Shutdown the IO service, cancel any transfers on the socket, and close the socket
-	if (connection->is_open())
+	boost::shared_ptr<tcp::socket> socket = connection->get_socket();
+	if (socket->is_open())
 	{
 		try
 		{
-			connection->shutdown(connection->shutdown_both);
+			socket->shutdown(socket->shutdown_both);
 		}
 		catch (...)
 		{
 			Logger::warn("Socket shutdown improperly, proceeding anyway", port, host);
 		}
 
-		connection->close();
+		socket->close();
 	}
 	else
 	{
@@ -145,6 +152,9 @@ void TcpClient::shutdown()
 {
 	if (!failed)
 	{
+		// Deliver any batch still waiting on its timer before this object goes away
+		flush_batch();
+
 		active_jobs_mutex.lock();
 		int current_jobs = active_jobs;
 		active_jobs_mutex.unlock();
@@ -162,54 +172,23 @@ void TcpClient::shutdown()
 	}
 }
 
-void TcpClient::send_bytes(const vector<byte> & bytes)
-{
-	string data;
-
-	for (int i = 0; i < bytes.size(); i++)
-	{
-		data.push_back((unsigned char) bytes[i]);
-	}
-
-	send(data);
-}
-
-void TcpClient::send(const string & data)
+bool TcpClient::send(const string & data)
 {
 	if (failed)
 	{
 		// Log & fire an error
 		string message("Trying to send data on a TCP client that has permanently failed!");
 		Logger::error(message, port, host);
-		return;
+		return false;
 	}
 
-	// If we're not already connected, then queue this data to be send
-	connected_mutex.lock();
-	bool connected_now = connected;
-	connected_mutex.unlock();
-
-	if (!connected_now)
-	{
-		active_jobs_mutex.lock();
-		active_jobs++;
-		active_jobs_mutex.unlock();
-		data_queue_mutex.lock();
-		data_queue.push(data);
-		data_queue_mutex.unlock();
-	}
-	else
-	{
-		// Check if the queue needs to be flushed, and if so, flush it
-		flush();
+	// Queue the data on the connection, which holds it until the client is connected
+	return write(connection, data);
+}
 
-		// Send the data, and record that we've started a new send job
-		active_jobs_mutex.lock();
-		active_jobs++;
-		active_jobs_mutex.unlock();
-        boost::asio::async_write(*connection, boost::asio::buffer(data.data(), data.size()),
-				boost::bind(&TcpClient::send_handler, this, _1, _2, data, host, port, connection));
-	}
+int TcpClient::get_buffered_amount()
+{
+	return connection->get_buffered_bytes();
 }
 
 void TcpClient::resolve_handler(const boost::system::error_code & error_code, tcp::resolver::iterator endpoint_iterator)
@@ -245,18 +224,19 @@ void TcpClient::resolve_handler(const boost::system::error_code & error_code, tc
 	if (connection.get())
 	{
 		// Attempt to connect to the endpoint, using IPv6 if specified
+		boost::shared_ptr<tcp::socket> socket = connection->get_socket();
 		tcp::endpoint receiver_endpoint = *endpoint_iterator;
 		if (using_ipv6 && *using_ipv6)
 		{
-			connection->open(tcp::v6());
+			socket->open(tcp::v6());
 		}
 		else
 		{
-			connection->open(tcp::v4());
+			socket->open(tcp::v4());
 		}
 
 		// Initialize the socket if it's open
-		if (!connection->is_open())
+		if (!socket->is_open())
 			init_socket();
 
 		// Log success
@@ -264,7 +244,7 @@ void TcpClient::resolve_handler(const boost::system::error_code & error_code, tc
 		fire_resolve();
 
 		// Try to asynchronously establish a connection to the host
-		connection->async_connect(receiver_endpoint, boost::bind(&TcpClient::connect_handler, this, _1, endpoint_iterator));
+		socket->async_connect(receiver_endpoint, strand.wrap(boost::bind(&TcpClient::connect_handler, this, _1, endpoint_iterator)));
 	}
 	else
 	{
@@ -306,7 +286,7 @@ void TcpClient::connect_handler(const boost::system::error_code & error_code, tc
 			tcp::resolver::query query(host, boost::lexical_cast<string>(port));
 
 			// Try the next possible endpoint
-			resolver->async_resolve(query, boost::bind(&TcpClient::resolve_handler, this, _1, endpoint_iterator++));
+			resolver->async_resolve(query, strand.wrap(boost::bind(&TcpClient::resolve_handler, this, _1, endpoint_iterator++)));
 		}
 		else
 		{
@@ -318,41 +298,16 @@ void TcpClient::connect_handler(const boost::system::error_code & error_code, tc
 		}
 	}
 
-	// Log success, and record that we are now connected
+	// Log success, and remember who's on the other end for the connection's events
+	connection->cache_remote_endpoint();
 	Logger::info("Connection established to host", port, host);
 	fire_connect();
 
 	// Start receiving data on this connection
-	connection->async_receive(boost::asio::buffer(receive_buffer),
-			boost::bind(&TcpClient::receive_handler, this, _1, _2, connection, host, port));
+	start_receive(connection);
 
-	// Flush data from the queue if necessary
-	flush();
-
-	connected_mutex.lock();
-
-	connected = true;
-	connected_mutex.unlock();
-}
-
-void TcpClient::flush()
-{
-	data_queue_mutex.lock();
-	while (!data_queue.empty())
-	{
-		data_queue_mutex.unlock();
-
-		// Pull the next data chunk to be sent off the queue
-		data_queue_mutex.lock();
-		string data = data_queue.front();
-		data_queue.pop();
-		data_queue_mutex.unlock();
-
-		// Asynchronously send the data across the connection
-        boost::asio::async_write(*connection, boost::asio::buffer(data.data(), data.size()),
-				boost::bind(&TcpClient::send_handler, this, _1, _2, data, host, port, connection));
-	}
-	data_queue_mutex.unlock();
+	// Start writing any data queued before we were connected
+	set_writable(connection);
 }
 
 int TcpClient::get_port()
@@ -375,8 +330,13 @@ void TcpClient::fire_disconnect_event(const string & message)
 	fire_disconnect(message);
 }
 
-void TcpClient::fire_data_event(const string data, boost::shared_ptr<tcp::socket> connection)
+void TcpClient::fire_drain_event(boost::shared_ptr<TcpConnection> connection)
+{
+	fire_drain();
+}
+
+void TcpClient::fire_data_event(SharedBufferPtr data, boost::shared_ptr<TcpConnection> connection)
 {
-	fire_data(boost::make_shared<TcpEvent>(this, connection, data));
+	dispatch_data(create_event(connection, data));
 }
 
@@ -35,8 +35,9 @@ class TcpClient: public Tcp, public Client
 		 * 	@param	host		The hostname of the remote host to which this client will connect
 		 * 	@param	port		The port of the remote host to which this client will connect
 		 * 	@param	io_service	The I/O service to use to perform asynchronous I/O requests
+		 * 	@param	buffer_pool	The pool from which buffers for sending and receiving data are leased
 		 */
-		TcpClient(const string & host, int port, boost::asio::io_service & io_service);
+		TcpClient(const string & host, int port, boost::asio::io_service & io_service, BufferPool & buffer_pool);
 
 		/**
 		 * Builds a TCP client to connect to a specified remote host and port, and begins asynchronously resolving and
@@ -45,9 +46,11 @@ class TcpClient: public Tcp, public Client
 		 * 	@param	host		The hostname of the remote host to which this client will connect
 		 * 	@param	port		The port of the remote host to which this client will connect
 		 * 	@param	io_service	The I/O service to use to perform asynchronous I/O requests
+		 * 	@param	buffer_pool	The pool from which buffers for sending and receiving data are leased
          * 	@param  options     A map of options specifying the behavior of the socket
 		 */
-		TcpClient(const string & host, int port, boost::asio::io_service & io_service, map<string, string> options);
+		TcpClient(const string & host, int port, boost::asio::io_service & io_service, BufferPool & buffer_pool,
+				map<string, string> options);
 
 		/**
 		 * Deconstructs a TCP client, immediately calling <code>close</code> to shutdown this client's socket and stop
@@ -59,15 +62,14 @@ class TcpClient: public Tcp, public Client
 		 * Asynchronously sends data to the remote host to which this client is connected.
 		 *
 		 * 	@param	data	The data to send across the wire
+		 * 	@return	False if the data buffered on this client is now above the high watermark, and true otherwise
 		 */
-		virtual void send(const string & data);
+		virtual bool send(const string & data);
 
 		/**
-		 * Asynchronously sends bytes to the remote host to which this client is connected.
-		 *
-		 * 	@param	bytes	The bytes of data to send across the wire
+		 * Returns the number of bytes queued on this client that have not yet been written to the socket.
 		 */
-		virtual void send_bytes(const vector<byte> & bytes);
+		virtual int get_buffered_amount();
 
 		/**
 		 * Gracefully shutdown this TCP client, waiting until all sends have completed before freeing all resources for
@@ -101,6 +103,12 @@ class TcpClient: public Tcp, public Client
 		 */
 		FB_JSAPI_EVENT(connect, 0, ());
 
+		/**
+		 * The javascript event fired once the data buffered on this client falls below the low watermark, after a
+		 * 	'send' has returned false because it was above the high watermark.
+		 */
+		FB_JSAPI_EVENT(drain, 0, ());
+
 	protected:
 
 		/**
@@ -117,13 +125,20 @@ class TcpClient: public Tcp, public Client
 		 */
 		virtual void fire_disconnect_event(const string & message);
 
+		/**
+		 * Helper to fire a drain event to javascript.
+		 *
+		 * 	@param	connection	The connection whose write queue has drained
+		 */
+		virtual void fire_drain_event(boost::shared_ptr<TcpConnection> connection);
+
 		/**
 		 * Helper to fire data event to javascript.
 		 *
-		 * 	@param	data	The data received
+		 * 	@param	data	The buffer holding the data received, which the event shares
 		 * 	@param	connection	The connection on which to reply to the data
 		 */
-		virtual void fire_data_event(const string data, boost::shared_ptr<tcp::socket> connection);
+		virtual void fire_data_event(SharedBufferPtr data, boost::shared_ptr<TcpConnection> connection);
 
 		/**
 		 * Immediately cancels any pending operations and closes this client's socket.
@@ -170,46 +185,15 @@ class TcpClient: public Tcp, public Client
 		void connect_handler(const boost::system::error_code & error_code, tcp::resolver::iterator endpoint_iterator);
 
 		/**
-		 * Helper function that will listen for incoming data on the TCP connection for the client, specifically responses
-		 * 	to data already sent.
-		 */
-		void listen();
-
-		/**
-		 * Helper function to flush the queue of data if sends are requested before the client is connected
-		 */
-		void flush();
-
-		/**
-		 * A shared reference to the socket used to connect to the remote host
+		 * A shared reference to the connection to the remote host, on which data sent before this client is connected
+		 * 	is queued
 		 */
-		boost::shared_ptr<tcp::socket> connection;
+		boost::shared_ptr<TcpConnection> connection;
 
 		/**
 		 * Resolver object provided by <code>boost</code> to resolve the remote hostname and port
 		 */
 		boost::shared_ptr<tcp::resolver> resolver;
-
-		/**
-		 * A flag recording whether this client is connected yet or not, used to queue send requests made before this client
-		 *  is connected if necessary.
-		 */
-		bool connected;
-
-		/**
-		 * A mutex used to access the queue for pending jobs
-		 */
-		boost::mutex connected_mutex;
-
-		/**
-		 * A queue of data to be sent, which fills as 'send' or 'send_bytes' commands occur before the client is connected
-		 */
-		queue<string> data_queue;
-
-		/**
-		 * A mutex used to access the queue for pending jobs
-		 */
-		boost::mutex data_queue_mutex;
 };
 
 #endif	/* TCPCLIENT_H */
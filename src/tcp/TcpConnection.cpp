@@ -0,0 +1,65 @@
+/*
+ * TcpConnection.cpp
+ *
+ *  Created on: Oct 17, 2026
+ */
+
+#include "TcpConnection.h"
+
+TcpConnection::TcpConnection(boost::asio::io_service & io_service, boost::shared_ptr<tcp::socket> socket, int shard_index) :
+	socket(socket), shard_index(shard_index), remote_port(0), strand(io_service), receive_size(0), quiet_receives(0), buffered_bytes(0), writing(false), gathered(0), writable(false), draining(false)
+{
+}
+
+void TcpConnection::cache_remote_endpoint()
+{
+	boost::system::error_code error_code;
+	tcp::endpoint endpoint = socket->remote_endpoint(error_code);
+
+	if (!error_code)
+	{
+		remote_host = endpoint.address().to_string();
+		remote_port = endpoint.port();
+	}
+}
+
+int TcpConnection::release_write_queue()
+{
+	int released = write_queue.size();
+
+	write_queue.clear();
+	buffered_bytes = 0;
+
+	return released;
+}
+
+boost::shared_ptr<tcp::socket> TcpConnection::get_socket()
+{
+	return socket;
+}
+
+int TcpConnection::get_shard_index()
+{
+	return shard_index;
+}
+
+boost::asio::io_service::strand & TcpConnection::get_strand()
+{
+	return strand;
+}
+
+size_t TcpConnection::get_buffered_bytes()
+{
+	boost::mutex::scoped_lock lock(write_mutex);
+	return buffered_bytes;
+}
+
+const string & TcpConnection::get_remote_host()
+{
+	return remote_host;
+}
+
+unsigned short TcpConnection::get_remote_port()
+{
+	return remote_port;
+}
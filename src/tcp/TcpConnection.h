@@ -0,0 +1,190 @@
+/*
+ * TcpConnection.h
+ *
+ *  Created on: Oct 17, 2026
+ */
+
+#ifndef TCPCONNECTION_H_
+#define TCPCONNECTION_H_
+
+#include <boost/asio.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+
+#include <deque>
+#include <string>
+
+#include "SharedBuffer.h"
+
+using boost::asio::ip::tcp;
+using std::deque;
+using std::string;
+
+class Tcp;
+
+/**
+ * The state of a single TCP connection, owned by the TCP client or server that created it. This holds the socket
+ * 	along with the queue of data waiting to be written to it, so that exactly one write is in flight on the socket at
+ * 	any time, and data queued while it is in flight can be gathered into the next write. Each connection's handlers
+ * 	run on its own strand, so different connections are served in parallel.
+ *
+ * 	@see Tcp
+ */
+class TcpConnection
+{
+	public:
+
+		/**
+		 * Wraps a socket in a new connection, on which nothing may be written until it is marked writable.
+		 *
+		 * 	@param	io_service	The I/O service on which the socket performs asynchronous I/O
+		 * 	@param	socket		The socket for this connection
+		 * 	@param	shard_index	For servers, the index of the shard that accepted this connection
+		 */
+		TcpConnection(boost::asio::io_service & io_service, boost::shared_ptr<tcp::socket> socket, int shard_index = 0);
+
+		/**
+		 * Gets the socket for this connection.
+		 *
+		 * 	@return	The socket for this connection
+		 */
+		boost::shared_ptr<tcp::socket> get_socket();
+
+		/**
+		 * Gets the index of the shard that accepted this connection, which is always zero for clients.
+		 *
+		 * 	@return	The index of the shard that accepted this connection
+		 */
+		int get_shard_index();
+
+		/**
+		 * Gets the strand on which this connection's handlers run.
+		 *
+		 * 	@return	The strand for this connection
+		 */
+		boost::asio::io_service::strand & get_strand();
+
+		/**
+		 * Gets the number of bytes queued on this connection that have not yet been written to the socket.
+		 *
+		 * 	@return	The number of bytes waiting to be written
+		 */
+		size_t get_buffered_bytes();
+
+		/**
+		 * Gets the address of the remote host, as looked up once when the connection was accepted or established.
+		 *
+		 * 	@return	The remote address, or an empty string if it could not be looked up
+		 */
+		const string & get_remote_host();
+
+		/**
+		 * Gets the port of the remote host, as looked up once when the connection was accepted or established.
+		 *
+		 * 	@return	The remote port, or zero if it could not be looked up
+		 */
+		unsigned short get_remote_port();
+
+		/**
+		 * Looks up the remote endpoint of the connected socket and caches its address and port, so that the events
+		 * 	fired for this connection don't each ask the kernel for it. Called once, when the connection is accepted
+		 * 	or established, and never throws.
+		 */
+		void cache_remote_endpoint();
+
+		friend class Tcp;
+
+	private:
+
+		/**
+		 * Releases every queued write back to the buffer pool and empties the write queue. Must be called while
+		 * 	holding the write mutex.
+		 *
+		 * 	@return	The number of writes released
+		 */
+		int release_write_queue();
+
+		/**
+		 * Disallows copying a TCP connection
+		 */
+		TcpConnection(const TcpConnection &other);
+
+		/**
+		 * The socket for this connection
+		 */
+		boost::shared_ptr<tcp::socket> socket;
+
+
+		/**
+		 * The index of the shard that accepted this connection
+		 */
+		int shard_index;
+
+		/**
+		 * The address of the remote host, cached before the first receive
+		 */
+		string remote_host;
+
+		/**
+		 * The port of the remote host, cached before the first receive
+		 */
+		unsigned short remote_port;
+
+		/**
+		 * The strand on which this connection's handlers run
+		 */
+		boost::asio::io_service::strand strand;
+
+		/**
+		 * The data received by the receive being handled on this connection, or null while waiting for data
+		 */
+		SharedBufferPtr receive_buffer;
+
+		/**
+		 * The size of buffer to lease for the next receive, which adapts to the traffic on this connection
+		 */
+		size_t receive_size;
+
+		/**
+		 * The number of consecutive receives that have used only a small part of the buffer
+		 */
+		int quiet_receives;
+
+		/**
+		 * The data waiting to be written, the front of which is being written if <code>writing</code> is set
+		 */
+		deque<SharedBufferPtr> write_queue;
+
+		/**
+		 * The total number of bytes in the write queue
+		 */
+		size_t buffered_bytes;
+
+		/**
+		 * A flag recording whether a write is in flight on this connection
+		 */
+		bool writing;
+
+		/**
+		 * The number of entries at the front of the write queue covered by the write in flight
+		 */
+		int gathered;
+
+		/**
+		 * A flag recording whether this connection may be written to yet, which clients set once connected
+		 */
+		bool writable;
+
+		/**
+		 * A flag recording whether the write queue has gone above the high watermark, and a 'drain' event is owed
+		 * 	once it falls below the low watermark
+		 */
+		bool draining;
+
+		/**
+		 * A mutex around the write queue and its flags
+		 */
+		boost::mutex write_mutex;
+};
+
+#endif /* TCPCONNECTION_H_ */
@@ -9,91 +9,92 @@
 
 #include <stdio.h>
 
-TcpEvent::TcpEvent(Tcp * _tcp_object, boost::shared_ptr<tcp::socket> _connection, string _data) :
-	tcp_object(_tcp_object), connection(_connection), failed(false), data(_data)
+TcpEvent::TcpEvent() :
+	failed(true), tcp_object(0)
 {
+	registerMethod("getBufferedAmount", make_method(this, &TcpEvent::get_buffered_amount));
+}
+
+void TcpEvent::assign(Tcp * _tcp_object, boost::shared_ptr<TcpConnection> _connection, SharedBufferPtr _data)
+{
+	tcp_object = _tcp_object;
+	connection = _connection;
+	data = _data;
+	failed = false;
+
+	if (data)
+		receive_time = data->get_receive_time();
+
 	// Check to see if any the parameters are null, and log and fail if this occurs
-	if(tcp_object && connection)
-	{
-		// Initialize only if it's safe
-		port = connection->remote_endpoint().port();
-		host = connection->remote_endpoint().address().to_string();
-	}
-	else
+	if(!tcp_object || !connection)
 	{
 		// Fail permanently and log it
 		failed = true;
 
 		string message("TCP event was not properly initialized, permanently failed.");
-		Logger::error(message, port, host);
+		Logger::error(message, get_port(), get_host());
 		fire_error(message);
 	}
 }
 
-TcpEvent::~TcpEvent()
+void TcpEvent::recycle()
 {
-    // do not free socket, endpoint or tcp here
+	tcp_object = 0;
+	connection.reset();
+	failed = true;
+
+	Event::recycle();
 }
 
-void TcpEvent::send_bytes(const vector<byte> & bytes)
+TcpEvent::~TcpEvent()
 {
-    string data;
-
-    for (int i = 0; i < bytes.size(); i++)
-    {
-        data.push_back((unsigned char) bytes[i]);
-    }
-
-	send(data);
+    // do not free socket, endpoint or tcp here
 }
 
-void TcpEvent::send(const string & data)
+bool TcpEvent::send(const string & data)
 {
 	// Don't send if we've permanently failed
 	if(failed)
 	{
 		string message("TCP event failed to send, event already failed permanently");
-		Logger::error(message, port, host);
+		Logger::error(message, get_port(), get_host());
 		fire_error(message);
+		return false;
     }
 
 	if(!tcp_object->failed)
 	{
-		tcp_object->active_jobs++;
-        boost::asio::async_write(*connection, boost::asio::buffer(data.data(), data.size()),
-				boost::bind(&Tcp::send_handler, tcp_object, _1, _2, data, host, port, connection));
+		return tcp_object->write(connection, data);
 	}
 	else
 	{
 		string message("TCP event failed trying to reply on a permanently failed TCP object");
-		Logger::error(message, port, host);
+		Logger::error(message, get_port(), get_host());
 		fire_error(message);
+		return false;
 	}
 }
 
-string TcpEvent::read() const
-{
-	return data;
-}
-
-FB::VariantList TcpEvent::read_bytes() const
+int TcpEvent::get_buffered_amount()
 {
-    FB::VariantList fb_bytes;
-
-    for (int i = 0; i < data.size(); i++)
-    {
-        fb_bytes.push_back((unsigned char) (data.data())[i]);
-    }
+	if(failed)
+		return 0;
 
-	return fb_bytes;
+	return connection->get_buffered_bytes();
 }
 
 string TcpEvent::get_host()
 {
-	return host;
+	if (!connection)
+		return string();
+
+	return connection->get_remote_host();
 }
 
 unsigned short TcpEvent::get_port()
 {
-	return port;
+	if (!connection)
+		return 0;
+
+	return connection->get_remote_port();
 }
@@ -12,6 +12,7 @@
 
 #include "JSAPIAuto.h"
 #include "Event.h"
+#include "SharedBuffer.h"
 #include "Tcp.h"
 
 using boost::asio::ip::tcp;
@@ -27,46 +28,45 @@ class TcpEvent: public Event
 	public:
 
 		/**
-		 * Constructs a new <code>TcpEvent</code> object containing the TCP connection on which to reply.
+		 * Constructs an unassigned <code>TcpEvent</code> object, registering its javascript API. Events are taken from
+		 * 	the pool of their TCP object, and assigned to each message received.
+		 */
+		TcpEvent();
+
+		/**
+		 * Assigns this event to data received on a TCP connection, on which to reply.
 		 *
 		 * 	@param	tcp			The TCP server or client associated with this event
 		 * 	@param	connection	The TCP connection on which to reply
-		 * 	@param	data		The data received when this event was fired
+		 * 	@param	data		The buffer holding the data received when this event was fired, or null if none was
 		 */
-		TcpEvent(Tcp * tcp, boost::shared_ptr<tcp::socket> connection, string data);
+		void assign(Tcp * tcp, boost::shared_ptr<TcpConnection> connection, SharedBufferPtr data);
 
 		/**
-		 * Deconstructs the TCP event object, after a single reply.
+		 * Drops the connection and data this event was assigned, so that it can be reused.
 		 */
-		virtual ~TcpEvent();
+		virtual void recycle();
 
 		/**
-		 * Replies on the TCP connection with some data.
-		 *
-		 *	@param	data	The data with which to reply
+		 * Deconstructs the TCP event object, after a single reply.
 		 */
-		virtual void send(const string & data);
+		virtual ~TcpEvent();
 
 		/**
 		 * Replies on the TCP connection with some data.
 		 *
-		 *	@param	bytes	The bytes of data with which to reply
-		 */
-		virtual void send_bytes(const vector<byte> & bytes);
-
-		/**
-		 * Reads the string data that belongs to this event.
-		 *
-		 * 	@return	The string data received when this event was fired
+		 *	@param	data	The data with which to reply
+		 * 	@return	False if the data buffered on this connection is now above the high watermark, and true otherwise
 		 */
-		virtual string read() const;
+		virtual bool send(const string & data);
 
 		/**
-		 * Reads the byte data that belongs to this event
+		 * Gets the number of bytes queued on the TCP connection for this <code>TcpEvent</code> that have not yet been
+		 * 	written to the socket.
 		 *
-		 * 	@return	The byte data received when this event was fired
+		 * 	@return	The number of bytes waiting to be written
 		 */
-		virtual FB::VariantList read_bytes() const;
+		int get_buffered_amount();
 
 		/**
 		 * Gets the hostname of the remote endpoint of the TCP connection for this <code>TcpEvent</code>.
@@ -84,11 +84,6 @@ class TcpEvent: public Event
 
 	private:
 
-		/**
-		 * The data received when this event was fired
-		 */
-		string data;
-
 		/**
 		 * A flag to prevent this event from blowing up if was initialized improperly
 		 */
@@ -99,20 +94,10 @@ class TcpEvent: public Event
 		 */
 		Tcp * tcp_object;
 
-		/**
-		 * The remote hostname of the TCP connection for this <code>TcpEvent</code>
-		 */
-		string host;
-
-		/**
-		 * The remote port of the TCP connection for this <code>TcpEvent</code>.
-		 */
-		int port;
-
 		/**
 		 * The TCP connection on which to reply
 		 */
-		boost::shared_ptr<tcp::socket> connection;
+		boost::shared_ptr<TcpConnection> connection;
 };
 #endif	/* TCPREPLIER_H */
 
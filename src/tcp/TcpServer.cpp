@@ -7,16 +7,22 @@
 
 #include "TcpServer.h"
 
-TcpServer::TcpServer(int port, boost::asio::io_service & io_service) :
-	Tcp("SERVER", port, io_service)
+TcpServer::TcpServer(int port, boost::asio::io_service & io_service, BufferPool & buffer_pool,
+		const vector<boost::asio::io_service *> & loops) :
+	Tcp("SERVER", port, io_service, buffer_pool), loops(loops), next_loop_index(0)
 {
 	init();
 }
 
-TcpServer::TcpServer(int port, boost::asio::io_service & io_service, map<string, string> options) :
-	Tcp("SERVER", port, io_service)
+TcpServer::TcpServer(int port, boost::asio::io_service & io_service, BufferPool & buffer_pool, map<string, string> options,
+		const vector<boost::asio::io_service *> & loops) :
+	Tcp("SERVER", port, io_service, buffer_pool), loops(loops), next_loop_index(0)
 {
-	parse_args(options);
+	parse_args(options, std::max(1, (int) loops.size()));
+
+	if (batch_size || batch_delay)
+		enable_batching(io_service, batch_size, batch_delay);
+
 	init();
 }
 
@@ -30,14 +36,17 @@ void TcpServer::close()
 	// Shutdown the IO service, cancel any transfers on the socket, and close the socket
 	waiting_to_shutdown = true;
 
-    set<boost::shared_ptr<tcp::socket> >::iterator it;
+	connections_mutex.lock();
+
+    set<boost::shared_ptr<TcpConnection> >::iterator it;
     for(it = connections.begin(); it != connections.end(); it++)
     {
         try
         {
-            if((*it) && (*it).get() && (*it)->is_open())
+            boost::shared_ptr<tcp::socket> socket = (*it)->get_socket();
+            if(socket && socket.get() && socket->is_open())
             {
-                (*it)->close();
+                socket->close();
             }
         }
         catch(boost::system::error_code &e)
@@ -55,31 +64,66 @@ void TcpServer::close()
     }
 
 	connections.clear();
-
-	if (acceptor && acceptor->is_open())
+	for (size_t i = 0; i < acceptor_shards.size(); i++)
 	{
-		acceptor->close();
+		acceptor_shards[i]->connection_count = 0;
 	}
-	else
+	connections_mutex.unlock();
+
+	for (size_t i = 0; i < acceptor_shards.size(); i++)
 	{
-		// Don't fire an error, otherwise the plugin will crash
-		string message("Could not cleanly shut down acceptor in TCP server, desctructing anyways");
-		Logger::warn(message, port, host);
+		if (acceptor_shards[i]->acceptor.is_open())
+		{
+			boost::system::error_code error_code;
+			acceptor_shards[i]->acceptor.close(error_code);
+		}
+		else
+		{
+			// Don't fire an error, otherwise the plugin will crash
+			string message("Could not cleanly shut down acceptor in TCP server, desctructing anyways");
+			Logger::warn(message, port, host);
+		}
 	}
 }
 
 void TcpServer::init()
 {
-	// Bind the acceptor to the correct port & set the options on this acceptor
-	try
+	// Expose the per-shard connection counts to the javascript
+	registerMethod("getShardConnections", make_method(this, &TcpServer::get_shard_connections));
+
+	if (loops.empty())
+		loops.push_back(&io_service);
+
+	// Use a single acceptor unless sharding was explicitly requested
+	int shard_count = 1;
+	bool reuse_port = false;
+	if (shards && *shards > 0)
 	{
-		if (using_ipv6 && *using_ipv6)
+#ifdef SO_REUSEPORT
+		shard_count = *shards;
+		reuse_port = true;
+
+		if (shard_count > MAX_SHARDS)
 		{
-			acceptor = boost::shared_ptr<tcp::acceptor>(new tcp::acceptor(io_service, tcp::endpoint(tcp::v6(), port)));
+			Logger::warn("Too many shards requested, using " + boost::lexical_cast<string>((int) MAX_SHARDS), port, host);
+			shard_count = MAX_SHARDS;
 		}
-		else
+#else
+		Logger::warn("SO_REUSEPORT is not supported on this platform, using a single acceptor", port, host);
+#endif
+	}
+
+	// Bind each acceptor to the correct port & set the options on these acceptors
+	try
+	{
+		for (int i = 0; i < shard_count; i++)
 		{
-			acceptor = boost::shared_ptr<tcp::acceptor>(new tcp::acceptor(io_service, tcp::endpoint(tcp::v4(), port)));
+			// Pin each shard to a loop of its own, while there are loops to go round, and a lone acceptor to this
+			// server's own loop
+			boost::asio::io_service & loop = reuse_port ? *loops[i % loops.size()] : io_service;
+			boost::shared_ptr<Shard> shard(new Shard(loop));
+			open_acceptor(shard, reuse_port);
+			acceptor_shards.push_back(shard);
 		}
 	}
 	catch (boost::system::system_error &e)
@@ -92,8 +136,8 @@ void TcpServer::init()
 		failed = true;
 	}
 
-	// Check that acceptor was created successfully
-	if (!acceptor.get())
+	// Check that the acceptors were created successfully
+	if (acceptor_shards.empty())
 	{
 		// Fail gracefully and stop this server from ever doing anything again
 		string message("Failed to initialized TCP server acceptor");
@@ -102,6 +146,29 @@ void TcpServer::init()
 	}
 }
 
+void TcpServer::open_acceptor(boost::shared_ptr<Shard> shard, bool reuse_port)
+{
+	tcp::endpoint endpoint = (using_ipv6 && *using_ipv6) ? tcp::endpoint(tcp::v6(), port) : tcp::endpoint(tcp::v4(), port);
+
+	shard->acceptor.open(endpoint.protocol());
+	shard->acceptor.set_option(boost::asio::socket_base::reuse_address(true));
+
+#ifdef SO_REUSEPORT
+	if (reuse_port)
+	{
+		// Let the kernel spread incoming connections over every acceptor bound to this port
+		int on = 1;
+		if (setsockopt(shard->acceptor.native_handle(), SOL_SOCKET, SO_REUSEPORT, (void*) &on, sizeof(int)))
+		{
+			throw boost::system::system_error(boost::system::error_code(errno, boost::asio::error::get_system_category()));
+		}
+	}
+#endif
+
+	shard->acceptor.bind(endpoint);
+	shard->acceptor.listen();
+}
+
 void TcpServer::init_socket(boost::shared_ptr<tcp::socket> connection)
 {
 	// Set the socket options for this client's TCP socket
@@ -168,38 +235,54 @@ void TcpServer::start_listening()
 		// Log & fire an error
 		string message("Trying to start the server listening, but the server has permanently failed!");
 		Logger::error(message, port, host);
+		return;
     }
 
 	// Log listening
 	Logger::info("TCP server about to start listening for incoming connections on port "
-            + boost::lexical_cast<string>(port), port, host);
+            + boost::lexical_cast<string>(port) + " with " + boost::lexical_cast<string>(acceptor_shards.size()) + " acceptors", port, host);
 
-	// Prepare to accept a new connection and asynchronously accept new incoming connections
-    boost::shared_ptr < tcp::socket > connection(new tcp::socket(io_service), socket_deallocate);
-    connections.insert(connection);
-
-	// Try to accept any new connection
-	if(acceptor.get())
-	{
-		acceptor->async_accept(*connection, boost::bind(&TcpServer::accept_handler, this, _1, connection, host, port));
-	}
-	else
+	// Try to accept any new connection on every shard
+	for (size_t i = 0; i < acceptor_shards.size(); i++)
 	{
-		// Fail gracefully and stop this server from ever doing anything again
-		string message("TCP server failed to accept, acceptor invalid");
-		Logger::error(message, port, host);
-		failed = true;
-		return;
+		accept(i);
 	}
 
 	// Callback acknowledging that the server has opened
 	fire_open();
 }
 
+void TcpServer::accept(int shard_index)
+{
+	boost::shared_ptr<Shard> shard = acceptor_shards[shard_index];
+
+	// A sharded connection stays on its shard's loop, and otherwise the connections go round the loops in turn
+	boost::asio::io_service * loop = &shard->loop;
+	if (acceptor_shards.size() == 1)
+	{
+		loop = loops[next_loop_index];
+		next_loop_index = (next_loop_index + 1) % loops.size();
+	}
+
+	// Prepare to accept a new connection and asynchronously accept new incoming connections
+    boost::shared_ptr < tcp::socket > socket(new tcp::socket(*loop), socket_deallocate);
+    boost::shared_ptr < TcpConnection > connection(new TcpConnection(*loop, socket, shard_index));
+
+    connections_mutex.lock();
+    connections.insert(connection);
+    connections_mutex.unlock();
+
+	shard->acceptor.async_accept(*socket,
+			shard->strand.wrap(boost::bind(&TcpServer::accept_handler, this, _1, connection, host, port)));
+}
+
 void TcpServer::shutdown()
 {
 	if(!failed)
 	{
+		// Deliver any batch still waiting on its timer before this object goes away
+		flush_batch();
+
 		waiting_to_shutdown = true;
 		if (active_jobs == 0)
 		{
@@ -215,11 +298,16 @@ void TcpServer::shutdown()
 	}
 }
 
-void TcpServer::accept_handler(const boost::system::error_code & error_code, boost::shared_ptr<tcp::socket> connection, string host, int port)
+void TcpServer::accept_handler(const boost::system::error_code & error_code, boost::shared_ptr<TcpConnection> connection,
+		string host, int port)
 {
 	// Log error & return if there is an error
 	if (error_code)
 	{
+		connections_mutex.lock();
+		connections.erase(connection);
+		connections_mutex.unlock();
+
 		// Check for disconnection errors
 		std::set<boost::system::error_code>::iterator find_result = disconnect_errors.find(error_code);
 		if (find_result != disconnect_errors.end())
@@ -252,33 +340,69 @@ void TcpServer::accept_handler(const boost::system::error_code & error_code, boo
 	}
 
 	// Initialize the socket options before we start using it
-	init_socket(connection);
+	boost::shared_ptr<tcp::socket> socket = connection->get_socket();
+	init_socket(socket);
+
+	// Remember who's on the other end for the connection's events, without throwing if the peer has already gone
+	connection->cache_remote_endpoint();
 
 	// Log that we've successfully accepted a new connection, and fire the 'onconnect' event
-	string message("TCP server accepted new connection from " + connection->remote_endpoint().address().to_string() + " port "
-			+ boost::lexical_cast<string>(connection->remote_endpoint().port()));
+	string message("TCP server accepted new connection from " + connection->get_remote_host() + " port "
+			+ boost::lexical_cast<string>(connection->get_remote_port()));
 	Logger::info(message, port, host);
 	fire_connect();
 
-	if (connection.get())
-		connection->async_receive(boost::asio::buffer(receive_buffer),
-				boost::bind(&TcpServer::receive_handler, this, _1, _2, connection, host, port));
+	connections_mutex.lock();
+	acceptor_shards[connection->get_shard_index()]->connection_count++;
+	connections_mutex.unlock();
+
+	set_writable(connection);
+	start_receive(connection);
 
-	// Start listening for new connections, if we're not waiting to close
+	// Start listening for new connections on this shard, if we're not waiting to close
 	if (!waiting_to_shutdown)
 	{
-		start_listening();
+		accept(connection->get_shard_index());
 	}
 }
 
 
 void TcpServer::receive_handler(const boost::system::error_code & error_code, std::size_t bytesTransferred,
-		boost::shared_ptr<tcp::socket> connection, string host, int port)
+		boost::shared_ptr<TcpConnection> connection, string host, int port)
 {
     Tcp::receive_handler(error_code, bytesTransferred, connection, host, port);
 
-    if(connection && connection.get() && !connection->is_open())
-        connections.erase(connection);
+    // Once a receive fails, whether the peer went away or something broke, the connection is finished with, so close
+    // its socket and count it out of its shard
+    boost::shared_ptr<tcp::socket> socket = connection->get_socket();
+    if(error_code || !socket->is_open())
+    {
+        if(socket->is_open())
+        {
+            boost::system::error_code close_error;
+            socket->close(close_error);
+        }
+
+        boost::mutex::scoped_lock lock(connections_mutex);
+
+        if(connections.erase(connection))
+        {
+            acceptor_shards[connection->get_shard_index()]->connection_count--;
+        }
+    }
+}
+
+FB::VariantList TcpServer::get_shard_connections()
+{
+	boost::mutex::scoped_lock lock(connections_mutex);
+
+	FB::VariantList counts;
+	for (size_t i = 0; i < acceptor_shards.size(); i++)
+	{
+		counts.push_back(acceptor_shards[i]->connection_count);
+	}
+
+	return counts;
 }
 
 int TcpServer::get_port()
@@ -296,7 +420,12 @@ void TcpServer::fire_disconnect_event(const string & message)
 	fire_disconnect(message);
 }
 
-void TcpServer::fire_data_event(const string data, boost::shared_ptr<tcp::socket> connection)
+void TcpServer::fire_drain_event(boost::shared_ptr<TcpConnection> connection)
+{
+	fire_drain(create_event(connection, SharedBufferPtr()));
+}
+
+void TcpServer::fire_data_event(SharedBufferPtr data, boost::shared_ptr<TcpConnection> connection)
 {
-	fire_data(boost::make_shared<TcpEvent>(this, connection, data));
+	dispatch_data(create_event(connection, data));
 }
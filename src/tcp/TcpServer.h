@@ -9,6 +9,7 @@
 #define	TCPSERVER_H
 
 #include<set>
+#include<vector>
 
 #include "Tcp.h"
 #include "Server.h"
@@ -16,6 +17,7 @@
 
 using boost::asio::ip::tcp;
 using std::set;
+using std::vector;
 
 /**
  * This class represents a TCP server, which inherits basic TCP handling functionality from <code>Tcp</code>, and
@@ -32,8 +34,12 @@ class TcpServer: public Tcp, public Server
 		 *
 		 * 	@param	port		The port on which the server should listen
 		 * 	@param	io_service	The I/O service to use for background I/O requests
+		 * 	@param	buffer_pool	The pool from which buffers for sending and receiving data are leased
+		 * 	@param	loops		The I/O services to spread accepted connections over, or none to serve them all on
+		 * 						<code>io_service</code>
 		 */
-		TcpServer(int port, boost::asio::io_service & io_service);
+		TcpServer(int port, boost::asio::io_service & io_service, BufferPool & buffer_pool,
+				const vector<boost::asio::io_service *> & loops = vector<boost::asio::io_service *>());
 
 		/**
 		 * Builds a TCP server to listen on the specified port, but does not start the server listening on it. Using
@@ -41,9 +47,14 @@ class TcpServer: public Tcp, public Server
 		 *
 		 * 	@param	port		The port on which the server should listen
 		 * 	@param	io_service	The I/O service to use for background I/O requests
+		 * 	@param	buffer_pool	The pool from which buffers for sending and receiving data are leased
          * 	@param  options     A map of options specifying the behavior of the socket
+		 * 	@param	loops		The I/O services to spread accepted connections over, or none to serve them all on
+		 * 						<code>io_service</code>. With the 'shards' option, shard <i>i</i> accepts and serves
+		 * 						its connections on loop <i>i</i>, modulo the number of loops.
 		 */
-		TcpServer(int port, boost::asio::io_service & io_service, map<string, string> options);
+		TcpServer(int port, boost::asio::io_service & io_service, BufferPool & buffer_pool, map<string, string> options,
+				const vector<boost::asio::io_service *> & loops = vector<boost::asio::io_service *>());
 
 		/**
 		 * Deconstructs this TCP server, by immediately ceasing to accept incoming connections, shutdown all necessary
@@ -69,6 +80,12 @@ class TcpServer: public Tcp, public Server
 		 */
 		virtual int get_port();
 
+		/**
+		 * Returns the number of open connections accepted by each of this server's acceptors. Servers that were not
+		 * 	created with the 'shards' option have a single acceptor. This function is exposed to the javascript API.
+		 */
+		FB::VariantList get_shard_connections();
+
 		/**
 		 * The javascript event fired on a disconnect-type network error. This is fired on the following <code>boost</code> errors:
 		 * 	<ul>
@@ -85,6 +102,15 @@ class TcpServer: public Tcp, public Server
 		 */
 		FB_JSAPI_EVENT(connect, 0, ());
 
+		/**
+		 * The javascript event fired once the data buffered on a connection falls below the low watermark, after a
+		 * 	'send' on that connection has returned false because it was above the high watermark. This event sends
+		 * 	with it a <code>TcpEvent</code> without data, on which to resume sending.
+		 *
+		 * 	@see TcpEvent
+		 */
+		FB_JSAPI_EVENT(drain, 1, (FB::JSAPIPtr));
+
 	protected:
 
 
@@ -93,7 +119,7 @@ class TcpServer: public Tcp, public Server
 		 *
 		 */
         void receive_handler(const boost::system::error_code & error_code, std::size_t bytesTransferred,
-                boost::shared_ptr<tcp::socket> connection, string host, int port);
+                boost::shared_ptr<TcpConnection> connection, string host, int port);
 
 		/**
 		 * Helper to fire an error event to javascript.
@@ -109,13 +135,20 @@ class TcpServer: public Tcp, public Server
 		 */
 		virtual void fire_disconnect_event(const string & message);
 
+		/**
+		 * Helper to fire a drain event to javascript.
+		 *
+		 * 	@param	connection	The connection whose write queue has drained
+		 */
+		virtual void fire_drain_event(boost::shared_ptr<TcpConnection> connection);
+
 		/**
 		 * Helper to fire data event to javascript.
 		 *
-		 * 	@param	data	The data received
+		 * 	@param	data	The buffer holding the data received, which the event shares
 		 * 	@param	connection	The connection on which to reply to the data
 		 */
-		virtual void fire_data_event(const string data, boost::shared_ptr<tcp::socket> connection);
+		virtual void fire_data_event(SharedBufferPtr data, boost::shared_ptr<TcpConnection> connection);
 
 		/**
 		 * Closes down this TCP server immediately, by immediately ceasing to accept incoming connections, shutdown all
@@ -126,10 +159,49 @@ class TcpServer: public Tcp, public Server
 	private:
 
 		/**
-		 * Helper function to initialize the acceptor. If this was not successfully initialized, <code>fail</code> is true.
+		 * The state owned by a single acceptor. Each shard accepts its connections on its own strand, on the event
+		 * 	loop it is pinned to, after which they are served on their own strands on that same loop.
+		 */
+		struct Shard
+		{
+			Shard(boost::asio::io_service & io_service) :
+				loop(io_service), acceptor(io_service), strand(io_service), connection_count(0)
+			{
+			}
+
+			/** The event loop this shard's acceptor and connections run on */
+			boost::asio::io_service & loop;
+
+			/** The acceptor for incoming connections for this shard */
+			tcp::acceptor acceptor;
+
+			/** The strand on which this shard's accepts are handled */
+			boost::asio::io_service::strand strand;
+
+			/** The number of open connections accepted by this shard */
+			int connection_count;
+		};
+
+		/**
+		 * Helper function to initialize the acceptors. If these were not successfully initialized, <code>fail</code> is true.
 		 */
 		void init();
 
+		/**
+		 * Helper function to open, configure and bind the acceptor for a shard.
+		 *
+		 * 	@param	shard		The shard whose acceptor to open
+		 * 	@param	reuse_port	Whether to allow other acceptors to bind the same port using SO_REUSEPORT
+		 */
+		void open_acceptor(boost::shared_ptr<Shard> shard, bool reuse_port);
+
+		/**
+		 * Helper function to asynchronously accept the next incoming connection on a shard.
+		 *
+		 * 	@param	shard_index	The index of the shard on which to accept
+		 */
+		void accept(int shard_index);
+
         /**
          * Initialize the properties of this socket
          */
@@ -151,15 +223,35 @@ class TcpServer: public Tcp, public Server
 		 * 	@param	host		The host from which this accept was attempted
 		 * 	@param	port		The port from which this accept was attempted
 		 */
-		void accept_handler(const boost::system::error_code & error_code, boost::shared_ptr<tcp::socket> connection, string host, int port);
+		void accept_handler(const boost::system::error_code & error_code, boost::shared_ptr<TcpConnection> connection,
+				string host, int port);
+
+		/**
+		 * The largest number of shards a server may open, beyond which more acceptors only cost file descriptors
+		 */
+		static const int MAX_SHARDS = 64;
 
 		/**
-		 * The acceptor for incoming connections for this server
+		 * The event loops accepted connections are spread over, which hold at least this server's own I/O service
 		 */
-        boost::shared_ptr<tcp::acceptor> acceptor;
-        
+		vector<boost::asio::io_service *> loops;
+
+		/**
+		 * The index of the loop the next connection accepted without sharding is served on. Only used on the strand
+		 * 	of the single acceptor.
+		 */
+		size_t next_loop_index;
+
+		/**
+		 * The shards accepting incoming connections for this server, one per acceptor
+		 */
+        vector<boost::shared_ptr<Shard> > acceptor_shards;
+
         /** A set of established connections. */
-        set<boost::shared_ptr<tcp::socket> > connections;
+        set<boost::shared_ptr<TcpConnection> > connections;
+
+        /** A mutex around the established connections, which are accessed from every shard's strand. */
+        boost::mutex connections_mutex;
 };
 
 #endif	/* TCPSERVER_H */
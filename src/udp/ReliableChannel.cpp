@@ -0,0 +1,410 @@
+/*
+ * ReliableChannel.cpp
+ *
+ *  Created on: Oct 17, 2026
+ */
+
+#include "ReliableChannel.h"
+#include "Udp.h"
+#include "ByteOrder.h"
+
+#include <boost/detail/atomic_count.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <string.h>
+
+using ByteOrder::put16;
+using ByteOrder::put32;
+using ByteOrder::get16;
+using ByteOrder::get32;
+
+namespace
+{
+	/** The datagram types, carried in the first byte of every datagram */
+	const unsigned char DATA = 1;
+	const unsigned char ACK = 2;
+
+	/** The size of the header of an acknowledgement, before its ranges */
+	const size_t ACK_HEADER_SIZE = 12;
+
+	/** Counts channels created, to keep the identifiers of channels created at the same time distinct */
+	boost::detail::atomic_count channels_created(0);
+
+	uint32_t new_channel_id(void * channel)
+	{
+		boost::posix_time::ptime now = boost::posix_time::microsec_clock::universal_time();
+		uint32_t ticks = (uint32_t) (now - boost::posix_time::ptime(boost::gregorian::date(1970, 1, 1))).total_microseconds();
+
+		return ticks ^ (uint32_t) (size_t) channel ^ ((uint32_t) ++channels_created << 20);
+	}
+}
+
+ReliableChannel::ReliableChannel(Udp & udp_object, boost::shared_ptr<udp::socket> socket,
+		boost::shared_ptr<udp::endpoint> endpoint) :
+	udp_object(udp_object), socket(socket), endpoint(endpoint), channel_id(new_channel_id(this)), next_sequence(0),
+			congestion_window(INITIAL_WINDOW), slow_start_threshold(MAX_WINDOW), recovery_sequence(0), smoothed_rtt(0),
+			rtt_variation(0), retransmission_timeout(INITIAL_RTO), rtt_sampled(false), peer_known(false),
+			peer_channel_id(0), expected_sequence(0), ack_pending(false),
+			last_activity(boost::posix_time::microsec_clock::universal_time()), timer(udp_object.io_service)
+{
+}
+
+void ReliableChannel::start()
+{
+	arm_timer();
+}
+
+void ReliableChannel::send(SharedBufferPtr packet)
+{
+	send_queue.push_back(packet);
+	fill_window();
+}
+
+void ReliableChannel::fill_window()
+{
+	bool was_idle = outstanding.empty();
+
+	while (!send_queue.empty() && outstanding.size() < (size_t) congestion_window)
+	{
+		Outstanding message;
+		message.packet = send_queue.front();
+		message.transmissions = 0;
+		send_queue.pop_front();
+
+		transmit(outstanding.insert(std::make_pair(next_sequence++, message)).first);
+	}
+
+	// Time the first message sent since the channel was last idle
+	if (was_idle && !outstanding.empty())
+		arm_timer();
+}
+
+void ReliableChannel::transmit(OutstandingMap::iterator it)
+{
+	Outstanding & message = it->second;
+
+	// A message being resent may still be held by its last send, so is resent from a copy with the new header
+	if (message.transmissions > 0)
+		message.packet = SharedBuffer::copy(udp_object.buffer_pool, message.packet->data(), message.packet->size());
+
+	char * header = message.packet->data();
+	header[0] = DATA;
+	header[1] = 0;
+	put16(header + 2, 0);
+	put32(header + 4, channel_id);
+	put32(header + 8, (uint32_t) it->first);
+	put32(header + 12, (uint32_t) outstanding.begin()->first);
+
+	message.sent_at = boost::posix_time::microsec_clock::universal_time();
+	message.transmissions++;
+	last_activity = message.sent_at;
+
+	udp_object.send_buffer(socket, *endpoint, message.packet);
+}
+
+void ReliableChannel::receive(SharedBufferPtr datagram)
+{
+	last_activity = boost::posix_time::microsec_clock::universal_time();
+
+	if (datagram->size() >= DATA_HEADER_SIZE && datagram->data()[0] == DATA)
+	{
+		receive_data(datagram);
+	}
+	else if (datagram->size() >= ACK_HEADER_SIZE && datagram->data()[0] == ACK)
+	{
+		receive_ack(datagram);
+	}
+	else
+	{
+		Logger::warn("Dropping a datagram that is not part of a reliable UDP channel", endpoint->port(),
+				endpoint->address().to_string());
+	}
+}
+
+void ReliableChannel::receive_data(SharedBufferPtr datagram)
+{
+	const char * header = datagram->data();
+	uint32_t id = get32(header + 4);
+
+	// A message delayed from an end of the channel the peer has since replaced must not restart it again
+	if (peer_known && id != peer_channel_id
+			&& std::find(retired_peer_ids.begin(), retired_peer_ids.end(), id) != retired_peer_ids.end())
+		return;
+
+	// A new or restarted peer starts from the oldest message it still has outstanding
+	if (!peer_known || id != peer_channel_id)
+	{
+		if (peer_known)
+		{
+			retired_peer_ids.push_back(peer_channel_id);
+			if (retired_peer_ids.size() > (size_t) RETIRED_PEER_IDS)
+				retired_peer_ids.pop_front();
+		}
+
+		peer_known = true;
+		peer_channel_id = id;
+		expected_sequence = get32(header + 12);
+		reordered.clear();
+	}
+
+	uint64_t sequence = unwrap(get32(header + 8), expected_sequence);
+
+	// Acknowledge everything, including duplicates, whose acknowledgement may have been lost
+	schedule_ack();
+
+	if (sequence < expected_sequence || sequence >= expected_sequence + MAX_WINDOW || reordered.count(sequence))
+		return;
+
+	if (sequence != expected_sequence)
+	{
+		reordered[sequence] = datagram;
+		return;
+	}
+
+	// Fire this message, and any held back waiting for it
+	deliver(datagram);
+	expected_sequence++;
+
+	map<uint64_t, SharedBufferPtr>::iterator it;
+	while (!reordered.empty() && (it = reordered.begin())->first == expected_sequence)
+	{
+		deliver(it->second);
+		reordered.erase(it);
+		expected_sequence++;
+	}
+}
+
+void ReliableChannel::deliver(SharedBufferPtr datagram)
+{
+	udp_object.deliver_message(datagram, DATA_HEADER_SIZE, socket, endpoint);
+}
+
+void ReliableChannel::receive_ack(SharedBufferPtr datagram)
+{
+	const char * header = datagram->data();
+	size_t ranges = get16(header + 2);
+
+	// Ignore acknowledgements for an earlier incarnation of this channel
+	if (get32(header + 4) != channel_id)
+		return;
+
+	ranges = std::min(ranges, (datagram->size() - ACK_HEADER_SIZE) / 8);
+
+	uint64_t cumulative = unwrap(get32(header + 8), next_sequence);
+	uint64_t highest_acknowledged = cumulative;
+	bool progress = false;
+
+	// Release everything before the first gap
+	while (!outstanding.empty() && outstanding.begin()->first < cumulative)
+	{
+		acknowledge(outstanding.begin());
+		progress = true;
+	}
+
+	// Release everything the peer has received beyond it
+	for (size_t i = 0; i < ranges; i++)
+	{
+		const char * range = header + ACK_HEADER_SIZE + i * 8;
+		uint64_t start = unwrap(get32(range), cumulative);
+		uint64_t end = unwrap(get32(range + 4), cumulative);
+
+		OutstandingMap::iterator it = outstanding.lower_bound(start);
+		while (it != outstanding.end() && it->first < end)
+		{
+			acknowledge(it++);
+			progress = true;
+		}
+
+		highest_acknowledged = std::max(highest_acknowledged, end);
+	}
+
+	// Resend messages that enough later messages have overtaken, once per round trip
+	boost::posix_time::ptime now = boost::posix_time::microsec_clock::universal_time();
+	for (OutstandingMap::iterator it = outstanding.begin(); it != outstanding.end()
+			&& it->first + REORDER_THRESHOLD < highest_acknowledged; it++)
+	{
+		if (it->second.transmissions > 1 && (now - it->second.sent_at).total_microseconds() < smoothed_rtt)
+			continue;
+
+		// Halve the window once for all the losses in a single window of messages
+		if (it->first >= recovery_sequence)
+		{
+			slow_start_threshold = std::max(congestion_window / 2, 2.0);
+			congestion_window = slow_start_threshold;
+			recovery_sequence = next_sequence;
+		}
+
+		transmit(it);
+	}
+
+	if (progress)
+	{
+		arm_timer();
+		fill_window();
+	}
+}
+
+void ReliableChannel::acknowledge(OutstandingMap::iterator it)
+{
+	// Only sample the round trip time from messages sent once, whose acknowledgement is unambiguous
+	if (it->second.transmissions == 1)
+	{
+		double rtt = (boost::posix_time::microsec_clock::universal_time() - it->second.sent_at).total_microseconds();
+
+		if (!rtt_sampled)
+		{
+			smoothed_rtt = rtt;
+			rtt_variation = rtt / 2;
+			rtt_sampled = true;
+		}
+		else
+		{
+			rtt_variation = 0.75 * rtt_variation + 0.25 * std::abs(smoothed_rtt - rtt);
+			smoothed_rtt = 0.875 * smoothed_rtt + 0.125 * rtt;
+		}
+
+		retransmission_timeout = std::min(std::max(smoothed_rtt + 4 * rtt_variation, (double) MIN_RTO), (double) MAX_RTO);
+	}
+
+	// Grow exponentially until the first loss, and linearly after it
+	if (congestion_window < slow_start_threshold)
+		congestion_window += 1;
+	else
+		congestion_window += 1 / congestion_window;
+	congestion_window = std::min(congestion_window, (double) MAX_WINDOW);
+
+	outstanding.erase(it);
+	udp_object.complete_sends(1);
+}
+
+void ReliableChannel::schedule_ack()
+{
+	if (ack_pending)
+		return;
+
+	ack_pending = true;
+	udp_object.strand.post(boost::bind(&ReliableChannel::send_ack, shared_from_this()));
+}
+
+void ReliableChannel::send_ack()
+{
+	ack_pending = false;
+
+	// Report the ranges received beyond the first gap, oldest first
+	vector<std::pair<uint64_t, uint64_t> > ranges;
+	for (map<uint64_t, SharedBufferPtr>::iterator it = reordered.begin(); it != reordered.end()
+			&& ranges.size() < (size_t) MAX_ACK_RANGES; it++)
+	{
+		if (!ranges.empty() && ranges.back().second == it->first)
+			ranges.back().second++;
+		else
+			ranges.push_back(std::make_pair(it->first, it->first + 1));
+	}
+
+	SharedBufferPtr ack = SharedBuffer::create(udp_object.buffer_pool, ACK_HEADER_SIZE + ranges.size() * 8);
+	char * header = ack->data();
+	header[0] = ACK;
+	header[1] = 0;
+	put16(header + 2, (uint16_t) ranges.size());
+	put32(header + 4, peer_channel_id);
+	put32(header + 8, (uint32_t) expected_sequence);
+
+	for (size_t i = 0; i < ranges.size(); i++)
+	{
+		put32(header + ACK_HEADER_SIZE + i * 8, (uint32_t) ranges[i].first);
+		put32(header + ACK_HEADER_SIZE + i * 8 + 4, (uint32_t) ranges[i].second);
+	}
+	ack->set_size(ACK_HEADER_SIZE + ranges.size() * 8);
+
+	udp_object.send_buffer(socket, *endpoint, ack);
+}
+
+void ReliableChannel::arm_timer()
+{
+	if (outstanding.empty())
+		timer.expires_from_now(boost::posix_time::seconds(IDLE_TIMEOUT));
+	else
+		timer.expires_from_now(boost::posix_time::microseconds((long) retransmission_timeout));
+
+	timer.async_wait(udp_object.strand.wrap(boost::bind(&ReliableChannel::timer_handler, shared_from_this(), _1)));
+}
+
+void ReliableChannel::timer_handler(const boost::system::error_code & error_code)
+{
+	// The timer was restarted or stopped, or was restarted after this expiry was already queued
+	if (error_code == boost::asio::error::operation_aborted)
+		return;
+	if (timer.expires_at() > boost::posix_time::microsec_clock::universal_time())
+		return;
+
+	if (outstanding.empty())
+	{
+		// Forget the channel once nothing has been sent or received on it for a while
+		boost::posix_time::ptime now = boost::posix_time::microsec_clock::universal_time();
+		if (send_queue.empty() && reordered.empty() && now - last_activity >= boost::posix_time::seconds(IDLE_TIMEOUT))
+			udp_object.remove_channel(*endpoint);
+		else
+			arm_timer();
+		return;
+	}
+
+	OutstandingMap::iterator oldest = outstanding.begin();
+
+	if (oldest->second.transmissions >= MAX_TRANSMISSIONS)
+	{
+		fail();
+		return;
+	}
+
+	// Collapse the window after a timeout, and back off the timeout until a message gets through
+	slow_start_threshold = std::max(outstanding.size() / 2.0, 2.0);
+	congestion_window = 1;
+	recovery_sequence = next_sequence;
+	retransmission_timeout = std::min(retransmission_timeout * 2, (double) MAX_RTO);
+
+	transmit(oldest);
+	arm_timer();
+}
+
+void ReliableChannel::fail()
+{
+	int attempts = MAX_TRANSMISSIONS;
+	int dropped = outstanding.size() + send_queue.size();
+
+	string message("Reliable UDP channel gave up after " + boost::lexical_cast<string>(attempts)
+			+ " attempts to send a message, dropping " + boost::lexical_cast<string>(dropped) + " unacknowledged messages");
+	Logger::error(message, endpoint->port(), endpoint->address().to_string());
+	udp_object.fire_error_event(message);
+	outstanding.clear();
+	send_queue.clear();
+
+	// Start afresh under a new identifier, so the peer does not wait for the messages dropped
+	channel_id = new_channel_id(this);
+	next_sequence = 0;
+	recovery_sequence = 0;
+	congestion_window = INITIAL_WINDOW;
+	slow_start_threshold = MAX_WINDOW;
+	retransmission_timeout = INITIAL_RTO;
+	rtt_sampled = false;
+
+	arm_timer();
+	udp_object.complete_sends(dropped);
+}
+
+bool ReliableChannel::opens_channel(SharedBufferPtr datagram)
+{
+	return datagram->size() >= DATA_HEADER_SIZE && datagram->data()[0] == DATA;
+}
+
+void ReliableChannel::close()
+{
+	boost::system::error_code error_code;
+	timer.cancel(error_code);
+}
+
+uint64_t ReliableChannel::unwrap(uint32_t sequence, uint64_t reference)
+{
+	boost::int64_t unwrapped = (boost::int64_t) reference + (boost::int32_t) (sequence - (uint32_t) reference);
+	return unwrapped < 0 ? 0 : (uint64_t) unwrapped;
+}
@@ -0,0 +1,279 @@
+/*
+ * ReliableChannel.h
+ *
+ *  Created on: Oct 17, 2026
+ */
+
+#ifndef RELIABLECHANNEL_H_
+#define RELIABLECHANNEL_H_
+
+#include <boost/asio.hpp>
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/cstdint.hpp>
+
+#include <deque>
+#include <map>
+
+class Udp;
+
+#include "SharedBuffer.h"
+
+using boost::asio::ip::udp;
+using boost::uint16_t;
+using boost::uint32_t;
+using boost::uint64_t;
+using std::deque;
+using std::map;
+
+/**
+ * The reliable, ordered stream of messages between a UDP object and one peer, used when the 'reliable' option is set.
+ * 	Each message is sent as a single datagram carrying a sequence number, and is retransmitted until the peer
+ * 	acknowledges it, either cumulatively or selectively. Messages received from the peer are deduplicated, held until
+ * 	any gap before them is filled, and then fired as data events in order. The number of unacknowledged messages is
+ * 	bounded by a congestion window, which grows as messages are acknowledged and shrinks when they are lost.
+ *
+ * 	Every datagram starts with a header identifying this channel, so that a peer which restarts its end of the channel
+ * 	is recognised, and a peer which forgot its end of an idle channel can pick it back up. All of a channel's work is
+ * 	done on its UDP object's strand.
+ */
+class ReliableChannel : public boost::enable_shared_from_this<ReliableChannel>
+{
+	public:
+
+		/**
+		 * Builds an idle channel to a peer.
+		 *
+		 * 	@param	udp_object	The UDP object this channel belongs to
+		 * 	@param	socket		The socket on which the UDP object sends to and receives from the peer
+		 * 	@param	endpoint	The peer's endpoint, which is also handed to the data events fired for its messages
+		 */
+		ReliableChannel(Udp & udp_object, boost::shared_ptr<udp::socket> socket, boost::shared_ptr<udp::endpoint> endpoint);
+
+		/**
+		 * Starts the channel's timer, so that it is forgotten if it stays idle. Must be called once the channel is
+		 * 	held by a shared pointer.
+		 */
+		void start();
+
+		/**
+		 * Sends a message to the peer, as soon as the congestion window allows.
+		 *
+		 * 	@param	packet	A buffer holding the message after <code>DATA_HEADER_SIZE</code> bytes left for the header
+		 */
+		void send(SharedBufferPtr packet);
+
+		/**
+		 * Handles a datagram received from the peer, firing data events for any messages it puts in order.
+		 *
+		 * 	@param	datagram	The datagram received
+		 */
+		void receive(SharedBufferPtr datagram);
+
+		/**
+		 * Stops this channel's timer. The channel must not be used afterwards.
+		 */
+		void close();
+
+		/**
+		 * Checks whether a datagram from a peer without a channel should open one, which only a well-formed message
+		 * 	datagram does.
+		 *
+		 * 	@param	datagram	The datagram received
+		 * 	@return	True if the datagram is a message
+		 */
+		static bool opens_channel(SharedBufferPtr datagram);
+
+		/** The size of the header at the front of every message datagram */
+		static const size_t DATA_HEADER_SIZE = 16;
+
+	private:
+
+		/**
+		 * A message that has been sent, but not yet acknowledged
+		 */
+		struct Outstanding
+		{
+			/** The datagram holding the message, with its header */
+			SharedBufferPtr packet;
+
+			/** The time at which the message was last sent */
+			boost::posix_time::ptime sent_at;
+
+			/** The number of times the message has been sent */
+			int transmissions;
+		};
+
+		typedef map<uint64_t, Outstanding> OutstandingMap;
+
+		/**
+		 * Sends queued messages until the congestion window is full.
+		 */
+		void fill_window();
+
+		/**
+		 * Sends, or resends, an outstanding message, with a header naming the oldest message still outstanding.
+		 *
+		 * 	@param	it	The outstanding message to send
+		 */
+		void transmit(OutstandingMap::iterator it);
+
+		/**
+		 * Handles a message datagram from the peer.
+		 */
+		void receive_data(SharedBufferPtr datagram);
+
+		/**
+		 * Handles an acknowledgement from the peer, releasing the messages it acknowledges and resending those it
+		 * 	shows were lost.
+		 */
+		void receive_ack(SharedBufferPtr datagram);
+
+		/**
+		 * Releases an acknowledged message, sampling the round trip time from it if it was only sent once, and growing
+		 * 	the congestion window.
+		 *
+		 * 	@param	it	The acknowledged message
+		 */
+		void acknowledge(OutstandingMap::iterator it);
+
+		/**
+		 * Fires a data event for a message received in order.
+		 */
+		void deliver(SharedBufferPtr datagram);
+
+		/**
+		 * Arranges for an acknowledgement to be sent at the end of the current turn of the event loop, so that all the
+		 * 	messages received in one turn are acknowledged together.
+		 */
+		void schedule_ack();
+
+		/**
+		 * Sends an acknowledgement of everything received so far.
+		 */
+		void send_ack();
+
+		/**
+		 * Starts the timer, for the retransmission timeout if any messages are outstanding, or otherwise for the idle
+		 * 	timeout after which the channel is forgotten.
+		 */
+		void arm_timer();
+
+		/**
+		 * Handler invoked when the timer expires, which resends the oldest outstanding message if it has timed out, or
+		 * 	forgets the channel if it has stayed idle.
+		 */
+		void timer_handler(const boost::system::error_code & error_code);
+
+		/**
+		 * Gives up on the outstanding and queued messages after the peer has stopped acknowledging them, reporting an
+		 * 	error and starting the channel afresh.
+		 */
+		void fail();
+
+		/**
+		 * Recovers a full sequence number from the lower 32 bits sent on the wire, as the one nearest a known sequence
+		 * 	number.
+		 */
+		static uint64_t unwrap(uint32_t sequence, uint64_t reference);
+
+		/** The UDP object this channel belongs to */
+		Udp & udp_object;
+
+		/** The socket on which to send to the peer */
+		boost::shared_ptr<udp::socket> socket;
+
+		/** The peer's endpoint */
+		boost::shared_ptr<udp::endpoint> endpoint;
+
+		/** The identifier of this end of the channel, carried by every message sent */
+		uint32_t channel_id;
+
+		/** The sequence number of the next message sent */
+		uint64_t next_sequence;
+
+		/** The messages waiting for room in the congestion window */
+		deque<SharedBufferPtr> send_queue;
+
+		/** The messages sent but not yet acknowledged, by sequence number */
+		OutstandingMap outstanding;
+
+		/** The congestion window, in messages */
+		double congestion_window;
+
+		/** The window size above which the congestion window grows linearly rather than exponentially */
+		double slow_start_threshold;
+
+		/** The sequence number sent last when a loss was last detected. Further losses before it is acknowledged
+		 belong to the same congestion event. */
+		uint64_t recovery_sequence;
+
+		/** The smoothed round trip time, in microseconds */
+		double smoothed_rtt;
+
+		/** The round trip time variation, in microseconds */
+		double rtt_variation;
+
+		/** The retransmission timeout, in microseconds */
+		double retransmission_timeout;
+
+		/** Whether the round trip time has been sampled yet */
+		bool rtt_sampled;
+
+		/** Whether a message has been received from the peer, so its end of the channel is known */
+		bool peer_known;
+
+		/** The identifier of the peer's end of the channel */
+		uint32_t peer_channel_id;
+
+		/** The identifiers of the peer's earlier ends of the channel, most recent last, whose delayed messages are
+		 dropped rather than taken for a restart */
+		deque<uint32_t> retired_peer_ids;
+
+		/** The sequence number of the next message to fire from the peer */
+		uint64_t expected_sequence;
+
+		/** Messages received from the peer ahead of a gap, by sequence number */
+		map<uint64_t, SharedBufferPtr> reordered;
+
+		/** Whether an acknowledgement has been scheduled */
+		bool ack_pending;
+
+		/** The time of the last datagram sent or received */
+		boost::posix_time::ptime last_activity;
+
+		/** The retransmission and idle timer */
+		boost::asio::deadline_timer timer;
+
+		/** The initial retransmission timeout, in microseconds */
+		static const int INITIAL_RTO = 200000;
+
+		/** The smallest retransmission timeout, in microseconds */
+		static const int MIN_RTO = 20000;
+
+		/** The largest retransmission timeout, in microseconds */
+		static const int MAX_RTO = 2000000;
+
+		/** The initial congestion window, in messages */
+		static const int INITIAL_WINDOW = 10;
+
+		/** The largest congestion window, and the furthest ahead of a gap messages are held, in messages */
+		static const int MAX_WINDOW = 1024;
+
+		/** The number of later messages acknowledged before a message is considered lost */
+		static const int REORDER_THRESHOLD = 3;
+
+		/** The number of times a message is sent before giving up on the peer */
+		static const int MAX_TRANSMISSIONS = 10;
+
+		/** The number of received ranges reported in a single acknowledgement */
+		static const int MAX_ACK_RANGES = 32;
+
+		/** The number of the peer's earlier channel identifiers remembered */
+		static const int RETIRED_PEER_IDS = 16;
+
+		/** The number of seconds after which an idle channel is forgotten */
+		static const int IDLE_TIMEOUT = 60;
+};
+
+#endif /* RELIABLECHANNEL_H_ */
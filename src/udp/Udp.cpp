@@ -6,14 +6,499 @@
  */
 
 #include "Udp.h"
+#include "ByteOrder.h"
 
-Udp::Udp(string host, int port, boost::asio::io_service & io_service) :
-	host(host), port(port), pending_sends(0), should_close(false), io_service(io_service), failed(false)
+#include <string.h>
+
+namespace
+{
+	/** The first byte of every fragment, marking it as one */
+	const unsigned char FRAGMENT = 3;
+}
+
+Udp::Udp(string host, int port, boost::asio::io_service & io_service, BufferPool & buffer_pool) :
+	io_service(io_service), strand(io_service), buffer_pool(buffer_pool),
+			receive_size(BUFFER_SIZE), min_receive_size(BUFFER_SIZE), max_receive_size(MAX_BUFFER_SIZE), quiet_receives(0),
+			received_datagrams(0), truncated_datagrams(0), kernel_drops(0), incomplete_messages(0), pending_sends(0), should_close(false),
+			fragment_size(0), message_ids(0), reassembly_bytes(0), reassembly_timer(io_service), reassembly_timer_armed(false),
+			timestamp_mode(ReceiveTime::NONE), send_segment_size(0), send_batch_size(0), send_batch_delay(0), sending_offset(0), flush_pending(false),
+			send_timer_armed(false), host(host), port(port), connected(false), failed(false)
 {
 	remote_endpoint = boost::shared_ptr<udp::endpoint>(new udp::endpoint());
 }
 
-void Udp::send_handler(const boost::system::error_code &error_code, size_t bytes_transferred, string data, string host, int port)
+Udp::~Udp()
+{
+	// Stop the channels' timers and the reassembly timer, whose handlers must not outlive this object
+	map<udp::endpoint, boost::shared_ptr<ReliableChannel> >::iterator it;
+	for (it = channels.begin(); it != channels.end(); it++)
+		it->second->close();
+
+	boost::system::error_code error_code;
+	reassembly_timer.cancel(error_code);
+}
+
+void Udp::send_to(boost::shared_ptr<udp::socket> socket, const udp::endpoint & endpoint, const string & data)
+{
+	if (fragment_size > 0)
+	{
+		send_fragments(socket, endpoint, data);
+		return;
+	}
+
+	if (reliable && *reliable)
+	{
+		size_t max_size = MAX_RELIABLE_MESSAGE_SIZE;
+		if (data.size() > max_size)
+		{
+			string message("UDP send failed, a reliable message may be at most "
+					+ boost::lexical_cast<string>(max_size) + " bytes");
+			Logger::error(message, port, host);
+			fire_error_event(message);
+			return;
+		}
+
+		send_packet(socket, endpoint, create_packet(0, data.data(), data.size()));
+		return;
+	}
+
+	if (send_segment_size > 0 && data.size() > send_segment_size)
+	{
+		// Split the data into as few segmented sends as the kernel accepts, each of which it splits into datagrams
+		size_t segments = MAX_SEGMENTED_SIZE / send_segment_size;
+		int max_segments = MAX_SEGMENTS;
+		segments = std::max((size_t) 1, std::min(segments, (size_t) max_segments));
+
+		size_t chunk_size = segments * send_segment_size;
+
+		for (size_t offset = 0; offset < data.size(); offset += chunk_size)
+		{
+			size_t size = std::min(chunk_size, data.size() - offset);
+			send_buffer(socket, endpoint, SharedBuffer::copy(buffer_pool, data.data() + offset, size));
+		}
+		return;
+	}
+
+	// Copy the data into a pooled buffer, which is held until the send completes
+	send_buffer(socket, endpoint, SharedBuffer::copy(buffer_pool, data));
+}
+
+void Udp::send_fragments(boost::shared_ptr<udp::socket> socket, const udp::endpoint & endpoint, const string & data)
+{
+	// Each fragment, with its own header and the reliable channel's, must fit in a datagram of the fragment size
+	size_t payload_size = fragment_size - FRAGMENT_HEADER_SIZE - reliable_header_size();
+	size_t count = std::max((size_t) 1, (data.size() + payload_size - 1) / payload_size);
+	size_t max_fragments = MAX_FRAGMENTS;
+
+	if (count > max_fragments)
+	{
+		string message("UDP send failed, a message may be split into at most " + boost::lexical_cast<string>(max_fragments)
+				+ " fragments of " + boost::lexical_cast<string>(payload_size) + " bytes");
+		Logger::error(message, port, host);
+		fire_error_event(message);
+		return;
+	}
+
+	boost::uint32_t message_id = ++message_ids;
+
+	for (size_t index = 0; index < count; index++)
+	{
+		size_t offset = index * payload_size;
+		size_t size = std::min(payload_size, data.size() - offset);
+
+		SharedBufferPtr packet = create_packet(FRAGMENT_HEADER_SIZE, data.data() + offset, size);
+
+		char * header = packet->data() + reliable_header_size();
+		header[0] = FRAGMENT;
+		header[1] = 0;
+		ByteOrder::put16(header + 2, (boost::uint16_t) count);
+		ByteOrder::put32(header + 4, message_id);
+		ByteOrder::put16(header + 8, (boost::uint16_t) index);
+		ByteOrder::put16(header + 10, 0);
+
+		send_packet(socket, endpoint, packet);
+	}
+}
+
+size_t Udp::reliable_header_size()
+{
+	if (reliable && *reliable)
+		return ReliableChannel::DATA_HEADER_SIZE;
+	return 0;
+}
+
+SharedBufferPtr Udp::create_packet(size_t header_size, const char * data, size_t size)
+{
+	size_t offset = reliable_header_size() + header_size;
+
+	SharedBufferPtr packet = SharedBuffer::create(buffer_pool, offset + size);
+	memcpy(packet->data() + offset, data, size);
+	packet->set_size(offset + size);
+
+	return packet;
+}
+
+void Udp::send_packet(boost::shared_ptr<udp::socket> socket, const udp::endpoint & endpoint, SharedBufferPtr packet)
+{
+	if (reliable && *reliable)
+	{
+		// The message is pending until the peer acknowledges it
+		pending_sends_mutex.lock();
+		pending_sends++;
+		pending_sends_mutex.unlock();
+
+		strand.dispatch(boost::bind(&Udp::send_reliable, this, socket, endpoint, packet));
+		return;
+	}
+
+	send_buffer(socket, endpoint, packet);
+}
+
+void Udp::send_buffer(boost::shared_ptr<udp::socket> socket, const udp::endpoint & endpoint, SharedBufferPtr buffer)
+{
+	pending_sends_mutex.lock();
+	pending_sends++;
+	pending_sends_mutex.unlock();
+
+	if (send_batch_size > 0)
+	{
+		QueuedSend queued;
+		queued.data = buffer;
+		queued.endpoint = endpoint;
+
+		boost::mutex::scoped_lock lock(send_queue_mutex);
+
+		send_socket = socket;
+		send_queue.push_back(queued);
+
+		// A flush already under way sends everything queued behind it
+		if (flush_pending)
+			return;
+
+		if (send_queue.size() >= send_batch_size || send_batch_delay == 0)
+		{
+			// Send a full batch now, or without a delay, whatever was queued during this turn of the event loop
+			flush_pending = true;
+			if (send_timer_armed)
+			{
+				// The flush takes this batch with it, so the next partial batch needs a timer of its own
+				send_timer_armed = false;
+				send_timer->cancel();
+			}
+			strand.post(boost::bind(&Udp::flush_sends, this));
+		}
+		else if (!send_timer_armed)
+		{
+			// This is the first datagram of a new batch, bound how long it may wait
+			send_timer_armed = true;
+			send_timer->expires_from_now(boost::posix_time::microseconds(send_batch_delay));
+			send_timer->async_wait(strand.wrap(boost::bind(&Udp::send_timer_handler, this, _1)));
+		}
+		return;
+	}
+
+	// A connected socket sends to its remote endpoint without the kernel looking up the address and route each time
+	if (sends_connected(endpoint))
+		socket->async_send(boost::asio::buffer(buffer->data(), buffer->size()),
+				strand.wrap(boost::bind(&Udp::send_handler, this, _1, _2, buffer, host, endpoint.port())));
+	else
+		socket->async_send_to(boost::asio::buffer(buffer->data(), buffer->size()), endpoint,
+				strand.wrap(boost::bind(&Udp::send_handler, this, _1, _2, buffer, host, endpoint.port())));
+}
+
+bool Udp::sends_connected(const udp::endpoint & endpoint)
+{
+	boost::mutex::scoped_lock lock(remote_endpoint_mutex);
+	return connected && endpoint == *remote_endpoint;
+}
+
+void Udp::set_remote_endpoint(const udp::endpoint & endpoint, bool is_connected)
+{
+	boost::mutex::scoped_lock lock(remote_endpoint_mutex);
+	remote_endpoint = boost::make_shared<udp::endpoint>(endpoint);
+	connected = is_connected;
+}
+
+void Udp::send_reliable(boost::shared_ptr<udp::socket> socket, udp::endpoint endpoint, SharedBufferPtr packet)
+{
+	boost::shared_ptr<ReliableChannel> channel = get_channel(socket, boost::make_shared<udp::endpoint>(endpoint));
+
+	if (!channel)
+	{
+		string message("Dropping a reliable UDP message, too many peers already have channels open");
+		Logger::error(message, endpoint.port(), endpoint.address().to_string());
+		fire_error_event(message);
+		complete_sends(1);
+		return;
+	}
+
+	channel->send(packet);
+}
+
+void Udp::deliver_datagram(SharedBufferPtr data, boost::shared_ptr<udp::socket> socket,
+		boost::shared_ptr<udp::endpoint> endpoint)
+{
+	if (!(reliable && *reliable))
+	{
+		deliver_message(data, 0, socket, endpoint);
+		return;
+	}
+
+	map<udp::endpoint, boost::shared_ptr<ReliableChannel> >::iterator it = channels.find(*endpoint);
+	if (it != channels.end())
+	{
+		it->second->receive(data);
+		return;
+	}
+
+	// Only a message can open a channel, so stray datagrams from unknown peers leave no state behind
+	if (!ReliableChannel::opens_channel(data))
+	{
+		Logger::warn("Dropping a datagram that does not open a reliable UDP channel", endpoint->port(),
+				endpoint->address().to_string());
+		return;
+	}
+
+	boost::shared_ptr<ReliableChannel> channel = get_channel(socket, endpoint);
+	if (!channel)
+	{
+		Logger::warn("Dropping a datagram from a new peer, too many peers already have reliable UDP channels open",
+				endpoint->port(), endpoint->address().to_string());
+		return;
+	}
+
+	channel->receive(data);
+}
+
+void Udp::deliver_message(SharedBufferPtr data, size_t offset, boost::shared_ptr<udp::socket> socket,
+		boost::shared_ptr<udp::endpoint> endpoint)
+{
+	if (fragment_size > 0)
+	{
+		reassemble(data, offset, socket, endpoint);
+		return;
+	}
+
+	if (offset > 0)
+	{
+		SharedBufferPtr message = SharedBuffer::copy(buffer_pool, data->data() + offset, data->size() - offset);
+		message->set_receive_time(data->get_receive_time());
+		message->set_destination(data->get_destination());
+		data = message;
+	}
+
+	fire_data_event(data, socket, endpoint);
+}
+
+void Udp::reassemble(SharedBufferPtr data, size_t offset, boost::shared_ptr<udp::socket> socket,
+		boost::shared_ptr<udp::endpoint> endpoint)
+{
+	const char * header = data->data() + offset;
+	size_t payload_offset = offset + FRAGMENT_HEADER_SIZE;
+
+	if (data->size() < payload_offset || header[0] != FRAGMENT)
+	{
+		Logger::warn("Dropping a datagram that is not a fragment of a message", endpoint->port(),
+				endpoint->address().to_string());
+		return;
+	}
+
+	size_t count = ByteOrder::get16(header + 2);
+	boost::uint32_t message_id = ByteOrder::get32(header + 4);
+	size_t index = ByteOrder::get16(header + 8);
+	size_t payload_size = data->size() - payload_offset;
+
+	if (index >= count)
+	{
+		Logger::warn("Dropping a malformed fragment", endpoint->port(), endpoint->address().to_string());
+		return;
+	}
+
+	// Every fragment but the last is full, so a message claiming more than the reassembly budget can hold is dropped
+	// before anything is held for it
+	size_t full_fragments = (index == count - 1) ? count - 1 : count;
+	if (full_fragments * payload_size > (size_t) MAX_REASSEMBLY_BYTES)
+	{
+		Logger::warn("Dropping a fragment of a message too large to reassemble", endpoint->port(),
+				endpoint->address().to_string());
+		return;
+	}
+
+	// A message small enough for a single fragment needs no reassembly
+	if (count == 1)
+	{
+		SharedBufferPtr message = SharedBuffer::copy(buffer_pool, data->data() + payload_offset, payload_size);
+		message->set_receive_time(data->get_receive_time());
+		message->set_destination(data->get_destination());
+		fire_data_event(message, socket, endpoint);
+		return;
+	}
+
+	ReassemblyKey key(*endpoint, message_id);
+	ReassemblyMap::iterator it = reassemblies.find(key);
+
+	// A sender that reused a message identifier for a message of a different size has given up on the first
+	if (it != reassemblies.end() && it->second.count != count)
+	{
+		drop_reassembly(it);
+		it = reassemblies.end();
+	}
+
+	if (it == reassemblies.end())
+	{
+		if (reassemblies.size() >= (size_t) MAX_REASSEMBLIES)
+			drop_reassembly(oldest_reassembly());
+
+		Reassembly reassembly;
+		reassembly.count = count;
+		reassembly.bytes = 0;
+		reassembly.started_at = boost::posix_time::microsec_clock::universal_time();
+		it = reassemblies.insert(std::make_pair(key, reassembly)).first;
+
+		// Incomplete messages are given up on even once no more fragments arrive
+		if (!reassembly_timer_armed)
+			arm_reassembly_timer();
+	}
+
+	Reassembly & reassembly = it->second;
+
+	// Ignore duplicates
+	if (reassembly.fragments.count(index))
+		return;
+
+	reassembly.fragments[index] = std::make_pair(data, payload_offset);
+	reassembly.bytes += payload_size;
+	reassembly_bytes += payload_size;
+
+	if (reassembly.fragments.size() < count)
+	{
+		// Bound the memory held by incomplete messages, giving up on the oldest first
+		while (reassembly_bytes > (size_t) MAX_REASSEMBLY_BYTES && reassemblies.size() > 1)
+		{
+			ReassemblyMap::iterator oldest = oldest_reassembly();
+			if (oldest == it)
+				break;
+			drop_reassembly(oldest);
+		}
+		return;
+	}
+
+	// Every fragment has arrived, join them into a single message
+	SharedBufferPtr message = SharedBuffer::create(buffer_pool, reassembly.bytes);
+	size_t position = 0;
+
+	map<size_t, std::pair<SharedBufferPtr, size_t> >::iterator part;
+	for (part = reassembly.fragments.begin(); part != reassembly.fragments.end(); part++)
+	{
+		const SharedBufferPtr & fragment = part->second.first;
+		size_t fragment_offset = part->second.second;
+
+		memcpy(message->data() + position, fragment->data() + fragment_offset, fragment->size() - fragment_offset);
+		position += fragment->size() - fragment_offset;
+	}
+	message->set_size(position);
+
+	// The message was received once its last fragment arrived
+	message->set_receive_time(data->get_receive_time());
+	message->set_destination(data->get_destination());
+
+	reassembly_bytes -= reassembly.bytes;
+	reassemblies.erase(it);
+
+	fire_data_event(message, socket, endpoint);
+}
+
+void Udp::arm_reassembly_timer()
+{
+	reassembly_timer_armed = true;
+	reassembly_timer.expires_from_now(boost::posix_time::seconds(1));
+	reassembly_timer.async_wait(strand.wrap(boost::bind(&Udp::reassembly_timer_handler, this, _1)));
+}
+
+void Udp::reassembly_timer_handler(const boost::system::error_code & error_code)
+{
+	// The timer was stopped along with this object
+	if (error_code == boost::asio::error::operation_aborted)
+		return;
+
+	reassembly_timer_armed = false;
+	expire_reassemblies(boost::posix_time::microsec_clock::universal_time());
+
+	// Keep sweeping for as long as messages are waiting for their fragments
+	if (!reassemblies.empty())
+		arm_reassembly_timer();
+}
+
+void Udp::expire_reassemblies(const boost::posix_time::ptime & now)
+{
+	ReassemblyMap::iterator it = reassemblies.begin();
+	while (it != reassemblies.end())
+	{
+		if (now - it->second.started_at >= boost::posix_time::seconds(REASSEMBLY_TIMEOUT))
+			drop_reassembly(it++);
+		else
+			it++;
+	}
+}
+
+Udp::ReassemblyMap::iterator Udp::oldest_reassembly()
+{
+	ReassemblyMap::iterator oldest = reassemblies.begin();
+
+	for (ReassemblyMap::iterator it = reassemblies.begin(); it != reassemblies.end(); it++)
+	{
+		if (it->second.started_at < oldest->second.started_at)
+			oldest = it;
+	}
+
+	return oldest;
+}
+
+void Udp::drop_reassembly(ReassemblyMap::iterator it)
+{
+	Logger::warn("Gave up reassembling a message after receiving " + boost::lexical_cast<string>(it->second.fragments.size()) + " of "
+			+ boost::lexical_cast<string>(it->second.count) + " fragments", it->first.first.port(),
+			it->first.first.address().to_string());
+
+	reassembly_bytes -= it->second.bytes;
+	reassemblies.erase(it);
+
+	receive_stats_mutex.lock();
+	incomplete_messages++;
+	receive_stats_mutex.unlock();
+}
+
+boost::shared_ptr<ReliableChannel> Udp::get_channel(boost::shared_ptr<udp::socket> socket,
+		boost::shared_ptr<udp::endpoint> endpoint)
+{
+	map<udp::endpoint, boost::shared_ptr<ReliableChannel> >::iterator it = channels.find(*endpoint);
+	if (it != channels.end())
+		return it->second;
+
+	// Each channel holds a timer and its peer's state for a minute, so bound how many peers can have one
+	if (channels.size() >= (size_t) MAX_CHANNELS)
+		return boost::shared_ptr<ReliableChannel>();
+
+	boost::shared_ptr<ReliableChannel> channel = boost::make_shared<ReliableChannel>(boost::ref(*this), socket, endpoint);
+	channels[*endpoint] = channel;
+	channel->start();
+
+	return channel;
+}
+
+void Udp::remove_channel(const udp::endpoint & endpoint)
+{
+	map<udp::endpoint, boost::shared_ptr<ReliableChannel> >::iterator it = channels.find(endpoint);
+
+	if (it != channels.end())
+	{
+		it->second->close();
+		channels.erase(it);
+	}
+}
+
+void Udp::send_handler(const boost::system::error_code &error_code, size_t bytes_transferred, SharedBufferPtr data,
+		string host, int port)
 {
 	if (error_code)
 	{
@@ -33,22 +518,27 @@ void Udp::send_handler(const boost::system::error_code &error_code, size_t bytes
 	}
 
 	// Did not successfully send all the data, don't try and resend the rest (this is UDP)
-	if (bytes_transferred != data.size())
+	if (bytes_transferred != data->size())
 	{
 		string message(
 				string("UDP send failed, data was not successfully sent, only ") + boost::lexical_cast<string>(bytes_transferred) + " of "
-						+ boost::lexical_cast<string>(message.size()) + " total bytes were sent");
+						+ boost::lexical_cast<string>(data->size()) + " total bytes were sent");
 		Logger::error(message, port, host);
 		fire_error_event(message);
 
 		return;
 	}
 
-	string message("UDP send succeeded, sent " + boost::lexical_cast<string>(bytes_transferred) + " bytes, message is: " + data);
+	string message("UDP send succeeded, sent " + boost::lexical_cast<string>(bytes_transferred) + " bytes");
 	Logger::info(message, port, host);
 
+	complete_sends(1);
+}
+
+void Udp::complete_sends(int count)
+{
 	pending_sends_mutex.lock();
-	pending_sends--; // just handled sending
+	pending_sends -= count; // just handled sending
 	int pending_sends_now = pending_sends;
 	pending_sends_mutex.unlock();
 
@@ -56,8 +546,187 @@ void Udp::send_handler(const boost::system::error_code &error_code, size_t bytes
 		close();
 }
 
+void Udp::send_timer_handler(const boost::system::error_code & error_code)
+{
+	// The batch was already flushed because it filled up
+	if (error_code == boost::asio::error::operation_aborted)
+		return;
+
+	send_queue_mutex.lock();
+
+	// The batch filled up after this expiry was already queued, and the timer has since been disarmed or now belongs
+	// to a newer batch
+	if (!send_timer_armed || send_timer->expires_at() > boost::posix_time::microsec_clock::universal_time())
+	{
+		send_queue_mutex.unlock();
+		return;
+	}
+
+	send_timer_armed = false;
+	bool start_flush = !flush_pending;
+	flush_pending = true;
+	send_queue_mutex.unlock();
+
+	if (start_flush)
+		flush_sends();
+}
+
+void Udp::writable_handler(const boost::system::error_code & error_code)
+{
+	if (error_code && error_code != boost::asio::error::operation_aborted)
+	{
+		string message(
+				"UDP send failed, error message: '" + error_code.message() + "', error code '" + boost::lexical_cast<string>(
+						error_code.value()) + "' was encountered");
+		Logger::error(message, port, host);
+		fire_error_event(message);
+	}
+
+	// Carry on with the batch even if the wait failed, so that the sends are completed, one way or the other
+	flush_sends();
+}
+
+void Udp::flush_sends()
+{
+	for (;;)
+	{
+		if (sending_offset == sending.size())
+		{
+			// Take the next batch from the front of the queue, or stop if there is none
+			sending.clear();
+			sending_offset = 0;
+
+			boost::mutex::scoped_lock lock(send_queue_mutex);
+
+			if (send_queue.empty())
+			{
+				flush_pending = false;
+				return;
+			}
+
+			size_t batch = std::min(send_queue.size(), send_batch_size);
+			sending.assign(send_queue.begin(), send_queue.begin() + batch);
+			send_queue.erase(send_queue.begin(), send_queue.begin() + batch);
+		}
+
+#if defined(__UNIX__)
+
+		// Send the rest of the batch with a single system call
+		size_t count = sending.size() - sending_offset;
+		size_t control_size = CMSG_SPACE(sizeof(uint16_t));
+		send_headers.resize(count);
+		send_vectors.resize(count);
+		send_controls.resize(count * control_size);
+
+		for (size_t i = 0; i < count; i++)
+		{
+			QueuedSend & queued = sending[sending_offset + i];
+
+			send_vectors[i].iov_base = queued.data->data();
+			send_vectors[i].iov_len = queued.data->size();
+
+			memset(&send_headers[i], 0, sizeof(struct mmsghdr));
+			if (!sends_connected(queued.endpoint))
+			{
+				send_headers[i].msg_hdr.msg_name = queued.endpoint.data();
+				send_headers[i].msg_hdr.msg_namelen = queued.endpoint.size();
+			}
+			send_headers[i].msg_hdr.msg_iov = &send_vectors[i];
+			send_headers[i].msg_hdr.msg_iovlen = 1;
+
+#if defined(UDP_SEGMENT)
+			if (send_segment_size > 0 && queued.data->size() > send_segment_size)
+			{
+				// Have the kernel split this datagram into segments of the segment size
+				send_headers[i].msg_hdr.msg_control = &send_controls[i * control_size];
+				send_headers[i].msg_hdr.msg_controllen = control_size;
+
+				struct cmsghdr * control = CMSG_FIRSTHDR(&send_headers[i].msg_hdr);
+				control->cmsg_level = SOL_UDP;
+				control->cmsg_type = UDP_SEGMENT;
+				control->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+
+				uint16_t segment = send_segment_size;
+				memcpy(CMSG_DATA(control), &segment, sizeof(uint16_t));
+			}
+#endif
+		}
+
+		int sent = sendmmsg(send_socket->native_handle(), &send_headers[0], count, MSG_DONTWAIT);
+
+		if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+		{
+			// The socket's send buffer is full, carry on once it drains
+			send_socket->async_send(boost::asio::null_buffers(), strand.wrap(boost::bind(&Udp::writable_handler, this, _1)));
+			return;
+		}
+
+		if (sent < 0)
+		{
+			// The first datagram could not be sent, drop it and carry on with the rest
+			boost::system::error_code error_code(errno, boost::asio::error::get_system_category());
+			string message(
+					"UDP send failed, error message: '" + error_code.message() + "', error code '" + boost::lexical_cast<string>(
+							error_code.value()) + "' was encountered");
+			Logger::error(message, port, host);
+			fire_error_event(message);
+
+			sending[sending_offset].data.reset();
+			sending_offset++;
+			complete_sends(1);
+			continue;
+		}
+
+		Logger::info("UDP send succeeded, sent a batch of " + boost::lexical_cast<string>(sent) + " datagrams", port, host);
+
+		for (int i = 0; i < sent; i++)
+			sending[sending_offset + i].data.reset();
+		sending_offset += sent;
+		complete_sends(sent);
+
+#else
+
+		// Without sendmmsg, send each datagram of the batch on its own, which still completes it in one turn
+		for (; sending_offset < sending.size(); sending_offset++)
+		{
+			QueuedSend & queued = sending[sending_offset];
+
+			if (sends_connected(queued.endpoint))
+			{
+				send_socket->async_send(boost::asio::buffer(queued.data->data(), queued.data->size()),
+						strand.wrap(boost::bind(&Udp::send_handler, this, _1, _2, queued.data, host, queued.endpoint.port())));
+				continue;
+			}
+
+			send_socket->async_send_to(boost::asio::buffer(queued.data->data(), queued.data->size()), queued.endpoint,
+					strand.wrap(boost::bind(&Udp::send_handler, this, _1, _2, queued.data, host, queued.endpoint.port())));
+		}
+
+#endif
+	}
+}
+
+void Udp::start_receive(boost::shared_ptr<udp::socket> socket)
+{
+	SharedBufferPtr data = SharedBuffer::create(buffer_pool, receive_size);
+
+	// Everything received on a connected socket comes from the remote endpoint, which never changes once connected
+	if (connected)
+	{
+		socket->async_receive(boost::asio::buffer(data->data(), data->capacity()),
+				strand.wrap(boost::bind(&Udp::receive_handler, this, _1, _2, socket, data, remote_endpoint, host, port)));
+		return;
+	}
+
+	boost::shared_ptr<udp::endpoint> endpoint = boost::make_shared<udp::endpoint>();
+
+	socket->async_receive_from(boost::asio::buffer(data->data(), data->capacity()), *endpoint,
+			strand.wrap(boost::bind(&Udp::receive_handler, this, _1, _2, socket, data, endpoint, host, port)));
+}
+
 void Udp::receive_handler(const boost::system::error_code &error_code, std::size_t bytes_transferred,
-		boost::shared_ptr<udp::socket> socket, boost::shared_ptr<udp::endpoint> endpoint, string host, int port)
+		boost::shared_ptr<udp::socket> socket, SharedBufferPtr data, boost::shared_ptr<udp::endpoint> endpoint,
+		string host, int port)
 {
 	// Check for errors
 	if (error_code)
@@ -66,6 +735,14 @@ void Udp::receive_handler(const boost::system::error_code &error_code, std::size
 		{
 			Logger::info("UDP receive failed, aborted", port, host);
 		}
+		else if (error_code == boost::asio::error::connection_refused && connected)
+		{
+			// A connected socket is told when an earlier datagram was refused by the remote host, which is no reason to
+			// stop listening for its replies
+			Logger::warn("UDP datagram refused by the remote host", port, host);
+			if (!should_close)
+				listen();
+		}
 		else
 		{
 			string message(
@@ -78,19 +755,200 @@ void Udp::receive_handler(const boost::system::error_code &error_code, std::size
 		return;
 	}
 
-	// Get the data && fire a data event
-	string data(receive_buffer.c_array(), bytes_transferred);
-	fire_data_event(data, socket, endpoint);
+	// Hand the slot to the data event, moving small datagrams out of large buffers first
+	bool filled = bytes_transferred == data->capacity();
+	data->set_size(bytes_transferred);
+	deliver_datagram(SharedBuffer::compact(buffer_pool, data), socket, endpoint);
+	adapt_receive_size(filled, bytes_transferred);
+
+	receive_stats_mutex.lock();
+	received_datagrams++;
+	if (filled)
+		truncated_datagrams++;
+	receive_stats_mutex.unlock();
 
-	// Pull out the data we received, and fire a data received event
-	Logger::info("UDP receive succeeded, received " + boost::lexical_cast<string>(bytes_transferred) + " bytes, data is: " + data, port,
-			host);
+	Logger::info("UDP receive succeeded, received " + boost::lexical_cast<string>(bytes_transferred) + " bytes", port, host);
 
-	// Listen for more messages if we're not trying to close down this UDP object
+	// Replace this receive with another if we're not trying to close down this UDP object
 	if (!should_close)
 		listen();
 }
 
+void Udp::wait_readable(boost::shared_ptr<udp::socket> socket)
+{
+	socket->async_receive(boost::asio::null_buffers(),
+			strand.wrap(boost::bind(&Udp::readable_handler, this, _1, socket)));
+}
+
+void Udp::readable_handler(const boost::system::error_code & error_code, boost::shared_ptr<udp::socket> socket)
+{
+	if (error_code)
+	{
+		if (error_code == boost::asio::error::operation_aborted)
+		{
+			Logger::info("UDP receive failed, aborted", port, host);
+		}
+		else if (error_code == boost::asio::error::connection_refused && connected)
+		{
+			Logger::warn("UDP datagram refused by the remote host", port, host);
+			if (!should_close)
+				listen();
+		}
+		else
+		{
+			string message(
+					"UDP receive failed, error message: '" + error_code.message() + "', code: '" + boost::lexical_cast<string>(
+							error_code.value()) + "'");
+			Logger::error(message, port, host);
+			fire_error_event(message);
+		}
+
+		return;
+	}
+
+	boost::system::error_code receive_error;
+	size_t received = receive_ring->receive(*socket, receive_size, receive_error);
+
+	if (receive_error == boost::asio::error::connection_refused && connected)
+	{
+		// As in receive_handler, a refused earlier datagram is no reason to stop listening for replies
+		Logger::warn("UDP datagram refused by the remote host", port, host);
+		if (!should_close)
+			listen();
+
+		return;
+	}
+
+	if (receive_error && receive_error != boost::asio::error::would_block)
+	{
+		string message(
+				"UDP receive failed, error message: '" + receive_error.message() + "', code: '" + boost::lexical_cast<string>(
+						receive_error.value()) + "'");
+		Logger::error(message, port, host);
+		fire_error_event(message);
+
+		return;
+	}
+
+	// Hand each datagram to its own data event, along with its own copy of the sender's endpoint, or the remote
+	// endpoint every datagram comes from on a connected socket
+	for (size_t i = 0; i < received; i++)
+	{
+		SharedBufferPtr data = receive_ring->take(i);
+		boost::shared_ptr<udp::endpoint> endpoint = connected ? remote_endpoint
+				: boost::make_shared<udp::endpoint>(receive_ring->get_endpoint(i));
+		size_t segment_size = receive_ring->get_segment_size(i);
+		data->set_receive_time(receive_ring->get_receive_time(i));
+		data->set_destination(receive_ring->get_destination(i));
+
+		if (segment_size > 0 && data->size() > segment_size)
+		{
+			// Split a run of datagrams coalesced by the kernel back into one event per datagram
+			for (size_t offset = 0; offset < data->size(); offset += segment_size)
+			{
+				size_t size = std::min(segment_size, data->size() - offset);
+				SharedBufferPtr segment = SharedBuffer::copy(buffer_pool, data->data() + offset, size);
+				segment->set_receive_time(data->get_receive_time());
+				segment->set_destination(data->get_destination());
+				deliver_datagram(segment, socket, endpoint);
+			}
+			continue;
+		}
+
+		deliver_datagram(SharedBuffer::compact(buffer_pool, data), socket, endpoint);
+		adapt_receive_size(receive_ring->filled(i), data->size());
+	}
+
+	receive_stats_mutex.lock();
+	received_datagrams += received;
+	for (size_t i = 0; i < received; i++)
+	{
+		if (receive_ring->filled(i))
+			truncated_datagrams++;
+	}
+	kernel_drops = receive_ring->get_drops();
+	receive_stats_mutex.unlock();
+
+	if (received > 0)
+		Logger::info("UDP receive succeeded, received a batch of " + boost::lexical_cast<string>(received) + " datagrams", port, host);
+
+	if (!should_close)
+		listen();
+}
+
+boost::shared_ptr<UdpEvent> Udp::create_event(SharedBufferPtr data, boost::shared_ptr<udp::socket> socket,
+		boost::shared_ptr<udp::endpoint> endpoint)
+{
+	boost::shared_ptr<UdpEvent> event = event_pool.acquire();
+	event->assign(this, socket, endpoint, data);
+	return event;
+}
+
+void Udp::enable_timestamps(boost::shared_ptr<udp::socket> socket)
+{
+	if (timestamp_mode == ReceiveTime::NONE)
+		return;
+
+#if defined(__UNIX__)
+	if (!ReceiveTime::enable(socket->native_handle(), timestamp_mode))
+		Logger::warn("Failed to enable receive timestamps on UDP socket: '" + string(strerror(errno)) + "'", port, host);
+#else
+	Logger::warn("Receive timestamps are not supported on this platform", port, host);
+#endif
+}
+
+void Udp::set_socket_buffers(boost::shared_ptr<udp::socket> socket)
+{
+	int receive_buffer = DEFAULT_SOCKET_RECEIVE_BUFFER;
+	if (rcvbuf && *rcvbuf > 0)
+		receive_buffer = *rcvbuf;
+
+	int send_buffer = DEFAULT_SOCKET_SEND_BUFFER;
+	if (sndbuf && *sndbuf > 0)
+		send_buffer = *sndbuf;
+
+	boost::system::error_code error_code;
+	socket->set_option(boost::asio::socket_base::receive_buffer_size(receive_buffer), error_code);
+	if (error_code)
+		Logger::warn("Failed to set UDP socket receive buffer size: '" + error_code.message() + "'", port, host);
+
+	socket->set_option(boost::asio::socket_base::send_buffer_size(send_buffer), error_code);
+	if (error_code)
+		Logger::warn("Failed to set UDP socket send buffer size: '" + error_code.message() + "'", port, host);
+
+	// The kernel may cap the sizes asked for, so log what it actually chose
+	boost::asio::socket_base::receive_buffer_size actual_receive_buffer;
+	boost::asio::socket_base::send_buffer_size actual_send_buffer;
+	socket->get_option(actual_receive_buffer, error_code);
+	socket->get_option(actual_send_buffer, error_code);
+
+	Logger::info("UDP socket buffers: receive " + boost::lexical_cast<string>(actual_receive_buffer.value()) + " bytes, send "
+			+ boost::lexical_cast<string>(actual_send_buffer.value()) + " bytes", port, host);
+}
+
+void Udp::adapt_receive_size(bool filled, std::size_t bytes_transferred)
+{
+	if (filled)
+	{
+		// The datagram filled the buffer, so it may have been truncated
+		receive_size = std::min(receive_size * 2, max_receive_size);
+		quiet_receives = 0;
+	}
+	else if (bytes_transferred <= receive_size / 4)
+	{
+		// Shrink back once datagrams have stayed well below the buffer size for a while
+		if (++quiet_receives >= QUIET_RECEIVES)
+		{
+			receive_size = std::max(receive_size / 2, min_receive_size);
+			quiet_receives = 0;
+		}
+	}
+	else
+	{
+		quiet_receives = 0;
+	}
+}
+
 void inline Udp::parse_string_bool_arg(map<string, string> &options, string arg, optional<bool> &arg_value)
 {
 	map<string, string>::iterator it;
@@ -138,6 +996,90 @@ void Udp::parse_args(map<string, string> options)
 
 	if ((it = transformed_options.find("multicastttl")) != transformed_options.end())
 		multicast_ttl.reset(boost::lexical_cast<int>(it->second));
+
+	parse_string_bool_arg(transformed_options, "multicastloop", multicast_loop);
+
+	if ((it = transformed_options.find("batchsize")) != transformed_options.end())
+		batch_size.reset(boost::lexical_cast<int>(it->second));
+
+	if ((it = transformed_options.find("batchdelay")) != transformed_options.end())
+		batch_delay.reset(boost::lexical_cast<int>(it->second));
+
+	if ((it = transformed_options.find("minbuffer")) != transformed_options.end())
+		min_buffer.reset(boost::lexical_cast<int>(it->second));
+
+	if ((it = transformed_options.find("maxbuffer")) != transformed_options.end())
+		max_buffer.reset(boost::lexical_cast<int>(it->second));
+
+	if ((it = transformed_options.find("receivebatch")) != transformed_options.end())
+		receive_batch.reset(boost::lexical_cast<int>(it->second));
+
+	if ((it = transformed_options.find("pendingreceives")) != transformed_options.end())
+		pending_receives.reset(boost::lexical_cast<int>(it->second));
+
+	if ((it = transformed_options.find("rcvbuf")) != transformed_options.end())
+		rcvbuf.reset(boost::lexical_cast<int>(it->second));
+
+	if ((it = transformed_options.find("sndbuf")) != transformed_options.end())
+		sndbuf.reset(boost::lexical_cast<int>(it->second));
+
+	if ((it = transformed_options.find("sendbatch")) != transformed_options.end())
+		send_batch.reset(boost::lexical_cast<int>(it->second));
+
+	if ((it = transformed_options.find("senddelay")) != transformed_options.end())
+		send_delay.reset(boost::lexical_cast<int>(it->second));
+
+	if ((it = transformed_options.find("segmentsize")) != transformed_options.end())
+		segment_size.reset(boost::lexical_cast<int>(it->second));
+
+	parse_string_bool_arg(transformed_options, "gro", gro);
+	parse_string_bool_arg(transformed_options, "reliable", reliable);
+	parse_string_bool_arg(transformed_options, "connect", connect_socket);
+
+	if ((it = transformed_options.find("timestamps")) != transformed_options.end())
+		timestamps.reset(it->second);
+
+	if ((it = transformed_options.find("fragmentsize")) != transformed_options.end())
+		fragment.reset(boost::lexical_cast<int>(it->second));
+
+	// Resolve the bounds on the receive buffer size, keeping the maximum at least as large as the minimum
+	if (min_buffer && *min_buffer > 0)
+		min_receive_size = *min_buffer;
+	if (max_buffer && *max_buffer > 0)
+		max_receive_size = *max_buffer;
+	max_receive_size = std::max(min_receive_size, max_receive_size);
+	receive_size = min_receive_size;
+
+	if (timestamps)
+		timestamp_mode = ReceiveTime::parse(*timestamps);
+
+	// Fragments must have room for some of the message after their headers
+	if (fragment && *fragment > (int) (FRAGMENT_HEADER_SIZE + reliable_header_size()))
+		fragment_size = *fragment;
+	else if (fragment)
+		Logger::warn("UDP fragment size must be larger than the fragment headers, messages will not be fragmented", port, host);
+
+	// Segmented sends carry their segment size as ancillary data, so are only sent through the send queue
+	if (segment_size && *segment_size > 0)
+	{
+#if defined(__UNIX__) && defined(UDP_SEGMENT)
+		send_segment_size = *segment_size;
+#else
+		Logger::warn("Segmented UDP sends are not supported on this platform, sending data as single datagrams", port, host);
+#endif
+	}
+
+	// Queue outgoing datagrams if a batch size or delay is set, sending a batch at the end of the current turn of the
+	// event loop unless a delay is given
+	if (send_batch || send_delay || send_segment_size > 0)
+	{
+		send_batch_size = DEFAULT_SEND_BATCH;
+		if (send_batch && *send_batch > 0)
+			send_batch_size = *send_batch;
+		if (send_delay && *send_delay > 0)
+			send_batch_delay = *send_delay;
+		send_timer.reset(new boost::asio::deadline_timer(io_service));
+	}
 }
 
 inline string Udp::bool_option_to_string(optional<bool> &arg, string iftrue, string iffalse)
@@ -169,6 +1111,51 @@ void Udp::log_options()
 
 	options.append(", multicast ttl: ");
 	options.append(option_to_string<int> (multicast_ttl));
+	options.append(", multicast loop: ");
+	options.append(option_to_string<bool> (multicast_loop));
+
+	options.append(", batch size: ");
+	options.append(option_to_string<int> (batch_size));
+
+	options.append(", batch delay: ");
+	options.append(option_to_string<int> (batch_delay));
+
+	options.append(", min buffer: ");
+	options.append(option_to_string<int> (min_buffer));
+
+	options.append(", max buffer: ");
+	options.append(option_to_string<int> (max_buffer));
+
+	options.append(", receive batch: ");
+	options.append(option_to_string<int> (receive_batch));
+
+	options.append(", pending receives: ");
+	options.append(option_to_string<int> (pending_receives));
+
+	options.append(", rcvbuf: ");
+	options.append(option_to_string<int> (rcvbuf));
+
+	options.append(", sndbuf: ");
+	options.append(option_to_string<int> (sndbuf));
+
+	options.append(", send batch: ");
+	options.append(option_to_string<int> (send_batch));
+
+	options.append(", send delay: ");
+	options.append(option_to_string<int> (send_delay));
+
+	options.append(", segment size: ");
+	options.append(option_to_string<int> (segment_size));
+
+	options.append(bool_option_to_string(gro, ", gro", ", no gro"));
+	options.append(bool_option_to_string(reliable, ", reliable", ", unreliable"));
+	options.append(connect_socket && !*connect_socket ? ", unconnected" : ", connected");
+
+	options.append(", timestamps: ");
+	options.append(option_to_string<string> (timestamps));
+
+	options.append(", fragment size: ");
+	options.append(option_to_string<int> (fragment));
 
 	Logger::info(options, port, host);
 }
@@ -12,12 +12,34 @@
 #include <boost/asio/buffer.hpp>
 #include <boost/lexical_cast.hpp>
 #include <boost/make_shared.hpp>
+#include <boost/detail/atomic_count.hpp>
 #include <boost/optional.hpp>
+#include <boost/scoped_ptr.hpp>
 #include <boost/thread.hpp>
+#include <algorithm>
+#include <deque>
 #include <map>
+#include <vector>
+
+#if defined(__UNIX__)
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#include <errno.h>
+
+#endif
 
 class Udp;
+class UdpEvent;
 
+#include "SharedBuffer.h"
+#include "EventPool.h"
+#include "ReceiveTime.h"
+#include "ReliableChannel.h"
+#include "UdpReceiveRing.h"
 #include "UdpEvent.h"
 #include "Logger.h"
 
@@ -26,7 +48,9 @@ using boost::asio::buffer_size;
 using boost::asio::buffer_cast;
 using boost::asio::ip::udp;
 using std::string;
+using std::deque;
 using std::map;
+using std::vector;
 
 typedef boost::asio::const_buffers_1 boost_buffer;
 
@@ -49,16 +73,18 @@ class Udp
 		 * 					host to which to connect, and for servers, represents the port to which to bind and listen
 		 * 					for incoming connections.
 		 *	@param	io_service	The I/O service used for asynchronous I/O requests
+		 *	@param	buffer_pool	The pool from which buffers for sending data are leased
 		 */
-		Udp(string host, int port, boost::asio::io_service & io_service);
+		Udp(string host, int port, boost::asio::io_service & io_service, BufferPool & buffer_pool);
 
 		/**
 		 * Immediately calls the <code>close</code> function, freeing all resources for this UDP object and shutting down
 		 * any open connections.
 		 */
-		virtual ~Udp() {}
+		virtual ~Udp();
 
 		friend class UdpEvent;
+		friend class ReliableChannel;
 
 	protected:
 
@@ -92,11 +118,31 @@ class Udp
 		 *
 		 * ipv6                 if true, use ipv6. otherwise use ipv4.
 		 * multicast            enable udp multicasting
-		 * multicast group      the multicast group to join
+		 * multicast group      the multicast group to join, or a comma-separated list of groups
+		 * multicast loop       whether multicast datagrams sent from this socket are looped back to the host
 		 * multicast ttl        number of multicast hops to make;
 		 * do not route         prevent routing, use local interfaces
 		 * reuse address        allow the socket to bind to an address already in use
 		 * keep alive           allow the socket to send keep-alives.
+		 * batch size           deliver received data in 'dataBatch' events of up to this many messages
+		 * batch delay          deliver a partial batch once its oldest message has waited this many microseconds
+		 * min buffer           the smallest size in bytes the receive buffer shrinks to
+		 * max buffer           the largest size in bytes the receive buffer grows to
+		 * receive batch        servers drain up to this many datagrams from the socket each time it becomes readable
+		 * pending receives     the number of receives servers keep in flight, each into its own buffer and endpoint
+		 * reliable             deliver messages reliably and in order, over a channel to each peer
+		 * fragment size        split messages into datagrams of at most this many bytes, headers included, and reassemble
+		 *                      them on receipt
+		 * rcvbuf               the size in bytes of the kernel's receive buffer for the socket
+		 * sndbuf               the size in bytes of the kernel's send buffer for the socket
+		 * send batch           queue outgoing datagrams and send up to this many at a time
+		 * send delay           send a partial batch of queued datagrams once its oldest has waited this many microseconds
+		 * segment size         send data larger than this many bytes as datagrams of this size, segmented by the kernel
+		 * gro                  servers receive runs of datagrams coalesced by the kernel, and split them back up
+		 * connect              clients connect their socket to the remote host once resolved (the default), set to
+		 *                      false to receive from any sender
+		 * timestamps           have the kernel timestamp received datagrams, 'true' or 'software' for software
+		 *                      timestamps, or 'hardware' for hardware timestamps where the interface takes them
 		 *
 		 * @param options       A map of options to values.
 		 */
@@ -112,6 +158,14 @@ class Udp
 		 */
 		virtual void listen() = 0;
 
+		/**
+		 * Sizes the kernel's send and receive buffers for a socket, from the 'rcvbuf' and 'sndbuf' options or their
+		 * 	defaults, and logs the sizes the kernel actually chose, which may be capped by system limits.
+		 *
+		 * 	@param	socket	The open socket whose buffers to size
+		 */
+		void set_socket_buffers(boost::shared_ptr<udp::socket> socket);
+
 		/**
 		 * Immediately frees all resources for this UDP object and shutting down any open connections. This function
 		 * 	should never be invoked by the base class, and logs an error if this ever occurs.
@@ -119,17 +173,247 @@ class Udp
 		virtual void close() = 0;
 
 		/**
-		 * Handler invoked when the data has been sent (or sending terminated in error).
+		 * Asynchronously sends data to an endpoint, from a copy of the data in a buffer leased from the buffer pool,
+		 * 	and counts the send as pending until it completes. When sends are batched, the datagram is queued and sent
+		 * 	with the rest of its batch by <code>flush_sends</code>.
+		 *
+		 * 	@param	socket		The socket from which to send the data
+		 * 	@param	endpoint	The endpoint to which to send the data
+		 * 	@param	data		The data to send
+		 */
+		void send_to(boost::shared_ptr<udp::socket> socket, const udp::endpoint & endpoint, const string & data);
+
+		/**
+		 * A message being reassembled from its fragments
+		 */
+		struct Reassembly
+		{
+			/** The number of fragments the message was split into */
+			size_t count;
+
+			/** Each fragment received so far by its index, with the offset of its part of the message. Only the
+			 fragments that have arrived take up room, whatever count the sender claims. */
+			map<size_t, std::pair<SharedBufferPtr, size_t> > fragments;
+
+			/** The number of bytes of the message received so far */
+			size_t bytes;
+
+			/** The time the first fragment to arrive was received */
+			boost::posix_time::ptime started_at;
+		};
+
+		/** Identifies a message being reassembled by its sender and the sender's identifier for the message */
+		typedef std::pair<udp::endpoint, boost::uint32_t> ReassemblyKey;
+
+		typedef map<ReassemblyKey, Reassembly> ReassemblyMap;
+
+		/**
+		 * Splits a message into fragments no larger than the fragment size, each with a header naming the message and
+		 * 	its place in it, and sends them.
+		 *
+		 * 	@param	socket		The socket from which to send the message
+		 * 	@param	endpoint	The endpoint to which to send the message
+		 * 	@param	data		The message to send
+		 */
+		void send_fragments(boost::shared_ptr<udp::socket> socket, const udp::endpoint & endpoint, const string & data);
+
+		/**
+		 * Gets the size of the reliable channel's header in front of every message, which is zero unless messages are
+		 * 	delivered reliably.
+		 */
+		size_t reliable_header_size();
+
+		/**
+		 * Copies data into a pooled buffer, after room for the reliable channel's header, if any, and a header of the
+		 * 	given size.
+		 *
+		 * 	@param	header_size	The size of the header to leave room for after the reliable channel's header
+		 * 	@param	data		The data to copy
+		 * 	@param	size		The number of bytes of data
+		 * 	@return	The buffer holding the data
+		 */
+		SharedBufferPtr create_packet(size_t header_size, const char * data, size_t size);
+
+		/**
+		 * Sends a packet built by <code>create_packet</code>, over the reliable channel to the endpoint when messages are
+		 * 	delivered reliably.
+		 *
+		 * 	@param	socket		The socket from which to send the packet
+		 * 	@param	endpoint	The endpoint to which to send the packet
+		 * 	@param	packet		The packet to send
+		 */
+		void send_packet(boost::shared_ptr<udp::socket> socket, const udp::endpoint & endpoint, SharedBufferPtr packet);
+
+		/**
+		 * Sends a buffer to an endpoint, either immediately or through the send queue when sends are batched, and
+		 * 	counts the send as pending until it completes.
+		 *
+		 * 	@param	socket		The socket from which to send the data
+		 * 	@param	endpoint	The endpoint to which to send the data
+		 * 	@param	data		The buffer holding the data to send
+		 */
+		void send_buffer(boost::shared_ptr<udp::socket> socket, const udp::endpoint & endpoint, SharedBufferPtr data);
+
+		/**
+		 * Checks whether datagrams to an endpoint go out on the connected socket, without an address.
+		 *
+		 * 	@param	endpoint	The endpoint to which the data is sent
+		 * 	@return	True if the socket is connected to this endpoint
+		 */
+		bool sends_connected(const udp::endpoint & endpoint);
+
+		/**
+		 * Sets the remote host this object's socket sends to, once it has been resolved.
+		 *
+		 * 	@param	endpoint		The endpoint of the remote host
+		 * 	@param	is_connected	Whether the socket has been connected to it
+		 */
+		void set_remote_endpoint(const udp::endpoint & endpoint, bool is_connected);
+
+		/**
+		 * Sends a message over the reliable channel to an endpoint, creating the channel if needed. Must only be run on
+		 * 	the strand.
+		 *
+		 * 	@param	socket		The socket from which to send the message
+		 * 	@param	endpoint	The endpoint to which to send the message
+		 * 	@param	packet		The buffer holding the message, after room for the channel's header
+		 */
+		void send_reliable(boost::shared_ptr<udp::socket> socket, udp::endpoint endpoint, SharedBufferPtr packet);
+
+		/**
+		 * Hands a received datagram to the reliable channel for its sender when messages are delivered reliably, and
+		 * 	otherwise fires a data event for it directly.
+		 *
+		 * 	@param	data		The buffer holding the datagram
+		 * 	@param	socket		The socket on which the datagram was received
+		 * 	@param	endpoint	The endpoint the datagram was received from
+		 */
+		void deliver_datagram(SharedBufferPtr data, boost::shared_ptr<udp::socket> socket,
+				boost::shared_ptr<udp::endpoint> endpoint);
+
+		/**
+		 * Handles a message received, reassembling it from its fragments when messages are fragmented, and otherwise
+		 * 	firing a data event for it. Must only be run on the strand.
+		 *
+		 * 	@param	data		The buffer holding the message
+		 * 	@param	offset		The offset of the message in the buffer, after any header already handled
+		 * 	@param	socket		The socket on which the message was received
+		 * 	@param	endpoint	The endpoint the message was received from
+		 */
+		void deliver_message(SharedBufferPtr data, size_t offset, boost::shared_ptr<udp::socket> socket,
+				boost::shared_ptr<udp::endpoint> endpoint);
+
+		/**
+		 * Holds a fragment until the rest of its message has arrived, then fires a data event for the whole message.
+		 *
+		 * 	@param	data		The buffer holding the fragment
+		 * 	@param	offset		The offset of the fragment's header in the buffer
+		 * 	@param	socket		The socket on which the fragment was received
+		 * 	@param	endpoint	The endpoint the fragment was received from
+		 */
+		void reassemble(SharedBufferPtr data, size_t offset, boost::shared_ptr<udp::socket> socket,
+				boost::shared_ptr<udp::endpoint> endpoint);
+
+		/**
+		 * Starts the timer that sweeps the messages being reassembled once a second. Only called on the strand.
+		 */
+		void arm_reassembly_timer();
+
+		/**
+		 * Handler invoked when the reassembly timer expires, which gives up on the messages that have timed out, and
+		 * 	starts the timer again while any are left.
+		 */
+		void reassembly_timer_handler(const boost::system::error_code & error_code);
+
+		/**
+		 * Gives up on messages that have not been reassembled within the reassembly timeout.
+		 *
+		 * 	@param	now	The current time
+		 */
+		void expire_reassemblies(const boost::posix_time::ptime & now);
+
+		/**
+		 * Finds the message that has been waiting longest for its fragments. There must be at least one.
+		 */
+		ReassemblyMap::iterator oldest_reassembly();
+
+		/**
+		 * Gives up on reassembling a message, releasing the fragments received so far.
+		 *
+		 * 	@param	it	The message to give up on
+		 */
+		void drop_reassembly(ReassemblyMap::iterator it);
+
+		/**
+		 * Gets the reliable channel to an endpoint, creating it if there is none and fewer than
+		 * 	<code>MAX_CHANNELS</code> are open. Must only be run on the strand.
+		 *
+		 * 	@param	socket		The socket on which to communicate with the endpoint
+		 * 	@param	endpoint	The endpoint at the other end of the channel
+		 * 	@return	The channel to the endpoint, or null if there is none and no more can be opened
+		 */
+		boost::shared_ptr<ReliableChannel> get_channel(boost::shared_ptr<udp::socket> socket,
+				boost::shared_ptr<udp::endpoint> endpoint);
+
+		/**
+		 * Forgets the reliable channel to an endpoint, once it has been idle for a while. Must only be run on the
+		 * 	strand.
+		 *
+		 * 	@param	endpoint	The endpoint at the other end of the channel
+		 */
+		void remove_channel(const udp::endpoint & endpoint);
+
+		/**
+		 * Handler invoked when the data has been sent (or sending terminated in error), which drops this send's
+		 * 	reference to the buffer holding the data.
 		 *
 		 * 	@param	err		The error code encountered when trying to send data, if any occurred. On success,
 		 * 						this value is zero, and nonzero on error.
 		 * 	@param	bytes_transferred	The number of bytes successfully sent over the connection.
-		 * 	@param	msg		The data to be sent.
+		 * 	@param	data	The buffer holding the data that was sent
 		 * 	@param	host	The hostname for this UDP object
 		 * 	@param	port	The port for this UDP object
 		 */
 		void send_handler(const boost::system::error_code &err, std::size_t bytes_transferred,
-				string msg, string host, int port);
+				SharedBufferPtr data, string host, int port);
+
+		/**
+		 * Sends the queued datagrams in batches of up to the send batch size, until the queue is empty or the socket
+		 * 	would block, in which case it resumes once the socket is writable. Must only be run on the strand.
+		 */
+		void flush_sends();
+
+		/**
+		 * Handler invoked when the oldest queued datagram has waited as long as the send delay allows.
+		 *
+		 * 	@param	error_code	The error code from the timer, which is <code>operation_aborted</code> if a full batch
+		 * 						was flushed first
+		 */
+		void send_timer_handler(const boost::system::error_code & error_code);
+
+		/**
+		 * Handler invoked when the socket becomes writable after a batch of sends would have blocked.
+		 *
+		 * 	@param	error_code	The error encountered while waiting for the socket, if any
+		 */
+		void writable_handler(const boost::system::error_code & error_code);
+
+		/**
+		 * Counts sends as no longer pending, and closes this object if it was waiting for them to complete.
+		 *
+		 * 	@param	count	The number of sends that completed
+		 */
+		void complete_sends(int count);
+
+		/**
+		 * Starts an asynchronous receive of one datagram, into a receive slot of its own: a buffer of the current
+		 * 	receive size leased for it, and an endpoint for its sender. The slot is handed to the data event when the
+		 * 	datagram arrives, so any number of receives may be in flight at once. On a connected socket, the sender is
+		 * 	always the remote endpoint, which is handed to the data event instead.
+		 *
+		 * 	@param	socket	The socket on which to receive
+		 */
+		void start_receive(boost::shared_ptr<udp::socket> socket);
 
 		/**
 		 * Handler invoked when some data has been received.
@@ -138,13 +422,60 @@ class Udp
 		 * 						this value is zero, and nonzero on error.
 		 * 	@param	bytes_transferred	The number of bytes successfully received over the connection.
 		 * 	@param	socket		The connection on which attempted to receive data.
-		 * 	@param	endpoint	The connected endpoint to the remote host
+		 * 	@param	data		The buffer the datagram was received into
+		 * 	@param	endpoint	The endpoint of the host the datagram was received from
 		 * 	@param	host	The hostname for this UDP object
 		 * 	@param	port	The port for this UDP object
 		 */
 		void receive_handler(const boost::system::error_code &err, std::size_t bytes_transferred,
-						boost::shared_ptr<udp::socket> socket, boost::shared_ptr<udp::endpoint> endpoint, string host,
-						int port);
+						boost::shared_ptr<udp::socket> socket, SharedBufferPtr data,
+						boost::shared_ptr<udp::endpoint> endpoint, string host, int port);
+
+		/**
+		 * Waits for a socket to become readable, to drain a batch of datagrams from it into the receive ring. The
+		 * 	socket must be in non-blocking mode.
+		 *
+		 * 	@param	socket	The socket on which to receive
+		 */
+		void wait_readable(boost::shared_ptr<udp::socket> socket);
+
+		/**
+		 * Handler invoked when the socket becomes readable while receiving through the receive ring, which drains a
+		 * 	batch of datagrams into the ring and fires a data event for each.
+		 *
+		 * 	@param	error_code	The error encountered while waiting for the socket, if any
+		 * 	@param	socket		The socket that became readable
+		 */
+		void readable_handler(const boost::system::error_code & error_code, boost::shared_ptr<udp::socket> socket);
+
+		/**
+		 * Has the kernel timestamp the datagrams received on a socket, if the 'timestamps' option asks for it,
+		 * 	warning if it can't.
+		 *
+		 * 	@param	socket	The open socket
+		 */
+		void enable_timestamps(boost::shared_ptr<udp::socket> socket);
+
+		/**
+		 * Takes an event from this object's pool, and assigns it to a message received.
+		 *
+		 * 	@param	data		The buffer holding the message
+		 * 	@param	socket		The socket on which the message was received, and on which to reply
+		 * 	@param	endpoint	The sender of the message
+		 * 	@return	The event to fire
+		 */
+		boost::shared_ptr<UdpEvent> create_event(SharedBufferPtr data, boost::shared_ptr<udp::socket> socket,
+				boost::shared_ptr<udp::endpoint> endpoint);
+
+		/**
+		 * Adapts the receive size to the traffic on this object, doubling it when a datagram fills the buffer, and
+		 * 	halving it once datagrams have stayed small for a while, within this object's minimum and maximum buffer
+		 * 	sizes.
+		 *
+		 * 	@param	filled		Whether the datagram just received filled the buffer
+		 * 	@param	bytes_transferred	The size of the datagram just received
+		 */
+		void adapt_receive_size(bool filled, std::size_t bytes_transferred);
 
 		/**
 		 * Helper to fire an error event to javascript.
@@ -156,22 +487,101 @@ class Udp
 		/**
 		 * Helper to fire data event to javascript.
 		 *
-		 * 	@param	data	The data received
+		 * 	@param	data	The buffer holding the data received, which the event shares
 		 * 	@param	socket	The socket on which to reply to this data
 		 * 	@param	endpoint The connected endpoint to the remote host
 		 */
-		virtual void fire_data_event(const string data, boost::shared_ptr<udp::socket> socket,
+		virtual void fire_data_event(SharedBufferPtr data, boost::shared_ptr<udp::socket> socket,
 				boost::shared_ptr<udp::endpoint> endpoint) = 0;
 
 		/** The I/O service for perform nonblocking actions */
 		boost::asio::io_service & io_service;
 
-		/** A constant representing the size of the buffer in which to receive data. This is adjust to support
-		 the largest packet possible according to the UDP protocol. */
+		/** The strand on which all handlers for this UDP object run, which keeps them serialized when the I/O service
+		 is run by more than one background thread. */
+		boost::asio::io_service::strand strand;
+
+		/** The pool, shared by every object on the same network thread, from which buffers for data being sent are
+		 leased. */
+		BufferPool & buffer_pool;
+
+		/** The pool of events fired for data received by this object, which are reused once javascript lets go of them */
+		EventPool<UdpEvent> event_pool;
+
+		/** A constant representing the default minimum size of the buffer in which to receive data. */
 		static const int BUFFER_SIZE = 2048;
 
-		/** A buffer for receiving data from the remote host. */
-		boost::array<char, BUFFER_SIZE> receive_buffer;
+		/** A constant representing the default maximum size of the buffer in which to receive data, which is large
+		 enough for the largest packet possible according to the UDP protocol. */
+		static const int MAX_BUFFER_SIZE = 65536;
+
+		/** The number of consecutive small datagrams after which the receive buffer is shrunk. */
+		static const int QUIET_RECEIVES = 8;
+
+		/** The default size of the kernel's receive buffer for a socket, large enough to absorb bursts. */
+		static const int DEFAULT_SOCKET_RECEIVE_BUFFER = 4194304;
+
+		/** The default size of the kernel's send buffer for a socket. */
+		static const int DEFAULT_SOCKET_SEND_BUFFER = 1048576;
+
+		/** The default number of outgoing datagrams sent at a time, if only a send delay is given. */
+		static const int DEFAULT_SEND_BATCH = 64;
+
+		/** The size of the header in front of every fragment. */
+		static const int FRAGMENT_HEADER_SIZE = 12;
+
+		/** The largest number of fragments a message may be split into. */
+		static const int MAX_FRAGMENTS = 65535;
+
+		/** The largest number of messages reassembled at once, beyond which the oldest is given up on. */
+		static const int MAX_REASSEMBLIES = 1024;
+
+		/** The largest number of bytes held by messages being reassembled, beyond which the oldest are given up on. */
+		static const int MAX_REASSEMBLY_BYTES = 67108864;
+
+		/** The number of seconds after which a message that has not been reassembled is given up on. */
+		static const int REASSEMBLY_TIMEOUT = 5;
+
+		/** The largest message sent reliably, which must fit in a single datagram along with the channel's header. */
+		static const int MAX_RELIABLE_MESSAGE_SIZE = 65000;
+
+		/** The largest number of peers this object keeps reliable channels to at once */
+		static const int MAX_CHANNELS = 4096;
+
+		/** The largest number of segments the kernel splits a single segmented send into. */
+		static const int MAX_SEGMENTS = 64;
+
+		/** The largest number of bytes in a single segmented send, which must fit in one IP packet before it is split. */
+		static const int MAX_SEGMENTED_SIZE = 65000;
+
+		/** The size of buffer to lease for the next receive, which adapts to the traffic on this object. Datagrams
+		 larger than this are truncated, and grow the receive size for later receives. */
+		size_t receive_size;
+
+		/** The smallest size the receive buffer shrinks to */
+		size_t min_receive_size;
+
+		/** The largest size the receive buffer grows to */
+		size_t max_receive_size;
+
+		/** The number of consecutive datagrams that have used only a small part of the receive buffer */
+		int quiet_receives;
+
+		/** The number of datagrams received */
+		size_t received_datagrams;
+
+		/** The number of datagrams received that filled their buffer, and so may have been truncated */
+		size_t truncated_datagrams;
+
+		/** The number of datagrams the kernel has dropped on the socket because its receive buffer was full, as last
+		 reported with a received datagram */
+		uint32_t kernel_drops;
+
+		/** The number of fragmented messages given up on before all their fragments arrived */
+		size_t incomplete_messages;
+
+		/** A mutex around the receive counters, which are read from the javascript */
+		boost::mutex receive_stats_mutex;
 
 		/** The number of asynchronous I/O requests that are pending completion */
 		int pending_sends;
@@ -194,12 +604,148 @@ class Udp
 		/** If multicast is enabled, this is the TTL or hops */
 		optional<int> multicast_ttl;
 
+		/** If multicast is enabled, whether datagrams sent to a group are looped back to this host */
+		optional<bool> multicast_loop;
+
 		/** Flag to prevent routing, use local interfaces only */
 		optional<bool> do_not_route;
 
 		/** Flag to allow the socket to be bound to an address that is already in use. */
 		optional<bool> reuse_address;
 
+		/** The number of messages after which a batch of data events is fired, if batching */
+		optional<int> batch_size;
+
+		/** The number of microseconds after which a partial batch of data events is fired, if batching */
+		optional<int> batch_delay;
+
+		/** The smallest size in bytes the receive buffer shrinks to, if set */
+		optional<int> min_buffer;
+
+		/** The largest size in bytes the receive buffer grows to, if set */
+		optional<int> max_buffer;
+
+		/** The number of datagrams a server drains from its socket at a time, if set */
+		optional<int> receive_batch;
+
+		/** The number of receives a server keeps in flight, if set */
+		optional<int> pending_receives;
+
+		/** Flag for delivering messages reliably and in order */
+		optional<bool> reliable;
+
+		/** The reliable channel to each peer, when messages are delivered reliably. Only used on the strand. */
+		map<udp::endpoint, boost::shared_ptr<ReliableChannel> > channels;
+
+		/** The size in bytes of the fragments messages are split into, if set */
+		optional<int> fragment;
+
+		/** The size in bytes of the fragments messages are split into, or zero if messages are not fragmented */
+		size_t fragment_size;
+
+		/** The identifier of the last fragmented message sent */
+		boost::detail::atomic_count message_ids;
+
+		/** The messages being reassembled from their fragments. Only used on the strand. */
+		ReassemblyMap reassemblies;
+
+		/** The number of bytes held by the messages being reassembled */
+		size_t reassembly_bytes;
+
+		/** The timer sweeping the messages being reassembled for expiry, which runs while there are any */
+		boost::asio::deadline_timer reassembly_timer;
+
+		/** Whether the reassembly timer is running. Only used on the strand. */
+		bool reassembly_timer_armed;
+
+		/** The size in bytes of the kernel's receive buffer for the socket, if set */
+		optional<int> rcvbuf;
+
+		/** The size in bytes of the kernel's send buffer for the socket, if set */
+		optional<int> sndbuf;
+
+		/** The number of outgoing datagrams sent at a time, if set */
+		optional<int> send_batch;
+
+		/** The number of microseconds after which a partial batch of outgoing datagrams is sent, if set */
+		optional<int> send_delay;
+
+		/** The size in bytes of the datagrams larger sends are segmented into, if set */
+		optional<int> segment_size;
+
+		/** Flag for receiving runs of datagrams coalesced by the kernel, on servers */
+		optional<bool> gro;
+
+		/** The source of timestamps for received datagrams asked for, if any */
+		optional<string> timestamps;
+
+		/** The source of timestamps for received datagrams, which are read through the receive ring */
+		ReceiveTime::Mode timestamp_mode;
+
+		/** The slots into which datagrams are drained, if receiving in batches or reading ancillary data */
+		boost::scoped_ptr<UdpReceiveRing> receive_ring;
+
+		/** Whether clients connect their socket to the remote host, which is the default */
+		optional<bool> connect_socket;
+
+		/** The size in bytes of the datagrams larger sends are segmented into, or zero if sends are not segmented */
+		size_t send_segment_size;
+
+		/**
+		 * A datagram waiting in the send queue
+		 */
+		struct QueuedSend
+		{
+			/** The buffer holding the datagram */
+			SharedBufferPtr data;
+
+			/** The endpoint to which to send the datagram */
+			udp::endpoint endpoint;
+		};
+
+		/** The number of outgoing datagrams sent at a time, or zero if sends are not batched */
+		size_t send_batch_size;
+
+		/** The number of microseconds after which a partial batch of outgoing datagrams is sent */
+		int send_batch_delay;
+
+		/** The datagrams waiting to be sent, when sends are batched */
+		deque<QueuedSend> send_queue;
+
+		/** The batch of datagrams being sent, taken from the front of the send queue. Only used on the strand. */
+		vector<QueuedSend> sending;
+
+		/** The number of datagrams at the front of the batch being sent that have already been sent */
+		size_t sending_offset;
+
+		/** The socket from which queued datagrams are sent */
+		boost::shared_ptr<udp::socket> send_socket;
+
+		/** Whether a flush of the send queue has been posted, or is waiting for the socket to become writable */
+		bool flush_pending;
+
+		/** Whether the timer bounding how long a partial batch may wait is running */
+		bool send_timer_armed;
+
+		/** A mutex around the send queue and the flags above */
+		boost::mutex send_queue_mutex;
+
+		/** The timer bounding how long a partial batch of outgoing datagrams may wait */
+		boost::scoped_ptr<boost::asio::deadline_timer> send_timer;
+
+#if defined(__UNIX__)
+
+		/** The message headers passed to <code>sendmmsg</code>, one per datagram in the batch */
+		vector<struct mmsghdr> send_headers;
+
+		/** The gather vector of each message header, pointing at its datagram */
+		vector<struct iovec> send_vectors;
+
+		/** The ancillary data carrying the segment size of each segmented datagram in the batch */
+		vector<char> send_controls;
+
+#endif
+
 		/** The hostname for this UDP object ('SERVER' for servers, or the hostname of the remote host for clients) */
 		string host;
 
@@ -209,6 +755,14 @@ class Udp
 		/** A connected endpoint to the remote host. */
 		boost::shared_ptr<udp::endpoint> remote_endpoint;
 
+		/** Whether the socket is connected to the remote endpoint, so that datagrams to it are sent, and replies from it
+		 received, without an address */
+		bool connected;
+
+		/** A mutex around the remote endpoint and whether the socket is connected to it, which a client sets once its
+		 host has been resolved, while javascript may already be sending */
+		boost::mutex remote_endpoint_mutex;
+
 		/** A flag to say if this UDP object has permanently failed and cannot continue for some reason or another */
 		bool failed;
 };
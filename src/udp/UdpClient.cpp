@@ -1,8 +1,8 @@
 /* UdpClient.cpp
  *
  * The UDP client can connect to services over udp. This class was intended to be exposed to the javascript.
- * The client currently looks up the host and port everytime a message is sent; the performance hit is currently
- * being measured to see if this information should be cached locally.
+ * The client looks up the host and port once, then connects its socket to the remote host, so that messages are sent
+ * and replies received without per-datagram address handling.
  *
  * Javascript API related to the UDP Client:
  *
@@ -13,8 +13,8 @@
 
 #include "UdpClient.h"
 
-UdpClient::UdpClient(const string &host, int port, boost::asio::io_service & ioService) :
-	Udp(host, port, ioService), resolver(new udp::resolver(io_service)), socket(new udp::socket(io_service)), resolved_endpoint(false)
+UdpClient::UdpClient(const string &host, int port, boost::asio::io_service & ioService, BufferPool & bufferPool) :
+	Udp(host, port, ioService, bufferPool), resolver(new udp::resolver(io_service)), socket(new udp::socket(io_service)), resolved_endpoint(false), resolving(false), listening(false)
 {
 	// Check that the connection and resolver are valid, and fail gracefully if they are not
 	if (!resolver.get() || !socket.get())
@@ -27,8 +27,9 @@ UdpClient::UdpClient(const string &host, int port, boost::asio::io_service & ioS
 	}
 }
 
-UdpClient::UdpClient(const string &host, int port, boost::asio::io_service & ioService, map<string, string> options) :
-	Udp(host, port, ioService), resolver(new udp::resolver(io_service)), socket(new udp::socket(io_service)), resolved_endpoint(false)
+UdpClient::UdpClient(const string &host, int port, boost::asio::io_service & ioService, BufferPool & bufferPool,
+		map<string, string> options) :
+	Udp(host, port, ioService, bufferPool), resolver(new udp::resolver(io_service)), socket(new udp::socket(io_service)), resolved_endpoint(false), resolving(false), listening(false)
 {
 	// Check that the connection and resolver are valid, and fail gracefully if they are not
 	if (!resolver.get() || !socket.get())
@@ -41,6 +42,13 @@ UdpClient::UdpClient(const string &host, int port, boost::asio::io_service & ioS
 	}
 
 	parse_args(options);
+
+	if (batch_size || batch_delay)
+		enable_batching(io_service, batch_size, batch_delay);
+
+	// Timestamps arrive as ancillary data, which only the receive ring reads
+	if (timestamp_mode != ReceiveTime::NONE)
+		receive_ring.reset(new UdpReceiveRing(buffer_pool, (receive_batch && *receive_batch > 1) ? *receive_batch : 1));
 }
 
 void UdpClient::init_socket()
@@ -62,9 +70,22 @@ void UdpClient::init_socket()
 		fire_error(message);
 	}
 
-	// synchronize the buffer size of the socket with this class's buffer size
-	boost::asio::socket_base::receive_buffer_size buf_size_option(BUFFER_SIZE);
-	socket->set_option(buf_size_option);
+	set_socket_buffers(socket);
+	enable_timestamps(socket);
+
+	if (receive_ring)
+	{
+		// Replies are drained with non-blocking receives once the socket is readable
+		boost::system::error_code error_code;
+		socket->non_blocking(true, error_code);
+
+		if (error_code)
+		{
+			Logger::warn("Failed to make UDP client socket non-blocking, replies will not be timestamped: '"
+					+ error_code.message() + "'", port, host);
+			receive_ring.reset();
+		}
+	}
 
 	// set multicast ttl and out going interface
 	if (multicast && *multicast)
@@ -108,6 +129,9 @@ void UdpClient::shutdown()
 {
 	if (!failed)
 	{
+		// Deliver any batch still waiting on its timer before this object goes away
+		flush_batch();
+
 		should_close = true;
 
 		pending_sends_mutex.lock();
@@ -122,36 +146,24 @@ void UdpClient::shutdown()
 	}
 }
 
-void UdpClient::send_bytes(const vector<byte> & bytes)
-{
-	string data;
-
-	for (int i = 0; i < bytes.size(); i++)
-	{
-		data.push_back((unsigned char) bytes[i]);
-	}
-
-	send(data);
-}
-
-void UdpClient::send(const string &msg)
+bool UdpClient::send(const string &msg)
 {
 	if (failed)
 	{
 		// Log & fire an error
 		string message("Trying to send from a UDP client that has permanently failed!");
 		Logger::error(message, port, host);
-		return;
+		return false;
 	}
 
 	if (should_close)
-		return;
+		return false;
 
 	Logger::info("udpclient: sending a msg of size: " + boost::lexical_cast<std::string>(msg.size()) + " which is: " + msg, port, host);
 
-	pending_sends_mutex.lock();
-	pending_sends++;
-	pending_sends_mutex.unlock();
+	// Held while queueing or sending, so that this message can neither overtake queued ones still being flushed, nor
+	// be queued just after the queue was flushed for the last time
+	boost::mutex::scoped_lock lock(send_mtx);
 
 	if (!resolved_endpoint)
 	{
@@ -161,39 +173,55 @@ void UdpClient::send(const string &msg)
 		msgs_not_sent.push(msg);
 		queue_mtx.unlock();
 
+		// The messages queued behind the first are flushed once it resolves
+		if (resolving)
+			return true;
+		resolving = true;
+
 		// Create a query to resolve this host & port
 		if (using_ipv6 && *using_ipv6)
 		{
 			// Asynchronously resolve the remote host, and once the host is resolved, create a connection
 			udp::resolver::query query(udp::v6(), host, boost::lexical_cast<string>(port),
 					boost::asio::ip::resolver_query_base::numeric_service);
-			resolver->async_resolve(query, boost::bind(&UdpClient::resolve_handler, this, _1, _2));
+			resolver->async_resolve(query, strand.wrap(boost::bind(&UdpClient::resolve_handler, this, _1, _2)));
 		}
 		else
 		{
 			// Asynchronously resolve the remote host, and once the host is resolved, create a connection
 			udp::resolver::query query(udp::v4(), host, boost::lexical_cast<string>(port),
 					boost::asio::ip::resolver_query_base::numeric_service);
-			resolver->async_resolve(query, boost::bind(&UdpClient::resolve_handler, this, _1, _2));
+			resolver->async_resolve(query, strand.wrap(boost::bind(&UdpClient::resolve_handler, this, _1, _2)));
 		}
 	}
 	else
 	{
 		flush(); // any pending messages? send them.
+		send_resolved(msg);
+	}
 
-		Logger::info("udpclient: attempting to send " + boost::lexical_cast<string>(msg.size()) + " bytes of data: " + msg, port, host);
+	return true;
+}
 
-		// send the message
-		if (socket->is_open() && remote_endpoint.get())
-		{
-			socket->async_send_to(boost::asio::buffer(msg.data(), msg.size()), *remote_endpoint,
-					boost::bind(&UdpClient::send_handler, this, _1, _2, msg, host, port));
+void UdpClient::send_resolved(const string &msg)
+{
+	Logger::info("udpclient: attempting to send " + boost::lexical_cast<string>(msg.size()) + " bytes of data: " + msg, port, host);
 
-			Logger::info("udpclient: (async) send called", port, host);
+	// send the message
+	if (socket->is_open() && remote_endpoint.get())
+	{
+		send_to(socket, *remote_endpoint, msg);
 
-			if (!should_close)
-				listen(); // listen for responses
-		}
+		Logger::info("udpclient: (async) send called", port, host);
+
+		// Start listening for responses, unless already listening
+		queue_mtx.lock();
+		bool start_listening = !should_close && !listening;
+		listening = true;
+		queue_mtx.unlock();
+
+		if (start_listening)
+			listen();
 	}
 }
 
@@ -206,7 +234,8 @@ void UdpClient::resolve_handler(const boost::system::error_code &err, udp::resol
 		{
 			// If we haven't tried resolving using all resolvers, try with another
 			udp::resolver::query query(host, boost::lexical_cast<string>(port));
-			resolver->async_resolve(query, boost::bind(&UdpClient::resolve_handler, this, _1, endpoint_iterator++));
+			resolver->async_resolve(query, strand.wrap(boost::bind(&UdpClient::resolve_handler, this, _1, endpoint_iterator++)));
+			return;
 		}
 		else
 		{ // We have tried and cannot recover, fail permanently
@@ -215,6 +244,9 @@ void UdpClient::resolve_handler(const boost::system::error_code &err, udp::resol
 			Logger::error(message, port, host);
 			fire_error(message);
 
+			// Let the next send try again
+			boost::mutex::scoped_lock lock(send_mtx);
+			resolving = false;
 			return;
 		}
 	}
@@ -223,13 +255,30 @@ void UdpClient::resolve_handler(const boost::system::error_code &err, udp::resol
 
 	Logger::info("udpclient: resolved, going to send", port, host);
 
-	// We succeeded resolving the endpoint, continue
-	remote_endpoint = boost::make_shared<udp::endpoint>(*endpoint_iterator);
+	// Held while the remote endpoint is set, so that no send sees it half initialized
+	boost::mutex::scoped_lock lock(send_mtx);
+	udp::endpoint endpoint = *endpoint_iterator;
 
 	if (!socket->is_open())
 		init_socket();
 
+	// Connect the socket to the remote host, so that sends skip the address and route lookup, and only its replies are
+	// received. Multicast clients stay unconnected to hear every member of the group.
+	bool is_connected = false;
+	if (!(multicast && *multicast) && !(connect_socket && !*connect_socket))
+	{
+		boost::system::error_code error_code;
+		socket->connect(endpoint, error_code);
+
+		if (error_code)
+			Logger::warn("udpclient: failed to connect the socket, sending unconnected: '" + error_code.message() + "'", port, host);
+		else
+			is_connected = true;
+	}
+
 	// This endpoint has now been initialized
+	set_remote_endpoint(endpoint, is_connected);
+	resolving = false;
 	resolved_endpoint = true;
 
 	flush();
@@ -244,7 +293,7 @@ void UdpClient::flush()
 		string msg = msgs_not_sent.front();
 		msgs_not_sent.pop();
 		queue_mtx.unlock();
-		send(msg);
+		send_resolved(msg);
 		queue_mtx.lock();
 	}
 
@@ -253,11 +302,11 @@ void UdpClient::flush()
 
 void UdpClient::listen()
 {
-	if (remote_endpoint && remote_endpoint.get())
-		socket->async_receive_from(boost::asio::buffer(receive_buffer), *remote_endpoint,
-				boost::bind(&UdpClient::receive_handler, this, _1, _2, socket, remote_endpoint, host, port));
+	// Keep one receive in flight for replies, from the remote endpoint once the socket is connected
+	if (receive_ring)
+		wait_readable(socket);
 	else
-		Logger::warn("remote endpoint is null", port, host);
+		start_receive(socket);
 }
 
 string UdpClient::get_host()
@@ -278,10 +327,10 @@ void UdpClient::fire_error_event(const string & message)
 	fire_error(message);
 }
 
-void UdpClient::fire_data_event(const string data, boost::shared_ptr<udp::socket> socket, boost::shared_ptr<udp::endpoint> endpoint)
+void UdpClient::fire_data_event(SharedBufferPtr data, boost::shared_ptr<udp::socket> socket, boost::shared_ptr<udp::endpoint> endpoint)
 {
 	if (should_close)
 		return;
 
-	fire_data(boost::make_shared<UdpEvent>(this, socket, endpoint, data));
+	dispatch_data(create_event(data, socket, endpoint));
 }
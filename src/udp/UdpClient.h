@@ -30,8 +30,9 @@ class UdpClient: public Udp, public Client
 		 * @param host          The host to connect to
 		 * @param port          The port the host is listening on
 		 * @param io_service	The I/O service to be used for asynchronous I/O requests
+		 * @param buffer_pool	The pool from which buffers for sending data are leased
 		 */
-		UdpClient(const string &host, int port, boost::asio::io_service & io_service);
+		UdpClient(const string &host, int port, boost::asio::io_service & io_service, BufferPool & buffer_pool);
 
 		/**
 		 * Asynchronously resolves the host and port number after creation. The client will not be able to send
@@ -40,9 +41,11 @@ class UdpClient: public Udp, public Client
 		 * @param host          The host to connect to
 		 * @param port          The port the host is listening on
 		 * @param io_service	The I/O service to be used for asynchronous I/O requests
+		 * @param buffer_pool	The pool from which buffers for sending data are leased
 		 * @param options		A map of additional options to configure this UDP client
 		 */
-		UdpClient(const string &host, int port, boost::asio::io_service & io_service, map<string, string> options);
+		UdpClient(const string &host, int port, boost::asio::io_service & io_service, BufferPool & buffer_pool,
+				map<string, string> options);
 
 		/**
 		 * Deconstructs a UDP client, immediately calling <code>close</code> to shutdown this client's socket and stop
@@ -54,15 +57,9 @@ class UdpClient: public Udp, public Client
 		 * Asynchronously sends data to the remote host to which this client is connected.
 		 *
 		 * 	@param	data	The data to send across the wire
+		 * 	@return	False if the data could not be sent, and true otherwise
 		 */
-		virtual void send(const string & data);
-
-		/**
-		 * Asynchronously sends bytes to the remote host to which this client is connected.
-		 *
-		 * 	@param	bytes	The data to send across the wire
-		 */
-		virtual void send_bytes(const vector<byte> & bytes);
+		virtual bool send(const string & data);
 
 		/**
 		 * Gracefully shutdown this UDP client, waiting until all sends have completed before freeing all resources for
@@ -97,11 +94,11 @@ class UdpClient: public Udp, public Client
 		/**
 		 * Helper to fire data event to javascript.
 		 *
-		 * 	@param	data	The data received
+		 * 	@param	data	The buffer holding the data received, which the event shares
 		 * 	@param	socket	The socket on which to reply to this data
 		 * 	@param	endpoint The connected endpoint to the remote host
 		 */
-		virtual void fire_data_event(const string data, boost::shared_ptr<udp::socket> socket,
+		virtual void fire_data_event(SharedBufferPtr data, boost::shared_ptr<udp::socket> socket,
 				boost::shared_ptr<udp::endpoint> endpoint);
 
 		/**
@@ -134,10 +131,17 @@ class UdpClient: public Udp, public Client
 		void resolve_handler(const boost::system::error_code &err, udp::resolver::iterator endpoint_iterator);
 
         /**
-         * Flush all pending messages.
+         * Flush all pending messages, in the order they were sent. Must be called holding <code>send_mtx</code>.
          */
         void flush();
 
+		/**
+		 * Sends a message to the resolved remote endpoint, and starts listening for responses if not already listening.
+		 *
+		 * 	@param	msg	The message to send
+		 */
+		void send_resolved(const string & msg);
+
 		/**
 		 * Resolver object provided by <code>boost</code> to resolve the remote hostname and port
 		 */
@@ -153,6 +157,11 @@ class UdpClient: public Udp, public Client
          */
         boost::mutex queue_mtx;
 
+        /**
+         * Mutex ordering sends from javascript against the flush of the messages queued while resolving.
+         */
+        boost::mutex send_mtx;
+
         /**
          * Messages waiting to be sent, since the host hasn't been resolved yet.
          */
@@ -162,6 +171,18 @@ class UdpClient: public Udp, public Client
 		 * A flag representing whether the remote host for this UDP client has already been resolved.
 		 */
 		bool resolved_endpoint;
+
+		/**
+		 * A flag representing whether the remote host is being resolved, so that it is only looked up once however
+		 * 	many messages are sent before it resolves. Guarded by <code>send_mtx</code>.
+		 */
+		bool resolving;
+
+		/**
+		 * A flag representing whether this client has started listening for responses. Once started, each receive
+		 * 	starts the next, so that exactly one receive into the receive buffer is in flight at a time.
+		 */
+		bool listening;
 };
 
 #endif
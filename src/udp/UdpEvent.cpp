@@ -7,95 +7,105 @@
 
 #include "UdpEvent.h"
 
-UdpEvent::UdpEvent(Udp * _udp_object, boost::shared_ptr<udp::socket> _socket, boost::shared_ptr<udp::endpoint> _endpoint, string _data) :
-	port(-1), socket(_socket), endpoint(_endpoint), udp_object(_udp_object), failed(false), data(_data)
+UdpEvent::UdpEvent() :
+	failed(true), udp_object(0)
 {
-	// Check to see if any the parameters are null, and log and fail if this occurs
-	if (endpoint && udp_object)
+	registerMethod("getDestination", make_method(this, &UdpEvent::get_destination));
+}
+
+void UdpEvent::assign(Udp * _udp_object, boost::shared_ptr<udp::socket> _socket, boost::shared_ptr<udp::endpoint> _endpoint,
+		SharedBufferPtr _data)
+{
+	udp_object = _udp_object;
+	socket = _socket;
+	endpoint = _endpoint;
+	data = _data;
+	failed = false;
+
+	if (data)
 	{
-		// Initialize only if it's safe
-		host = boost::lexical_cast<string>(endpoint->address());
-		port = endpoint->port();
+		receive_time = data->get_receive_time();
+		destination = data->get_destination();
 	}
-	else
+
+	// Check to see if any the parameters are null, and log and fail if this occurs
+	if (!endpoint || !udp_object)
 	{
 		// Fail permanently and log it
 		failed = true;
 
 		string message("UDP Event was not properly initialized, permanently failed.");
-		Logger::error(message, port, host);
+		Logger::error(message, get_port(), get_host());
 		fire_error(message);
 	}
 }
 
-UdpEvent::~UdpEvent()
+void UdpEvent::recycle()
 {
-	// do not free socket, endpoint or udp here
+	udp_object = 0;
+	socket.reset();
+	endpoint.reset();
+	destination = boost::asio::ip::address();
+	failed = true;
+
+	Event::recycle();
 }
 
-void UdpEvent::send_bytes(const vector<byte> & bytes)
+UdpEvent::~UdpEvent()
 {
-    string data;
-
-    for (int i = 0; i < bytes.size(); i++)
-    {
-        data.push_back((unsigned char) bytes[i]);
-    }
-
-	send(data);
+	// do not free socket, endpoint or udp here
 }
 
-void UdpEvent::send(const string & data)
+bool UdpEvent::send(const string & data)
 {
 	// Don't send if we've permanently failed
 	if (failed)
 	{
 		string message("UDP event failed to send, Event already failed permanently");
-		Logger::error(message, port, host);
+		Logger::error(message, get_port(), get_host());
 		fire_error(message);
-        return;
+        return false;
     }
 
 	if (udp_object && udp_object->failed)
 	{
 		// Log & fire an error
 		string message("UDP event failed trying to reply to a UDP object that has permanently failed!");
-		Logger::error(message, port, host);
+		Logger::error(message, get_port(), get_host());
 		fire_error(message);
-        return;
+        return false;
 	}
 
 	if (socket && endpoint)
 	{
-		udp_object->pending_sends++;
-		socket->async_send_to(boost::asio::buffer(data.data(), data.size()), *endpoint, 
-                boost::bind(&Udp::send_handler, udp_object, _1, _2, data, host, endpoint->port()));
+		udp_object->send_to(socket, *endpoint, data);
+		return true;
 	}
-}
 
-string UdpEvent::read() const
-{
-	return data;
+	return false;
 }
 
-FB::VariantList UdpEvent::read_bytes() const
+string UdpEvent::get_host(void)
 {
-	FB::VariantList fb_bytes;
-
-    for (int i = 0; i < data.size(); i++)
-    {
-        fb_bytes.push_back((unsigned char) (data.data())[i]);
-    }
+	// Formatted only when asked for, rather than for every datagram received
+	if (!endpoint)
+		return string();
 
-	return fb_bytes;
+	return endpoint->address().to_string();
 }
 
-string UdpEvent::get_host(void)
+unsigned short UdpEvent::get_port(void)
 {
-	return host;
+	if (!endpoint)
+		return 0;
+
+	return endpoint->port();
 }
 
-unsigned short UdpEvent::get_port(void)
+string UdpEvent::get_destination(void)
 {
-	return port;
+	if (destination.is_unspecified())
+		return string();
+
+	return destination.to_string();
 }
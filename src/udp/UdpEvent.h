@@ -9,6 +9,7 @@
 #define	UDPREPLIER_H
 
 #include "Event.h"
+#include "SharedBuffer.h"
 #include "Udp.h"
 
 using boost::asio::ip::udp;
@@ -23,48 +24,39 @@ class UdpEvent : public Event
 	public:
 
 		/**
-		 * Constructs a new <code>UdpEvent</code> object containing the UDP connection on which to reply.
+		 * Constructs an unassigned <code>UdpEvent</code> object, registering its javascript API. Events are taken from
+		 * 	the pool of their UDP object, and assigned to each message received.
+		 */
+		UdpEvent();
+
+		/**
+		 * Assigns this event to data received on a UDP socket, on which to reply.
 		 *
 		 * 	@param	udp			The UDP server or client associated with this event
 		 * 	@param	socket		The UDP connection on which to reply
 		 * 	@param	endpoint	The remote endpoint for this UDP event, from which we can find information about
 		 * 						the remote host
-		 * 	@param	data		The data this event was fired from
+		 * 	@param	data		The buffer holding the data this event was fired from, and the address it was sent to
 		 */
-		UdpEvent(Udp * udp, boost::shared_ptr<udp::socket> socket, boost::shared_ptr<udp::endpoint> endpoint, string data);
+		void assign(Udp * udp, boost::shared_ptr<udp::socket> socket, boost::shared_ptr<udp::endpoint> endpoint, SharedBufferPtr data);
 
 		/**
-		 *  Deconstructs the UDP event object, after a single reply.
+		 * Drops the socket, endpoint and data this event was assigned, so that it can be reused.
 		 */
-		virtual ~UdpEvent();
+		virtual void recycle();
 
 		/**
-		 * Replies on the UDP connection with some data.
-		 *
-		 *	@param	data	The data with which to reply
+		 *  Deconstructs the UDP event object, after a single reply.
 		 */
-		virtual void send(const string & data);
+		virtual ~UdpEvent();
 
 		/**
 		 * Replies on the UDP connection with some data.
 		 *
-		 *	@param	bytes	The bytes of data with which to reply
-		 */
-		virtual void send_bytes(const vector<byte> & bytes);
-
-		/**
-		 * Reads the string data that belongs to this event.
-		 *
-		 * 	@return	The string data received when this event was fired
-		 */
-		virtual string read() const;
-
-		/**
-		 * Reads the byte data that belongs to this event
-		 *
-		 * 	@return	The byte data received when this event was fired
+		 *	@param	data	The data with which to reply
+		 * 	@return	False if the data could not be sent, and true otherwise
 		 */
-		virtual FB::VariantList read_bytes() const;
+		virtual bool send(const string & data);
 
 		/**
 		 * Gets the hostname of the remote endpoint of the UDP connection for this <code>UdpEvent</code>.
@@ -80,28 +72,21 @@ class UdpEvent : public Event
 		 */
 		virtual unsigned short get_port();
 
-	private:
-
 		/**
-		 * The data received when this event was fired
+		 * Gets the address the data for this event was sent to, which for multicast data is the group it was sent to.
+		 * 	Exposed to javascript as 'getDestination'.
+		 *
+		 * 	@return	The destination address, or an empty string if it is not known
 		 */
-		string data;
+		string get_destination();
+
+	private:
 
 		/**
 		 * A flag to prevent this event from blowing up if was initialized improperly
 		 */
 		bool failed;
 
-		/**
-		 * The remote hostname of the UDP connection for this <code>UdpEvent</code>
-		 */
-		string host;
-
-		/**
-		 * The remote port of the UDP connection for this <code>UdpEvent</code>
-		 */
-        int port;
-
 		/**
 		 * The socket corresponding to this UDP 'connection', on which to reply
 		 */
@@ -112,6 +97,11 @@ class UdpEvent : public Event
 		 */
         boost::shared_ptr<udp::endpoint> endpoint;
 
+		/**
+		 * The address the data for this event was sent to, or the unspecified address
+		 */
+		boost::asio::ip::address destination;
+
 		/**
 		 * The UDP server or client associated with this event
 		 */
@@ -0,0 +1,181 @@
+/*
+ * UdpReceiveRing.cpp
+ *
+ *  Created on: Oct 17, 2026
+ */
+
+#include "UdpReceiveRing.h"
+
+#include <string.h>
+
+UdpReceiveRing::UdpReceiveRing(BufferPool & buffer_pool, size_t slots) :
+	buffer_pool(buffer_pool), buffers(slots), endpoints(slots), lengths(slots), truncated(slots), segment_sizes(slots), receive_times(slots), destinations(slots), drops(0)
+#if defined(__UNIX__)
+	, headers(slots), vectors(slots), controls(slots * CONTROL_SIZE)
+#endif
+{
+}
+
+size_t UdpReceiveRing::receive(udp::socket & socket, size_t slot_size, boost::system::error_code & error_code)
+{
+	// Give every slot whose datagram was taken, or whose buffer no longer matches the receive size, a new buffer
+	for (size_t i = 0; i < buffers.size(); i++)
+	{
+		if (!buffers[i] || buffers[i]->capacity() != slot_size)
+			buffers[i] = SharedBuffer::create(buffer_pool, slot_size);
+	}
+
+	error_code = boost::system::error_code();
+
+#if defined(__UNIX__)
+
+	for (size_t i = 0; i < buffers.size(); i++)
+	{
+		vectors[i].iov_base = buffers[i]->data();
+		vectors[i].iov_len = buffers[i]->capacity();
+
+		memset(&headers[i], 0, sizeof(struct mmsghdr));
+		headers[i].msg_hdr.msg_name = endpoints[i].data();
+		headers[i].msg_hdr.msg_namelen = endpoints[i].capacity();
+		headers[i].msg_hdr.msg_iov = &vectors[i];
+		headers[i].msg_hdr.msg_iovlen = 1;
+		headers[i].msg_hdr.msg_control = &controls[i * CONTROL_SIZE];
+		headers[i].msg_hdr.msg_controllen = CONTROL_SIZE;
+	}
+
+	int received = recvmmsg(socket.native_handle(), &headers[0], headers.size(), MSG_DONTWAIT, NULL);
+
+	if (received < 0)
+	{
+		error_code = boost::system::error_code(errno, boost::asio::error::get_system_category());
+		return 0;
+	}
+
+	for (int i = 0; i < received; i++)
+	{
+		endpoints[i].resize(headers[i].msg_hdr.msg_namelen);
+		lengths[i] = headers[i].msg_len;
+		truncated[i] = (headers[i].msg_hdr.msg_flags & MSG_TRUNC) || lengths[i] == buffers[i]->capacity();
+		segment_sizes[i] = 0;
+		receive_times[i] = ReceiveTime::from_control(&headers[i].msg_hdr);
+		destinations[i] = boost::asio::ip::address();
+
+		for (struct cmsghdr * control = CMSG_FIRSTHDR(&headers[i].msg_hdr); control != NULL;
+				control = CMSG_NXTHDR(&headers[i].msg_hdr, control))
+		{
+#if defined(UDP_GRO)
+			if (control->cmsg_level == SOL_UDP && control->cmsg_type == UDP_GRO)
+			{
+				int segment_size;
+				memcpy(&segment_size, CMSG_DATA(control), sizeof(int));
+				segment_sizes[i] = segment_size;
+			}
+#endif
+#if defined(SO_RXQ_OVFL)
+			if (control->cmsg_level == SOL_SOCKET && control->cmsg_type == SO_RXQ_OVFL)
+				memcpy(&drops, CMSG_DATA(control), sizeof(uint32_t));
+#endif
+#if defined(IP_PKTINFO)
+			if (control->cmsg_level == IPPROTO_IP && control->cmsg_type == IP_PKTINFO)
+			{
+				struct in_pktinfo info;
+				memcpy(&info, CMSG_DATA(control), sizeof(struct in_pktinfo));
+				destinations[i] = boost::asio::ip::address_v4(ntohl(info.ipi_addr.s_addr));
+			}
+#endif
+#if defined(IPV6_PKTINFO)
+			if (control->cmsg_level == IPPROTO_IPV6 && control->cmsg_type == IPV6_PKTINFO)
+			{
+				struct in6_pktinfo info;
+				memcpy(&info, CMSG_DATA(control), sizeof(struct in6_pktinfo));
+
+				boost::asio::ip::address_v6::bytes_type bytes;
+				memcpy(bytes.data(), &info.ipi6_addr, bytes.size());
+				destinations[i] = boost::asio::ip::address_v6(bytes);
+			}
+#endif
+		}
+	}
+
+	return received;
+
+#else
+
+	// Without recvmmsg, drain the socket one non-blocking receive at a time
+	size_t received = 0;
+
+	while (received < buffers.size())
+	{
+		boost::system::error_code receive_error;
+		size_t bytes = socket.receive_from(boost::asio::buffer(buffers[received]->data(), buffers[received]->capacity()),
+				endpoints[received], 0, receive_error);
+
+		if (receive_error == boost::asio::error::message_size)
+		{
+			bytes = buffers[received]->capacity();
+		}
+		else if (receive_error)
+		{
+			// Report the error only if nothing was received before it
+			if (received == 0)
+				error_code = receive_error;
+			break;
+		}
+
+		lengths[received] = bytes;
+		truncated[received] = bytes == buffers[received]->capacity();
+		segment_sizes[received] = 0;
+		receive_times[received] = 0;
+		destinations[received] = boost::asio::ip::address();
+		received++;
+	}
+
+	return received;
+
+#endif
+}
+
+SharedBufferPtr UdpReceiveRing::take(size_t index)
+{
+	SharedBufferPtr data;
+
+	data.swap(buffers[index]);
+	data->set_size(lengths[index]);
+
+	return data;
+}
+
+const udp::endpoint & UdpReceiveRing::get_endpoint(size_t index) const
+{
+	return endpoints[index];
+}
+
+bool UdpReceiveRing::filled(size_t index) const
+{
+	return truncated[index];
+}
+
+size_t UdpReceiveRing::get_segment_size(size_t index) const
+{
+	return segment_sizes[index];
+}
+
+boost::int64_t UdpReceiveRing::get_receive_time(size_t index) const
+{
+	return receive_times[index];
+}
+
+const boost::asio::ip::address & UdpReceiveRing::get_destination(size_t index) const
+{
+	return destinations[index];
+}
+
+uint32_t UdpReceiveRing::get_drops() const
+{
+	return drops;
+}
+
+size_t UdpReceiveRing::get_slots() const
+{
+	return buffers.size();
+}
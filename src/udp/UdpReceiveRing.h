@@ -0,0 +1,176 @@
+/*
+ * UdpReceiveRing.h
+ *
+ *  Created on: Oct 17, 2026
+ */
+
+#ifndef UDPRECEIVERING_H_
+#define UDPRECEIVERING_H_
+
+#include <boost/asio.hpp>
+
+#include <vector>
+
+#if defined(__UNIX__)
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#include <errno.h>
+
+#endif
+
+#include "SharedBuffer.h"
+#include "ReceiveTime.h"
+
+using boost::asio::ip::udp;
+using std::vector;
+
+/**
+ * A ring of pooled receive slots, into which a batch of datagrams is drained from a socket in a single call. On *n*x
+ * 	the batch is read with one <code>recvmmsg</code> system call, and elsewhere with consecutive non-blocking receives.
+ * 	The socket must be in non-blocking mode. A slot keeps its buffer until the datagram received into it is taken, so
+ * 	slots left empty by a short batch are reused by the next without leasing again.
+ */
+class UdpReceiveRing
+{
+	public:
+
+		/**
+		 * Builds a ring of empty receive slots.
+		 *
+		 * 	@param	buffer_pool	The pool from which the slots' buffers are leased
+		 * 	@param	slots		The largest number of datagrams to receive in one batch
+		 */
+		UdpReceiveRing(BufferPool & buffer_pool, size_t slots);
+
+		/**
+		 * Receives as many datagrams as are waiting on the socket, up to the number of slots, without blocking. Any slot
+		 * 	without a buffer of the given size is given one first.
+		 *
+		 * 	@param	socket		The non-blocking socket from which to receive
+		 * 	@param	slot_size	The size of buffer each datagram is received into
+		 * 	@param	error_code	Set to the error encountered if no datagram could be received, which is
+		 * 						<code>would_block</code> if none were waiting
+		 * 	@return	The number of datagrams received into the first slots of the ring, or zero on error
+		 */
+		size_t receive(udp::socket & socket, size_t slot_size, boost::system::error_code & error_code);
+
+		/**
+		 * Takes the datagram received into a slot, leaving the slot to lease a new buffer on the next receive.
+		 *
+		 * 	@param	index	The slot to take, which must be one of those filled by the last receive
+		 * 	@return	The buffer holding the datagram
+		 */
+		SharedBufferPtr take(size_t index);
+
+		/**
+		 * Gets the endpoint a datagram received into a slot was sent from.
+		 *
+		 * 	@param	index	The slot, which must be one of those filled by the last receive
+		 * 	@return	The sender of the datagram
+		 */
+		const udp::endpoint & get_endpoint(size_t index) const;
+
+		/**
+		 * Gets whether a datagram received into a slot filled its buffer, and so may have been truncated.
+		 *
+		 * 	@param	index	The slot, which must be one of those filled by the last receive
+		 * 	@return	True if the datagram filled the slot's buffer
+		 */
+		bool filled(size_t index) const;
+
+		/**
+		 * Gets the size of the segments a datagram received into a slot was coalesced from, when generic receive
+		 * 	offload is enabled on the socket.
+		 *
+		 * 	@param	index	The slot, which must be one of those filled by the last receive
+		 * 	@return	The size of every segment but the last, or zero if the datagram was not coalesced
+		 */
+		size_t get_segment_size(size_t index) const;
+
+		/**
+		 * Gets the time a datagram received into a slot arrived, when the kernel has been asked to timestamp the
+		 * 	socket's datagrams.
+		 *
+		 * 	@param	index	The slot, which must be one of those filled by the last receive
+		 * 	@return	The number of nanoseconds since the Unix epoch, or zero if the datagram was not timestamped
+		 */
+		boost::int64_t get_receive_time(size_t index) const;
+
+		/**
+		 * Gets the address a datagram received into a slot was sent to, when the kernel has been asked to report it
+		 * 	with <code>IP_PKTINFO</code> or <code>IPV6_RECVPKTINFO</code>. For multicast datagrams, this is the group.
+		 *
+		 * 	@param	index	The slot, which must be one of those filled by the last receive
+		 * 	@return	The destination address of the datagram, or the unspecified address if it was not reported
+		 */
+		const boost::asio::ip::address & get_destination(size_t index) const;
+
+		/**
+		 * Gets the number of datagrams the kernel has dropped on the socket because its receive buffer was full, as
+		 * 	last reported with a received datagram. Drops are only reported once enabled with <code>SO_RXQ_OVFL</code>.
+		 *
+		 * 	@return	The number of datagrams dropped since the socket was opened
+		 */
+		uint32_t get_drops() const;
+
+		/**
+		 * Gets the number of slots in this ring.
+		 */
+		size_t get_slots() const;
+
+	private:
+
+		/**
+		 * Disallows copying a receive ring.
+		 */
+		UdpReceiveRing(const UdpReceiveRing &other);
+
+		/** The pool from which the slots' buffers are leased */
+		BufferPool & buffer_pool;
+
+		/** The buffer of each slot, empty once its datagram has been taken */
+		vector<SharedBufferPtr> buffers;
+
+		/** The sender of the datagram in each slot */
+		vector<udp::endpoint> endpoints;
+
+		/** The size of the datagram in each slot */
+		vector<size_t> lengths;
+
+		/** Whether the datagram in each slot filled its buffer */
+		vector<bool> truncated;
+
+		/** The size of the segments the datagram in each slot was coalesced from, or zero */
+		vector<size_t> segment_sizes;
+
+		/** The time the datagram in each slot arrived, or zero */
+		vector<boost::int64_t> receive_times;
+
+		/** The address the datagram in each slot was sent to, or the unspecified address */
+		vector<boost::asio::ip::address> destinations;
+
+		/** The number of datagrams dropped by the kernel, as last reported */
+		uint32_t drops;
+
+#if defined(__UNIX__)
+
+		/** The message headers passed to <code>recvmmsg</code>, one per slot */
+		vector<struct mmsghdr> headers;
+
+		/** The scatter vector of each message header, pointing at its slot's buffer */
+		vector<struct iovec> vectors;
+
+		/** The ancillary data received with each slot's datagram, <code>CONTROL_SIZE</code> bytes per slot */
+		vector<char> controls;
+
+		/** The room for ancillary data given to each slot */
+		static const size_t CONTROL_SIZE = 256;
+
+#endif
+};
+
+#endif /* UDPRECEIVERING_H_ */
@@ -7,20 +7,29 @@
 
 #include "UdpServer.h"
 
+#include <boost/algorithm/string.hpp>
 
-UdpServer::UdpServer(int port, boost::asio::io_service & io_service) 
-    : Udp("SERVER", port, io_service), socket(new udp::socket(io_service))
+#include <string.h>
+
+
+UdpServer::UdpServer(int port, boost::asio::io_service & io_service, BufferPool & buffer_pool) 
+    : Udp("SERVER", port, io_service, buffer_pool), socket(new udp::socket(io_service)), counting_drops(false), reporting_destinations(false)
 {
 	initialize();
+	init_receive_ring();
 }
 
 
-UdpServer::UdpServer(int port, boost::asio::io_service & io_service, map<string, string> options) 
-    : Udp("SERVER", port, io_service), socket(new udp::socket(io_service))
+UdpServer::UdpServer(int port, boost::asio::io_service & io_service, BufferPool & buffer_pool, map<string, string> options) 
+    : Udp("SERVER", port, io_service, buffer_pool), socket(new udp::socket(io_service)), counting_drops(false), reporting_destinations(false)
 {
     parse_args(options);
 
+	if (batch_size || batch_delay)
+		enable_batching(io_service, batch_size, batch_delay);
+
 	initialize();
+	init_receive_ring();
 }
 
 
@@ -28,6 +37,9 @@ void UdpServer::shutdown()
 {
 	if(!failed)
 	{
+		// Deliver any batch still waiting on its timer before this object goes away
+		flush_batch();
+
 		should_close = true;
 
 		if (pending_sends == 0) {
@@ -82,9 +94,7 @@ void UdpServer::initialize()
     	fire_error(message);
     }
 
-	// synchronize the buffer size of the socket with this class's buffer size
-	boost::asio::socket_base::receive_buffer_size buf_size_option(BUFFER_SIZE);
-	socket->set_option(buf_size_option);
+	set_socket_buffers(socket);
 
     if(do_not_route)
     {
@@ -92,6 +102,19 @@ void UdpServer::initialize()
 		socket->set_option(option);
     }
 
+	enable_timestamps(socket);
+
+	if (gro && *gro)
+	{
+#if defined(__UNIX__) && defined(UDP_GRO)
+		int on = 1;
+		if (setsockopt(socket->native_handle(), SOL_UDP, UDP_GRO, (void*) &on, sizeof(int)))
+			Logger::warn("Failed to enable GRO on UDP server socket, datagrams are received one at a time", port, host);
+#else
+		Logger::warn("GRO is not supported on this platform, datagrams are received one at a time", port, host);
+#endif
+	}
+
     if(reuse_address)
     {
         boost::asio::socket_base::reuse_address option(*reuse_address);
@@ -111,8 +134,56 @@ void UdpServer::initialize()
         socket->set_option(option);
     }
 
+	if (multicast_loop)
+		set_multicast_loopback(*multicast_loop);
+
+	if (multicast && *multicast)
+		report_destinations();
+
 	// register these methods so they can be invoked from the Javascript
 	registerMethod("listen", make_method(this, &UdpServer::start_listening));
+	registerMethod("getReceiveStats", make_method(this, &UdpServer::get_receive_stats));
+	registerMethod("joinGroup", make_method(this, &UdpServer::join_group));
+	registerMethod("leaveGroup", make_method(this, &UdpServer::leave_group));
+	registerMethod("joinSourceGroup", make_method(this, &UdpServer::join_source_group));
+	registerMethod("leaveSourceGroup", make_method(this, &UdpServer::leave_source_group));
+	registerMethod("setMulticastLoopback", make_method(this, &UdpServer::set_multicast_loopback));
+}
+
+
+void UdpServer::init_receive_ring()
+{
+#if defined(__UNIX__) && defined(SO_RXQ_OVFL)
+	// Have the kernel report how many datagrams it has dropped along with the datagrams received
+	int on = 1;
+	if (setsockopt(socket->native_handle(), SOL_SOCKET, SO_RXQ_OVFL, (void*) &on, sizeof(int)))
+		Logger::warn("Failed to enable drop accounting on UDP server socket", port, host);
+	else
+		counting_drops = true;
+#endif
+
+	int slots = (receive_batch && *receive_batch > 1) ? *receive_batch : 1;
+
+	if (gro && *gro)
+	{
+		// Coalesced datagrams are received whole, into buffers as large as a datagram can be, and through the receive
+		// ring, which reads the size of their segments
+		max_receive_size = std::max(max_receive_size, (size_t) MAX_BUFFER_SIZE);
+		min_receive_size = receive_size = max_receive_size;
+
+		receive_ring.reset(new UdpReceiveRing(buffer_pool, slots));
+	}
+	else if (slots > 1 || timestamp_mode != ReceiveTime::NONE || (multicast && *multicast))
+	{
+		// Timestamps and the groups datagrams were sent to arrive as ancillary data, which only the receive ring reads
+		receive_ring.reset(new UdpReceiveRing(buffer_pool, slots));
+	}
+	else if (counting_drops && !(pending_receives && *pending_receives > 1))
+	{
+		// So do the drop counts, so receive through a ring of a single slot, unless several receives were asked to
+		// be kept pending on the socket instead
+		receive_ring.reset(new UdpReceiveRing(buffer_pool, 1));
+	}
 }
 
 
@@ -154,6 +225,23 @@ void UdpServer::start_listening()
 
 	Logger::info("bind!", port, host);
 
+	if (receive_ring)
+	{
+		// Batches are drained with non-blocking receives once the socket is readable
+		boost::system::error_code error_code;
+		socket->non_blocking(true, error_code);
+
+		if (error_code)
+		{
+			string message("Failed to make UDP server socket non-blocking: '" + error_code.message() + "'");
+			Logger::error(message, port, host);
+			fire_error(message);
+
+			failed = true;
+			return;
+		}
+	}
+
 	if(multicast)
 	{
 		if(!multicast_group)
@@ -162,40 +250,223 @@ void UdpServer::start_listening()
         }
 		else
         {
-			// Try to join the multicast group, and fail gracefully if we can't join it
-			try
+			// Try to join each of the multicast groups, and fail gracefully if we can't join one
+			vector<string> groups;
+			boost::split(groups, *multicast_group, boost::is_any_of(","));
+
+			for (size_t i = 0; i < groups.size(); i++)
 			{
-				socket->set_option(boost::asio::ip::multicast::join_group(
-							boost::asio::ip::address::from_string(*multicast_group)));
+				if (!groups[i].empty() && !change_membership(groups[i], string(), true))
+				{
+					failed = true;
+					return;
+				}
 			}
-		    catch(boost::system::system_error & error)
-		    {
-			    // Catch this error, and fail gracefully
-			    string message(string("Caught error initializing UDP joinging multicast group: '") + error.what() + "'");
-			    Logger::error(message, port, host);
-
-			    failed = true;
-			    return;
-		    }
         }
 	}
 
-	listen();
+	// Keep as many receives in flight as asked for, each of which is replaced as it completes. A receive ring is
+	// drained on readiness instead, so needs only the one.
+	int receives = 1;
+	if (!receive_ring && pending_receives && *pending_receives > 1)
+		receives = *pending_receives;
+
+	for (int i = 0; i < receives; i++)
+		listen();
 	fire_open();
 
 	listening = true;
 }
 
 
+void UdpServer::report_destinations()
+{
+	if (reporting_destinations)
+		return;
+
+	// Have the kernel report the group each datagram was sent to, so one socket can serve many groups
+#if defined(__UNIX__) && defined(IP_PKTINFO) && defined(IPV6_RECVPKTINFO)
+	int on = 1;
+	int result = (using_ipv6 && *using_ipv6)
+			? setsockopt(socket->native_handle(), IPPROTO_IPV6, IPV6_RECVPKTINFO, (void*) &on, sizeof(int))
+			: setsockopt(socket->native_handle(), IPPROTO_IP, IP_PKTINFO, (void*) &on, sizeof(int));
+	if (result)
+	{
+		Logger::warn("Failed to enable destination reporting on UDP server socket, events will not report their group", port, host);
+		return;
+	}
+
+	reporting_destinations = true;
+#else
+	Logger::warn("Destination reporting is not supported on this platform, events will not report their group", port, host);
+#endif
+}
+
+
+void UdpServer::use_receive_ring()
+{
+	if (receive_ring)
+		return;
+
+	// Make the socket non-blocking for the ring to drain, as start_listening does before the first receive
+	boost::system::error_code error_code;
+	socket->non_blocking(true, error_code);
+
+	if (error_code)
+	{
+		Logger::warn("Failed to make UDP server socket non-blocking, events will not report their group: '"
+				+ error_code.message() + "'", port, host);
+		return;
+	}
+
+	// The receives already pending complete as before, then are replaced with waits on the ring
+	receive_stats_mutex.lock();
+	receive_ring.reset(new UdpReceiveRing(buffer_pool, 1));
+	receive_stats_mutex.unlock();
+}
+
+
 void UdpServer::listen()
 {
 	Logger::info("udpserver: starting to listen", port, host);
 
-    if(remote_endpoint && remote_endpoint.get())
-        socket->async_receive_from(boost::asio::buffer(receive_buffer), *remote_endpoint,
-                boost::bind(&UdpServer::receive_handler, this, _1, _2, socket, remote_endpoint, host, port));
-    else
-        Logger::warn("remote endpoint is null", port, host);
+	if (receive_ring)
+	{
+		wait_readable(socket);
+		return;
+	}
+
+	start_receive(socket);
+}
+
+bool UdpServer::join_group(const string & group)
+{
+	return change_membership(group, string(), true);
+}
+
+bool UdpServer::leave_group(const string & group)
+{
+	return change_membership(group, string(), false);
+}
+
+bool UdpServer::join_source_group(const string & group, const string & source)
+{
+	return change_membership(group, source, true);
+}
+
+bool UdpServer::leave_source_group(const string & group, const string & source)
+{
+	return change_membership(group, source, false);
+}
+
+void UdpServer::set_multicast_loopback(bool loopback)
+{
+	boost::system::error_code error_code;
+	socket->set_option(boost::asio::ip::multicast::enable_loopback(loopback), error_code);
+
+	if (error_code)
+	{
+		string message("Failed to set multicast loopback on UDP server socket: '" + error_code.message() + "'");
+		Logger::error(message, port, host);
+		fire_error(message);
+	}
+}
+
+bool UdpServer::change_membership(const string & group, const string & source, bool join)
+{
+	string action(join ? "join" : "leave");
+	boost::system::error_code error_code;
+
+	boost::asio::ip::address group_address = boost::asio::ip::address::from_string(group, error_code);
+	if (error_code || !group_address.is_multicast())
+	{
+		string message("Failed to " + action + " multicast group '" + group + "', it is not a multicast address");
+		Logger::error(message, port, host);
+		fire_error(message);
+		return false;
+	}
+
+	if (source.empty())
+	{
+		if (join)
+			socket->set_option(boost::asio::ip::multicast::join_group(group_address), error_code);
+		else
+			socket->set_option(boost::asio::ip::multicast::leave_group(group_address), error_code);
+	}
+	else
+	{
+		boost::asio::ip::address source_address = boost::asio::ip::address::from_string(source, error_code);
+		if (error_code || source_address.is_v6() != group_address.is_v6())
+		{
+			string message("Failed to " + action + " multicast group '" + group + "', source '" + source + "' is not an address "
+					"of the same family");
+			Logger::error(message, port, host);
+			fire_error(message);
+			return false;
+		}
+
+#if defined(__UNIX__) && defined(MCAST_JOIN_SOURCE_GROUP)
+		// The protocol-independent request covers both IPv4 and IPv6 groups
+		struct group_source_req request;
+		memset(&request, 0, sizeof(struct group_source_req));
+
+		udp::endpoint group_endpoint(group_address, 0);
+		udp::endpoint source_endpoint(source_address, 0);
+		memcpy(&request.gsr_group, group_endpoint.data(), group_endpoint.size());
+		memcpy(&request.gsr_source, source_endpoint.data(), source_endpoint.size());
+
+		int level = group_address.is_v6() ? IPPROTO_IPV6 : IPPROTO_IP;
+		if (setsockopt(socket->native_handle(), level, join ? MCAST_JOIN_SOURCE_GROUP : MCAST_LEAVE_SOURCE_GROUP, (void*) &request,
+				sizeof(struct group_source_req)))
+			error_code = boost::system::error_code(errno, boost::asio::error::get_system_category());
+#else
+		error_code = boost::asio::error::operation_not_supported;
+#endif
+	}
+
+	if (error_code)
+	{
+		string message("Failed to " + action + " multicast group '" + group + "'" + (source.empty() ? string() : " from source '"
+				+ source + "'") + ": '" + error_code.message() + "'");
+		Logger::error(message, port, host);
+		fire_error(message);
+		return false;
+	}
+
+	Logger::info(string("udpserver: ") + (join ? "joined" : "left") + " multicast group '" + group + "'", port, host);
+
+	if (join && !reporting_destinations)
+	{
+		// A group joined at runtime is told apart from the others by the destination only the receive ring reads. Until
+		// listening starts the ring can be chosen here, after that only on the strand the receives run on.
+		report_destinations();
+
+		if (reporting_destinations && !receive_ring)
+		{
+			if (listening)
+				strand.dispatch(boost::bind(&UdpServer::use_receive_ring, this));
+			else
+				receive_ring.reset(new UdpReceiveRing(buffer_pool, 1));
+		}
+	}
+
+	return true;
+}
+
+FB::VariantMap UdpServer::get_receive_stats()
+{
+	FB::VariantMap stats;
+
+	receive_stats_mutex.lock();
+	stats["received"] = (double) received_datagrams;
+	stats["truncated"] = (double) truncated_datagrams;
+	// The drop count only arrives with the ancillary data the receive ring reads, so leave it out rather than claim none
+	if (receive_ring && counting_drops)
+		stats["drops"] = (double) kernel_drops;
+	stats["incomplete"] = (double) incomplete_messages;
+	receive_stats_mutex.unlock();
+
+	return stats;
 }
 
 int UdpServer::get_port()
@@ -210,7 +481,7 @@ void UdpServer::fire_error_event(const string & message)
 }
 
 
-void UdpServer::fire_data_event(const string data, boost::shared_ptr<udp::socket> socket, boost::shared_ptr<udp::endpoint> endpoint)
+void UdpServer::fire_data_event(SharedBufferPtr data, boost::shared_ptr<udp::socket> socket, boost::shared_ptr<udp::endpoint> endpoint)
 {
-	fire_data(boost::make_shared<UdpEvent>(this, socket, endpoint, data));
+	dispatch_data(create_event(data, socket, endpoint));
 }
@@ -5,6 +5,7 @@
 
 #include <boost/asio.hpp>
 #include <boost/bind.hpp>
+#include <boost/scoped_ptr.hpp>
 #include <boost/thread.hpp>
 
 #include "Udp.h"
@@ -33,8 +34,9 @@ class UdpServer: public Udp, public Server
 		 *
 		 * 	@param	port				The port on which this UDP server should listen
 		 * 	@param	io_service			The I/O service to use for asynchronous I/O requests
+		 * 	@param	buffer_pool			The pool from which buffers for sending data are leased
 		 */
-		UdpServer(int port, boost::asio::io_service & io_service);
+		UdpServer(int port, boost::asio::io_service & io_service, BufferPool & buffer_pool);
 
 		/**
 		 * A constructor that creates a UDP server using IPv6. There are two constructors to satisfy Boost's requirement that sockets are
@@ -43,9 +45,10 @@ class UdpServer: public Udp, public Server
 		 *
 		 * 	@param	port				The port on which this UDP server should listen
 		 * 	@param	io_service			The I/O service to use for asynchronous I/O requests
+		 * 	@param	buffer_pool			The pool from which buffers for sending data are leased
 		 *  @param options				A map of additional options to configure this UDP server
 		 */
-		UdpServer(int port, boost::asio::io_service & io_service, map<string, string> options);
+		UdpServer(int port, boost::asio::io_service & io_service, BufferPool & buffer_pool, map<string, string> options);
 
 		/**
 		 * Deconstructs a UDP server, immediately closing the incoming socket and pending operations.
@@ -70,6 +73,65 @@ class UdpServer: public Udp, public Server
 		 */
 		virtual int get_port();
 
+		/**
+		 * Gets the receive counters of this server, exposed to javascript as 'getReceiveStats'. Kernel drops are
+		 * 	reported by the kernel along with received datagrams, on platforms that report them, so are counted unless
+		 * 	the 'pendingReceives' option keeps several plain receives pending instead of receiving through the ring.
+		 *
+		 * 	@return	A map of 'received', the number of datagrams received, 'truncated', the number of those that
+		 * 			filled their buffer and so may have been truncated, 'drops', the number of datagrams the kernel
+		 * 			has dropped because the socket's receive buffer was full, which is left out when drops are not
+		 * 			counted, and 'incomplete', the number of fragmented messages given up on before all their
+		 * 			fragments arrived
+		 */
+		FB::VariantMap get_receive_stats();
+
+		/**
+		 * Joins a multicast group on this server's socket, exposed to javascript as 'joinGroup'. Groups may be joined
+		 * 	and left at any time, and datagrams sent to any of them are received by the one socket. Once a group is
+		 * 	joined, each data event reports the group its datagram was sent to, on platforms that report it.
+		 *
+		 * 	@param	group	The address of the group to join
+		 * 	@return	True if the group was joined, and false otherwise, after firing an error
+		 */
+		bool join_group(const string & group);
+
+		/**
+		 * Leaves a multicast group joined with <code>join_group</code>, exposed to javascript as 'leaveGroup'.
+		 *
+		 * 	@param	group	The address of the group to leave
+		 * 	@return	True if the group was left, and false otherwise, after firing an error
+		 */
+		bool leave_group(const string & group);
+
+		/**
+		 * Joins a multicast group on this server's socket for the datagrams sent to it from a single source, exposed
+		 * 	to javascript as 'joinSourceGroup'.
+		 *
+		 * 	@param	group	The address of the group to join
+		 * 	@param	source	The address of the only sender to receive from
+		 * 	@return	True if the group was joined, and false otherwise, after firing an error
+		 */
+		bool join_source_group(const string & group, const string & source);
+
+		/**
+		 * Leaves a multicast group joined with <code>join_source_group</code>, exposed to javascript as
+		 * 	'leaveSourceGroup'.
+		 *
+		 * 	@param	group	The address of the group to leave
+		 * 	@param	source	The address of the sender the group was joined for
+		 * 	@return	True if the group was left, and false otherwise, after firing an error
+		 */
+		bool leave_source_group(const string & group, const string & source);
+
+		/**
+		 * Sets whether multicast datagrams sent from this server's socket are looped back to this host, exposed to
+		 * 	javascript as 'setMulticastLoopback'.
+		 *
+		 * 	@param	loopback	True to loop datagrams back, and false otherwise
+		 */
+		void set_multicast_loopback(bool loopback);
+
 		friend class UdpEvent;
 
 	protected:
@@ -84,11 +146,11 @@ class UdpServer: public Udp, public Server
 		/**
 		 * Helper to fire data event to javascript.
 		 *
-		 * 	@param	data	The data received
+		 * 	@param	data	The buffer holding the data received, which the event shares
 		 * 	@param	socket	The socket on which to reply to this data
 		 * 	@param	endpoint The connected endpoint to the remote host
 		 */
-		virtual void fire_data_event(const string data, boost::shared_ptr<udp::socket> socket, boost::shared_ptr<udp::endpoint> endpoint);
+		virtual void fire_data_event(SharedBufferPtr data, boost::shared_ptr<udp::socket> socket, boost::shared_ptr<udp::endpoint> endpoint);
 
 		/**
 		 * Immediately closes the incoming socket & acceptor, and stops all pending operations.
@@ -108,11 +170,40 @@ class UdpServer: public Udp, public Server
 		 */
 		void initialize(void);
 
+		/**
+		 * Helper function to enable drop accounting on the open socket, and to choose whether to receive through the
+		 * 	receive ring, which reads the ancillary data the kernel reports drops, timestamps and destinations in.
+		 */
+		void init_receive_ring();
+
+		/**
+		 * Helper function to have the kernel report the destination of each datagram received, once, so that events
+		 * 	report the multicast group their datagram was sent to.
+		 */
+		void report_destinations();
+
+		/**
+		 * Helper function to switch a listening server over to receiving through a receive ring of a single slot, so
+		 * 	that the destinations the kernel reports are read. Runs on the strand the receives run on.
+		 */
+		void use_receive_ring();
+
 		/**
 		 * Helper function to listen for new data from incoming connections.
 		 */
 		virtual void listen(void);
 
+		/**
+		 * Joins or leaves a multicast group, for all senders or for a single source, logging and firing an error if
+		 * 	the change fails.
+		 *
+		 * 	@param	group	The address of the group
+		 * 	@param	source	The address of the single sender, or empty for all senders
+		 * 	@param	join	True to join the group, and false to leave it
+		 * 	@return	True if the membership was changed, and false otherwise
+		 */
+		bool change_membership(const string & group, const string & source, bool join);
+
 		/**
 		 * The socket for incoming communications to this server.
 		 */
@@ -120,6 +211,12 @@ class UdpServer: public Udp, public Server
 
         /** A flag to indicate this object is already listening */
         bool listening;
+
+		/** Whether the kernel reports the datagrams it drops on this server's socket */
+		bool counting_drops;
+
+		/** Whether the kernel reports the destination of each datagram received on this server's socket */
+		bool reporting_destinations;
 };
 
 #endif